@@ -24,15 +24,15 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <Common/Util.hpp>
 
-constexpr const char* INSTRUCTIONS_STR = "add mul sub div smul sdiv or xor nor xnor and nand not cmp inc dec shl shr ret call jmp jc jnc jz jnz jl jle jnl jnle jg jge jng jnge mov nop hlt push pop pusha popa int lidt iret syscall sysret enteruser";
-constexpr size_t INSTRUCTIONS_STR_LEN = 205 - 1;
+constexpr const char* INSTRUCTIONS_STR = "add mul sub div smul sdiv or xor nor xnor and nand not cmp inc dec shl shr ret call jmp jc jnc jz jnz jl jle jnl jnle jg jge jng jnge mov nop hlt push pop pusha popa int lidt iret syscall sysret enteruser invlpg invasid";
+constexpr size_t INSTRUCTIONS_STR_LEN = 220 - 1;
 
 bool IsInstruction(const std::string& str) {
     const char* rawToken = str.c_str();
     if (const char* ins = strstr(INSTRUCTIONS_STR, rawToken); ins != nullptr) {
         if (ins != INSTRUCTIONS_STR && ins[-1] != ' ')
             return false;
-        if (size_t strSize = str.size(); INSTRUCTIONS_STR + INSTRUCTIONS_STR_LEN <= ins + strSize && ins[strSize] != ' ')
+        if (size_t strSize = str.size(); ins + strSize < INSTRUCTIONS_STR + INSTRUCTIONS_STR_LEN && ins[strSize] != ' ')
             return false;
         return true;
     }
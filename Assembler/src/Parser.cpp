@@ -1601,6 +1601,8 @@ InsEncoding::Opcode Parser::GetOpcode(const char* name, size_t nameSize) {
         INSERT_OPCODE(syscall, SYSCALL, 7);
         INSERT_OPCODE(sysret, SYSRET, 6);
         INSERT_OPCODE(enteruser, ENTERUSER, 9);
+        INSERT_OPCODE(invlpg, INVLPG, 6);
+        INSERT_OPCODE(invasid, INVASID, 7);
 #undef INSERT_OPCODE
         m_opcodeTableInitialised = true;
     }
@@ -2377,6 +2379,8 @@ const char* Parser::GetInstructionName(InsEncoding::Opcode opcode) {
         NAME_CASE(SYSCALL)
         NAME_CASE(SYSRET)
         NAME_CASE(ENTERUSER)
+        NAME_CASE(INVLPG)
+        NAME_CASE(INVASID)
         NAME_CASE(UNKNOWN)
     }
 #undef NAME_CASE
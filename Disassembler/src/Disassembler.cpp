@@ -254,6 +254,8 @@ const char* Disassembler::GetInstructionName(InsEncoding::Opcode opcode) {
         NAME_CASE(SYSCALL, syscall)
         NAME_CASE(SYSRET, sysret)
         NAME_CASE(ENTERUSER, enteruser)
+        NAME_CASE(INVLPG, invlpg)
+        NAME_CASE(INVASID, invasid)
         NAME_CASE(UNKNOWN, unknown)
     }
 #undef NAME_CASE
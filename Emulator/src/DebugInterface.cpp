@@ -36,6 +36,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <IO/IOInterfaceManager.hpp>
 
+#include <IO/Devices/Video/VideoBackend.hpp>
+
+#include <MMU/Epoch.hpp>
+#include <MMU/MemoryControlSystem.hpp>
 #include <MMU/MMU.hpp>
 #include <MMU/VirtualMMU.hpp>
 
@@ -43,6 +47,9 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <Common/Util.hpp>
 
+// Bytes of guest memory dump copies out at a time
+#define DEBUG_DUMP_CHUNK_SIZE 4096
+
 DebugInterface::DebugInterface(IOInterfaceType type, MMU* physicalMMU, VirtualMMU* virtualMMU, const std::string_view& data) : IOInterfaceItem(type, data), m_physicalMMU(physicalMMU), m_virtualMMU(virtualMMU), m_thread(nullptr), m_waitLock(0), m_eventPending(0), m_handlingEvents(0) {
 }
 
@@ -80,6 +87,12 @@ void DebugInterface::InterfaceInit() {
     m_commands["dump"] = [this](auto&& PH1) {
         return Command_Dump(std::forward<decltype(PH1)>(PH1));
     };
+    m_commands["frame"] = [this](auto&& PH1) {
+        return Command_Frame(std::forward<decltype(PH1)>(PH1));
+    };
+    m_commands["balloon"] = [this](auto&& PH1) {
+        return Command_Balloon(std::forward<decltype(PH1)>(PH1));
+    };
 
     // build the command alias map
     m_commandAliases["help"] = "help";
@@ -111,6 +124,12 @@ void DebugInterface::InterfaceInit() {
     m_commandAliases["dump"] = "dump";
     m_commandAliases["dmp"] = "dump";
 
+    m_commandAliases["frame"] = "frame";
+    m_commandAliases["fr"] = "frame";
+
+    m_commandAliases["balloon"] = "balloon";
+    m_commandAliases["bl"] = "balloon";
+
     // build the command help map
     m_commandHelp["help"] = "display this help message";
     m_commandHelp["quit"] = "quit the emulator";
@@ -121,6 +140,8 @@ void DebugInterface::InterfaceInit() {
     m_commandHelp["delete"] = "delete a breakpoint";
     m_commandHelp["info"] = "display information about the emulator";
     m_commandHelp["dump"] = "dump portions of physical or virtual memory";
+    m_commandHelp["frame"] = "dump the next video frame or display frame statistics";
+    m_commandHelp["balloon"] = "display the memory balloon or set how many bytes the guest should give back";
 
 
     spinlock_acquire(&m_waitLock);
@@ -181,12 +202,22 @@ void DebugInterface::MainLoop() {
             // 2. read input
             std::stringstream input;
             char c = 0;
+            bool closed = false;
             do {
-                g_IOInterfaceManager->Read(this, &c, 1);
+                if (g_IOInterfaceManager->Read(this, &c, 1) == 0) {
+                    closed = true;
+                    break;
+                }
                 if (isprint(c)) // ignore non-printable characters
                     input << c;
             } while (c != '\n');
 
+            if (closed) {
+                // no more commands can come, so let the guest run instead of trying to read forever
+                result = Command_Continue({});
+                continue;
+            }
+
             // 3. parse input
             // need to break the input into tokens, each separated by a space
             // the first token is the command, the rest are arguments
@@ -356,7 +387,7 @@ void DI_WriteHandler(void* data, const char* format, ...) {
 bool DebugInterface::Command_Info(const std::vector<std::string_view>& args) {
     if (args.empty()) {
         g_IOInterfaceManager->Write(this, "Usage: info <command>\n");
-        g_IOInterfaceManager->Write(this, "Available commands: registers, memory\n");
+        g_IOInterfaceManager->Write(this, "Available commands: registers, memory, tlb\n");
         return true;
     }
 
@@ -365,6 +396,8 @@ bool DebugInterface::Command_Info(const std::vector<std::string_view>& args) {
         Emulator::DumpRegisters(DI_WriteHandler, this);
     else if (command == "memory")
         m_physicalMMU->PrintRegions(DI_WriteHandler, this);
+    else if (command == "tlb")
+        VirtualMMU::PrintTLBStatistics(DI_WriteHandler, this);
     else
         g_IOInterfaceManager->Write(this, "Unknown command\n");
 
@@ -393,7 +426,24 @@ bool DebugInterface::Command_Dump(const std::vector<std::string_view>& args) {
 
     MMU* mmu = phys ? m_physicalMMU : m_virtualMMU;
 
-    if (!mmu->ValidateRead(address, size)) {
+    // The debugger has its own thread, so the memory map can change under it. Memory is copied out a chunk at a time under a guard,
+    // and only written out once it is released, so a slow connection doesn't hold up changes to the map.
+    uint8_t chunk[DEBUG_DUMP_CHUNK_SIZE];
+    auto readChunk = [&](uint64_t from) {
+        Epoch::ReadGuard guard;
+        uint64_t chunkSize = MIN(end - from, static_cast<uint64_t>(DEBUG_DUMP_CHUNK_SIZE));
+        if (!mmu->ValidateRead(from, chunkSize))
+            return false;
+        mmu->ReadBuffer(from, chunk, chunkSize);
+        return true;
+    };
+
+    bool valid;
+    {
+        Epoch::ReadGuard guard;
+        valid = mmu->ValidateRead(address, size);
+    }
+    if (!valid) {
         g_IOInterfaceManager->Write(this, "Invalid region\n");
         return true;
     }
@@ -404,6 +454,11 @@ bool DebugInterface::Command_Dump(const std::vector<std::string_view>& args) {
     uint8_t buffer_index = 0;
     uint8_t last_printed = 0;
     for (uint64_t i = address; i < end; i++, buffer_index++) {
+        // copy out the next chunk, checking it again as the map can have changed since
+        if ((i - address) % DEBUG_DUMP_CHUNK_SIZE == 0 && !readChunk(i)) {
+            g_IOInterfaceManager->Write(this, "Invalid region\n");
+            return true;
+        }
         if ((i - address) % 16 == 0 && i != address) {
             buffer_index = 0;
             if (i > 16 && end - i > 16) {
@@ -425,7 +480,7 @@ bool DebugInterface::Command_Dump(const std::vector<std::string_view>& args) {
             g_IOInterfaceManager->WriteFormatted(this, "|\n");
             buffer_index = 0;
         }
-        buffer[buffer_index] = mmu->read8(i);
+        buffer[buffer_index] = chunk[(i - address) % DEBUG_DUMP_CHUNK_SIZE];
     }
     
     // print any remaining bytes
@@ -451,3 +506,52 @@ bool DebugInterface::Command_Dump(const std::vector<std::string_view>& args) {
 
     return true;
 }
+
+bool DebugInterface::Command_Frame(const std::vector<std::string_view>& args) {
+    if (args.empty()) {
+        g_IOInterfaceManager->Write(this, "Usage: frame <command>\n");
+        g_IOInterfaceManager->Write(this, "Available commands: dump, stats\n");
+        return true;
+    }
+
+    VideoDevice* device = Emulator::GetVideoDevice();
+    VideoBackend* backend = device != nullptr ? device->GetBackend() : nullptr;
+    if (backend == nullptr) {
+        g_IOInterfaceManager->Write(this, "Video device is not initialised\n");
+        return true;
+    }
+
+    const std::string_view& command = args[0];
+    if (command == "dump") {
+        if (backend->RequestFrameDump())
+            g_IOInterfaceManager->Write(this, "Dumping next frame\n");
+        else
+            g_IOInterfaceManager->Write(this, "No frame dump output configured\n");
+    } else if (command == "stats")
+        backend->PrintStatistics(DI_WriteHandler, this);
+    else
+        g_IOInterfaceManager->Write(this, "Unknown command\n");
+
+    return true;
+}
+
+bool DebugInterface::Command_Balloon(const std::vector<std::string_view>& args) {
+    MemoryControlSystem* memControl = Emulator::GetMemoryControl();
+    if (memControl == nullptr) {
+        g_IOInterfaceManager->Write(this, "Memory control system is not initialised\n");
+        return true;
+    }
+
+    if (!args.empty()) {
+        uint64_t target = strtoull(args[0].data(), nullptr, 0);
+        if (target > memControl->GetRAMSize()) {
+            g_IOInterfaceManager->Write(this, "Target is larger than RAM\n");
+            return true;
+        }
+        memControl->SetBalloonTarget(target);
+    }
+
+    g_IOInterfaceManager->WriteFormatted(this, "Balloon: %lu KiB of %lu KiB target, %lu KiB RAM, %lu KiB reported free\n", memControl->GetBalloonSize() / 1024,
+                                         memControl->GetBalloonTarget() / 1024, memControl->GetRAMSize() / 1024, memControl->GetFreedSize() / 1024);
+    return true;
+}
@@ -66,6 +66,8 @@ private:
     COMMAND(Delete);
     COMMAND(Info);
     COMMAND(Dump);
+    COMMAND(Frame);
+    COMMAND(Balloon);
 
 #undef COMMAND
 
@@ -33,11 +33,13 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <IO/IOMemoryRegion.hpp>
 #include <MMU/BIOSMemoryRegion.hpp>
 #include <MMU/MMU.hpp>
+#include <MMU/SharedRAM.hpp>
 #include <MMU/StandardMemoryRegion.hpp>
 #include <MMU/VirtualMMU.hpp>
 #include <Register.hpp>
 #include <Stack.hpp>
 #include <thread>
+#include <type_traits>
 
 #include "IO/Devices/Video/backends/XCB/XCBVideoBackend.hpp"
 #include "MMU/SystemControlMemoryRegion.hpp"
@@ -85,6 +87,7 @@ namespace Emulator {
     } g_privilegeMode = PrivilegeMode::REAL_MODE;
     bool g_isInUserMode = false;
     bool g_isPagingEnabled = false;
+    bool g_isASIDEnabled = false;
 
     LinkedList::LockableLinkedList<Event> g_events;
     std::atomic_uchar g_eventWait = 0;
@@ -97,50 +100,65 @@ namespace Emulator {
 
     DebugInterface* g_DebugInterface = nullptr;
 
-    void HandleMemoryOperation(uint64_t address, void* data, uint64_t size, uint64_t count, bool write) {
-        if (write) {
-            for (uint64_t i = 0; i < count; i++) {
-                switch (size) {
-                case 1:
-                    g_CurrentMMU->write8(address + i, static_cast<uint8_t*>(data)[i]);
-                    break;
-                case 2:
-                    g_CurrentMMU->write16(address + i * 2, static_cast<uint16_t*>(data)[i]);
-                    break;
-                case 4:
-                    g_CurrentMMU->write32(address + i * 4, static_cast<uint32_t*>(data)[i]);
-                    break;
-                case 8:
-                    g_CurrentMMU->write64(address + i * 8, static_cast<uint64_t*>(data)[i]);
-                    break;
-                default:
-                    printf("Invalid size: %lu\n", size);
-                    abort();
-                }
-            }
-        } else {
-            for (uint64_t i = 0; i < count; i++) {
-                switch (size) {
-                case 1:
-                    static_cast<uint8_t*>(data)[i] = g_CurrentMMU->read8(address + i);
-                    break;
-                case 2:
-                    static_cast<uint16_t*>(data)[i] = g_CurrentMMU->read16(address + i * 2);
-                    break;
-                case 4:
-                    static_cast<uint32_t*>(data)[i] = g_CurrentMMU->read32(address + i * 4);
-                    break;
-                case 8:
-                    static_cast<uint64_t*>(data)[i] = g_CurrentMMU->read64(address + i * 8);
-                    break;
-                default:
-                    printf("Invalid size: %lu\n", size);
-                    abort();
-                }
+    /*
+     * Access is MMU without paging, or the PagingMMU for the paging configuration, so neither the configuration
+     * nor which MMU is current has to be checked on each access.
+     */
+    template <typename Access, typename T>
+    void MemoryOperation(Access* mmu, uint64_t address, T* data, uint64_t count, bool write) {
+        for (uint64_t i = 0; i < count; i++) {
+            if constexpr (std::is_same_v<Access, MMU>) {
+                if (write)
+                    mmu->template WritePhysical<T>(address + i * sizeof(T), data[i]);
+                else
+                    data[i] = mmu->template ReadPhysical<T>(address + i * sizeof(T));
+            } else {
+                if (write)
+                    mmu->template write<T>(address + i * sizeof(T), data[i]);
+                else
+                    data[i] = mmu->template read<T>(address + i * sizeof(T));
             }
         }
     }
 
+    template <typename Access>
+    void MemoryOperation(uint64_t address, void* data, uint64_t size, uint64_t count, bool write) {
+        Access* mmu = static_cast<Access*>(g_CurrentMMU);
+        switch (size) {
+        case 1:
+            MemoryOperation(mmu, address, static_cast<uint8_t*>(data), count, write);
+            break;
+        case 2:
+            MemoryOperation(mmu, address, static_cast<uint16_t*>(data), count, write);
+            break;
+        case 4:
+            MemoryOperation(mmu, address, static_cast<uint32_t*>(data), count, write);
+            break;
+        case 8:
+            MemoryOperation(mmu, address, static_cast<uint64_t*>(data), count, write);
+            break;
+        default:
+            printf("Invalid size: %lu\n", size);
+            abort();
+        }
+    }
+
+    // Instantiation for the current paging configuration, only changed alongside g_CurrentMMU
+    void (*g_memoryOperation)(uint64_t address, void* data, uint64_t size, uint64_t count, bool write) = MemoryOperation<MMU>;
+
+    template <PageSize Size, PageTableLevelCount Levels>
+    void EnablePaging() {
+        g_virtualMMU = new PagingMMU<Size, Levels>(&g_physicalMMU, 0);
+        g_memoryOperation = MemoryOperation<PagingMMU<Size, Levels>>;
+    }
+
+    // Indexed by PageSize then PageTableLevelCount, nullptr where the combination isn't supported
+    constexpr void (*g_enablePaging[3][3])() = {
+        {EnablePaging<PS_4KiB, PTLC_3>, EnablePaging<PS_4KiB, PTLC_4>, EnablePaging<PS_4KiB, PTLC_5>},
+        {EnablePaging<PS_16KiB, PTLC_3>, EnablePaging<PS_16KiB, PTLC_4>, EnablePaging<PS_16KiB, PTLC_5>},
+        {EnablePaging<PS_64KiB, PTLC_3>, EnablePaging<PS_64KiB, PTLC_4>, nullptr}
+    };
+
     void RaiseEvent(Event event) {
         g_events.lock();
         Event* new_event = new Event(event);
@@ -186,6 +204,31 @@ namespace Emulator {
                     device->StartTransfer();
                     break;
                 }
+                case EventType::ConsoleInput: {
+                    ConsoleDevice* device = reinterpret_cast<ConsoleDevice*>(event->data);
+                    device->HandleInputEvent();
+                    break;
+                }
+                case EventType::ConsoleTransfer: {
+                    ConsoleDevice* device = reinterpret_cast<ConsoleDevice*>(event->data);
+                    device->HandleTransferEvent();
+                    break;
+                }
+                case EventType::VideoFlip: {
+                    VideoDevice* device = reinterpret_cast<VideoDevice*>(event->data);
+                    device->HandleFlipEvent();
+                    break;
+                }
+                case EventType::VideoBlit: {
+                    VideoDevice* device = reinterpret_cast<VideoDevice*>(event->data);
+                    device->HandleBlitEvent();
+                    break;
+                }
+                case EventType::SharedRAMPublish: {
+                    SharedRAM* shared = reinterpret_cast<SharedRAM*>(event->data);
+                    shared->HandlePublishEvent();
+                    break;
+                }
                 default:
                     break;
                 }
@@ -223,7 +266,7 @@ namespace Emulator {
         g_IOInterfaceManager = new IOInterfaceManager();
 
         // Configure the console device
-        g_ConsoleDevice = new ConsoleDevice(16, consoleMode);
+        g_ConsoleDevice = new ConsoleDevice(&g_physicalMMU, 16, consoleMode);
         g_IOBus->AddDevice(g_ConsoleDevice);
         g_IOInterfaceManager->AddInterfaceItem(g_ConsoleDevice);
 
@@ -447,6 +490,16 @@ namespace Emulator {
         ExecutionThread = new std::thread(ExecutionLoop);
     }
 
+    void LoadPageTableRoot() {
+        uint64_t value = g_registers.Control[3]->GetValue();
+        g_registers.Control[3]->SetDirty(false);
+        if (g_isASIDEnabled) {
+            g_virtualMMU->SetPageTableRoot(value & ~(CR3_ASID_MASK | CR3_KEEP_TRANSLATIONS), value & CR3_ASID_MASK, (value & CR3_KEEP_TRANSLATIONS) > 0);
+            g_registers.Control[3]->SetValueNoCheck(value & ~CR3_KEEP_TRANSLATIONS); // KEEP only applies to the write
+        } else
+            g_virtualMMU->SetPageTableRoot(value);
+    }
+
     void SyncRegisters() {
         if (g_registers.Control[0]->IsDirty()) {
             uint64_t control = g_registers.Control[0]->GetValue();
@@ -457,7 +510,7 @@ namespace Emulator {
                 if (g_isPagingEnabled) {
                     PageSize pageSize = static_cast<PageSize>((control & 0xC) >> 2);
                     PageTableLevelCount pageTableLevelCount = static_cast<PageTableLevelCount>((control & 0x30) >> 4);
-                    if (pageSize == PS_64KiB && pageTableLevelCount == PTLC_5) {
+                    if (pageSize > PS_64KiB || pageTableLevelCount > PTLC_5 || g_enablePaging[pageSize][pageTableLevelCount] == nullptr) {
                         // restore any changes
                         if (!wasInProtectedMode && g_privilegeMode == PrivilegeMode::PROTECTED_MODE)
                             g_privilegeMode = PrivilegeMode::REAL_MODE;
@@ -465,12 +518,13 @@ namespace Emulator {
                         g_registers.Control[0]->SetDirty(false);
                         g_ExceptionHandler->RaiseException(Exception::INVALID_INSTRUCTION);
                     }
-                    uint64_t pageTableRoot = g_registers.Control[3]->GetValue();
-                    g_registers.Control[3]->SetDirty(false);
-                    g_virtualMMU = new VirtualMMU(&g_physicalMMU, pageTableRoot, pageSize, pageTableLevelCount);
+                    g_isASIDEnabled = (control & 0x40) > 0;
+                    g_enablePaging[pageSize][pageTableLevelCount]();
+                    LoadPageTableRoot();
                     g_CurrentMMU = g_virtualMMU;
                 } else {
                     g_CurrentMMU = &g_physicalMMU;
+                    g_memoryOperation = MemoryOperation<MMU>;
                     delete g_virtualMMU;
                 }
                 g_registers.Control[0]->SetDirty(false);
@@ -479,13 +533,26 @@ namespace Emulator {
                 EmulatorThread->join();
                 Crash("Emulator thread exited unexpectedly"); // should be unreachable
             }
+            if (g_isPagingEnabled && ((control & 0x40) > 0) != g_isASIDEnabled) {
+                // existing tags no longer mean anything, and CR3 has to be read again with the new layout
+                g_isASIDEnabled = (control & 0x40) > 0;
+                g_virtualMMU->FlushTLB();
+                g_registers.Control[3]->SetDirty(true);
+            }
             g_registers.Control[0]->SetDirty(false);
         }
-        if (g_registers.Control[3]->IsDirty() && g_isPagingEnabled) {
-            uint64_t pageTableRoot = g_registers.Control[3]->GetValue();
-            g_registers.Control[3]->SetDirty(false);
-            g_virtualMMU->SetPageTableRoot(pageTableRoot);
-        }
+        if (g_registers.Control[3]->IsDirty() && g_isPagingEnabled)
+            LoadPageTableRoot();
+    }
+
+    void InvalidatePage(uint64_t address) {
+        if (g_isPagingEnabled)
+            g_virtualMMU->InvalidatePage(address);
+    }
+
+    void InvalidateAddressSpace(uint64_t asid) {
+        if (g_isPagingEnabled)
+            g_virtualMMU->FlushAddressSpace(asid & CR3_ASID_MASK);
     }
 
     [[noreturn]] void Crash(const char* message) {
@@ -558,4 +625,12 @@ namespace Emulator {
         return g_DebugInterface;
     }
 
+    VideoDevice* GetVideoDevice() {
+        return g_VideoDevice;
+    }
+
+    MemoryControlSystem* GetMemoryControl() {
+        return g_SysControlMemoryRegion != nullptr ? g_SysControlMemoryRegion->GetMemoryControl() : nullptr;
+    }
+
 } // namespace Emulator
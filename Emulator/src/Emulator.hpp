@@ -27,6 +27,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <IO/Devices/Video/VideoBackend.hpp>
 
 class DebugInterface;
+class MemoryControlSystem;
 
 namespace Emulator {
 
@@ -39,7 +40,12 @@ namespace Emulator {
     enum class EventType {
         SwitchToIP,
         NewMMU,
-        StorageTransfer
+        StorageTransfer,
+        ConsoleInput,
+        ConsoleTransfer,
+        VideoFlip,
+        VideoBlit,
+        SharedRAMPublish
     };
 
     struct Event {
@@ -49,13 +55,16 @@ namespace Emulator {
 
     void RaiseEvent(Event event);
 
-    void HandleMemoryOperation(uint64_t address, void* data, uint64_t size, uint64_t count, bool write);
+    // Operands are rebuilt for every instruction and a CR0 change restarts the execution thread, so they can hold this directly
+    extern void (*g_memoryOperation)(uint64_t address, void* data, uint64_t size, uint64_t count, bool write);
 
     int Start(uint8_t* program, size_t size, size_t ramSize, const std::string_view& consoleMode, const std::string_view& debugConsoleMode, bool has_display = false, VideoBackendType displayType = VideoBackendType::NONE, bool has_drive = false, const char* drivePath = nullptr);
     int RequestEmulatorStop();
     int SendInstruction(uint64_t instruction);
 
     DebugInterface* GetDebugInterface();
+    VideoDevice* GetVideoDevice();
+    MemoryControlSystem* GetMemoryControl();
 
     void SetCPUStatus(uint64_t mask);
     void ClearCPUStatus(uint64_t mask);
@@ -76,6 +85,10 @@ namespace Emulator {
 
 
     void SyncRegisters();
+
+    // Both do nothing when paging is disabled
+    void InvalidatePage(uint64_t address);
+    void InvalidateAddressSpace(uint64_t asid);
     void DumpRegisters(void (*write)(void*, const char*, ...), void* data = nullptr);
 
     Register* GetRegisterPointer(uint8_t ID);
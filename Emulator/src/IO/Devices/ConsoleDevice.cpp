@@ -17,19 +17,37 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "ConsoleDevice.hpp"
 
+#include <cstddef>
+
 #include <Emulator.hpp>
 
+#include <Common/Util.hpp>
+
 #include <IO/IOInterfaceManager.hpp>
 
 #ifdef EMULATOR_DEBUG
 #include <stdio.h>
 #endif
 
-ConsoleDevice::ConsoleDevice(uint64_t size, const std::string_view& data)
-    : IODevice(IODeviceID::CONSOLE, size, 0), IOInterfaceItem(IOInterfaceType::UNKNOWN, data) {
+ConsoleDevice::ConsoleDevice(MMU* PhysicalMMU, uint64_t size, const std::string_view& data)
+    : IODevice(IODeviceID::CONSOLE, size, 2), IOInterfaceItem(IOInterfaceType::UNKNOWN, data), m_PhysicalMMU(PhysicalMMU), m_command(0), m_request(0), m_error(false), m_transferInterruptPending(false), m_inputThread(nullptr), m_inputBuffer{}, m_inputHead(0), m_inputTail(0), m_inputSignal(0), m_inputEnded(false), m_inputStopping(false), m_interruptsEnabled(false), m_interruptPending(false), m_nonBlocking(false) {
 }
 
 ConsoleDevice::~ConsoleDevice() {
+    if (m_inputThread != nullptr) {
+        // no more interrupts for this device, then wake the thread wherever it is waiting
+        m_interruptsEnabled.store(false);
+        m_inputStopping.store(true);
+        g_IOInterfaceManager->RemoveInterfaceItem(this);
+        m_inputTail.store(m_inputHead.load()); // the buffered input is thrown away
+        m_inputTail.notify_one();
+        m_inputThread->join();
+        delete m_inputThread;
+    } else
+        g_IOInterfaceManager->RemoveInterfaceItem(this);
+
+    // nothing can be reading from the interface anymore
+    g_IOInterfaceManager->DestroyInterfaceItem(this);
 }
 
 void ConsoleDevice::InterfaceInit() {
@@ -44,73 +62,276 @@ void ConsoleDevice::InterfaceWrite() {
 uint8_t ConsoleDevice::ReadByte(uint64_t address) {
 #ifdef EMULATOR_DEBUG
     printf("ConsoleDevice::ReadByte(%lu)\n", address);
-#else
-    (void)address;
 #endif
-    uint8_t data = 0;
-    g_IOInterfaceManager->Read(this, &data, 1);
-    return data;
+    switch (static_cast<ConsoleDeviceRegisters>(address)) {
+    case ConsoleDeviceRegisters::STATUS:
+    case ConsoleDeviceRegisters::CONTROL:
+    case ConsoleDeviceRegisters::COMMAND:
+    case ConsoleDeviceRegisters::REQUEST:
+        return ReadQWord(address) & 0xFF;
+    default: // every other port behaves as the data port for byte accesses
+        return ReadInput();
+    }
 }
 
 uint16_t ConsoleDevice::ReadWord(uint64_t address) {
 #ifdef EMULATOR_DEBUG
     printf("ConsoleDevice::ReadWord(%lu)\n", address);
-#else
-    (void)address;
 #endif
-    return 0;
+    return ReadQWord(address) & 0xFFFF;
 }
 
 uint32_t ConsoleDevice::ReadDWord(uint64_t address) {
 #ifdef EMULATOR_DEBUG
     printf("ConsoleDevice::ReadDWord(%lu)\n", address);
-#else
-    (void)address;
 #endif
-    return 0;
+    return ReadQWord(address) & 0xFFFF'FFFF;
 }
 
 uint64_t ConsoleDevice::ReadQWord(uint64_t address) {
 #ifdef EMULATOR_DEBUG
     printf("ConsoleDevice::ReadQWord(%lu)\n", address);
-#else
-    (void)address;
 #endif
-    return 0;
+    switch (static_cast<ConsoleDeviceRegisters>(address)) {
+    case ConsoleDeviceRegisters::STATUS: {
+        ConsoleDeviceStatus status = GetStatus();
+        return *reinterpret_cast<uint64_t*>(&status);
+    }
+    case ConsoleDeviceRegisters::CONTROL: {
+        ConsoleDeviceControl control = {};
+        control.INTE = m_interruptsEnabled.load() ? 1 : 0;
+        control.NBLK = m_nonBlocking.load() ? 1 : 0;
+        return *reinterpret_cast<uint64_t*>(&control);
+    }
+    case ConsoleDeviceRegisters::COMMAND:
+        return m_command;
+    case ConsoleDeviceRegisters::REQUEST:
+        return m_request;
+    default:
+        return 0;
+    }
 }
 
 void ConsoleDevice::WriteByte(uint64_t address, uint8_t data) {
 #ifdef EMULATOR_DEBUG
     printf("ConsoleDevice::WriteByte(%lu, %hhu)\n", address, data);
-#else
-    (void)address;
 #endif
-    g_IOInterfaceManager->Write(this, &data, 1);
+    switch (static_cast<ConsoleDeviceRegisters>(address)) {
+    case ConsoleDeviceRegisters::STATUS:
+    case ConsoleDeviceRegisters::CONTROL:
+    case ConsoleDeviceRegisters::COMMAND:
+    case ConsoleDeviceRegisters::REQUEST:
+        WriteQWord(address, data);
+        break;
+    default: // every other port behaves as the data port for byte accesses
+        g_IOInterfaceManager->Write(this, &data, 1);
+        break;
+    }
 }
 
 void ConsoleDevice::WriteWord(uint64_t address, uint16_t data) {
 #ifdef EMULATOR_DEBUG
     printf("ConsoleDevice::WriteWord(%lu, %hu)\n", address, data);
-#else
-    (void)address;
 #endif
-    (void)data;
+    WriteQWord(address, data);
 }
 
 void ConsoleDevice::WriteDWord(uint64_t address, uint32_t data) {
 #ifdef EMULATOR_DEBUG
     printf("ConsoleDevice::WriteDWord(%lu, %u)\n", address, data);
-#else
-    (void)address;
 #endif
-    (void)data;
+    WriteQWord(address, data);
 }
 
 void ConsoleDevice::WriteQWord(uint64_t address, uint64_t data) {
 #ifdef EMULATOR_DEBUG
     printf("ConsoleDevice::WriteQWord(%lu, %lu)\n", address, data);
-#else
-    (void)address;
 #endif
-    (void)data;
+    switch (static_cast<ConsoleDeviceRegisters>(address)) {
+    case ConsoleDeviceRegisters::STATUS: {
+        // Writing 1 to INTP or TINTP acknowledges that interrupt. Everything else is read-only.
+        ConsoleDeviceStatus* status = reinterpret_cast<ConsoleDeviceStatus*>(&data);
+        if (status->TINTP == 1)
+            m_transferInterruptPending.store(false);
+        if (status->INTP == 0)
+            break;
+        m_interruptPending.store(false);
+        // input that arrived before the acknowledge would otherwise never be signalled
+        if (m_interruptsEnabled.load() && m_inputHead.load() != m_inputTail.load() && !m_interruptPending.exchange(true))
+            Emulator::RaiseEvent({Emulator::EventType::ConsoleInput, reinterpret_cast<uint64_t>(this)});
+        break;
+    }
+    case ConsoleDeviceRegisters::CONTROL: {
+        ConsoleDeviceControl* control = reinterpret_cast<ConsoleDeviceControl*>(&data);
+        m_nonBlocking.store(control->NBLK == 1);
+        m_interruptsEnabled.store(control->INTE == 1);
+        StartInputThread();
+        if (control->INTE == 1 && m_inputHead.load() != m_inputTail.load() && !m_interruptPending.exchange(true))
+            Emulator::RaiseEvent({Emulator::EventType::ConsoleInput, reinterpret_cast<uint64_t>(this)});
+        break;
+    }
+    case ConsoleDeviceRegisters::COMMAND:
+        m_command = data;
+        HandleCommand(static_cast<ConsoleDeviceCommands>(m_command));
+        break;
+    case ConsoleDeviceRegisters::REQUEST:
+        m_request = data;
+        break;
+    default:
+        break;
+    }
+}
+
+void ConsoleDevice::HandleInputEvent() {
+    if (m_interruptsEnabled.load() && m_interruptPending.load())
+        RaiseInterrupt(static_cast<uint64_t>(ConsoleDeviceInterrupts::INPUT));
+}
+
+void ConsoleDevice::HandleTransferEvent() {
+    if (m_transferInterruptPending.load())
+        RaiseInterrupt(static_cast<uint64_t>(ConsoleDeviceInterrupts::TRANSFER));
+}
+
+void ConsoleDevice::HandleCommand(ConsoleDeviceCommands command) {
+    if (command != ConsoleDeviceCommands::WRITE && command != ConsoleDeviceCommands::READ) {
+        m_error.store(true);
+        return;
+    }
+
+    // COUNT is written back into the request
+    if (!m_PhysicalMMU->ValidateRead(m_request, sizeof(ConsoleDevice_TransferRequest)) || !m_PhysicalMMU->ValidateWrite(m_request + offsetof(ConsoleDevice_TransferRequest, COUNT), sizeof(uint64_t))) {
+        m_error.store(true);
+        return;
+    }
+
+    ConsoleDevice_TransferRequest request = {};
+    m_PhysicalMMU->ReadBuffer(m_request, reinterpret_cast<uint8_t*>(&request), sizeof(ConsoleDevice_TransferRequest));
+
+    // READ stores into the buffer, so it has to be writable rather than just readable
+    if (request.LENGTH > 0 && (request.ADDRESS + request.LENGTH < request.ADDRESS || !(command == ConsoleDeviceCommands::WRITE ? m_PhysicalMMU->ValidateRead(request.ADDRESS, request.LENGTH) : m_PhysicalMMU->ValidateWrite(request.ADDRESS, request.LENGTH)))) {
+        m_error.store(true);
+        return;
+    }
+
+    // Done right here on the CPU thread, a whole buffer only costs the one interface call (per chunk) so there is nothing gained by deferring it
+    uint64_t count;
+    if (command == ConsoleDeviceCommands::WRITE)
+        count = TransferToConsole(request.ADDRESS, request.LENGTH);
+    else
+        count = TransferFromConsole(request.ADDRESS, request.LENGTH);
+
+    m_PhysicalMMU->write64(m_request + offsetof(ConsoleDevice_TransferRequest, COUNT), count);
+    m_error.store(false);
+
+    // interrupts can't be raised from the CPU thread, so hand it to the emulator thread
+    if (request.FLAGS.INT == 1 && !m_transferInterruptPending.exchange(true))
+        Emulator::RaiseEvent({Emulator::EventType::ConsoleTransfer, reinterpret_cast<uint64_t>(this)});
+}
+
+uint64_t ConsoleDevice::TransferToConsole(uint64_t address, uint64_t length) {
+    uint8_t buffer[CONSOLE_TRANSFER_CHUNK_SIZE];
+    uint64_t offset = 0;
+    while (offset < length) {
+        uint64_t size = MIN(length - offset, CONSOLE_TRANSFER_CHUNK_SIZE);
+        m_PhysicalMMU->ReadBuffer(address + offset, buffer, size);
+        g_IOInterfaceManager->Write(this, buffer, size);
+        offset += size;
+    }
+    return length;
+}
+
+uint64_t ConsoleDevice::TransferFromConsole(uint64_t address, uint64_t length) {
+    if (length == 0 || !WaitForInput())
+        return 0;
+
+    // everything that is already buffered, in at most 2 pieces if the ring wraps
+    uint64_t tail = m_inputTail.load();
+    uint64_t count = MIN(m_inputHead.load() - tail, length);
+    uint64_t offset = tail % CONSOLE_INPUT_BUFFER_SIZE;
+    uint64_t first = MIN(count, CONSOLE_INPUT_BUFFER_SIZE - offset);
+    m_PhysicalMMU->WriteBuffer(address, &m_inputBuffer[offset], first);
+    if (first < count)
+        m_PhysicalMMU->WriteBuffer(address + first, m_inputBuffer, count - first);
+
+    m_inputTail.store(tail + count);
+    m_inputTail.notify_one();
+    return count;
+}
+
+void ConsoleDevice::StartInputThread() {
+    // Only ever called from the CPU thread. The thread is started lazily so an idle console doesn't consume the input of its interface.
+    if (m_inputThread == nullptr)
+        m_inputThread = new std::thread(&ConsoleDevice::InputThread, this);
+}
+
+void ConsoleDevice::InputThread() {
+    while (!m_inputStopping.load()) {
+        uint64_t head = m_inputHead.load();
+        uint64_t tail = m_inputTail.load();
+        uint64_t space = CONSOLE_INPUT_BUFFER_SIZE - (head - tail);
+        if (space == 0) {
+            m_inputTail.wait(tail); // wait for the CPU to consume some input
+            continue;
+        }
+
+        // read straight into the ring, only up to the wrap point
+        uint64_t offset = head % CONSOLE_INPUT_BUFFER_SIZE;
+        size_t count = g_IOInterfaceManager->Read(this, &m_inputBuffer[offset], MIN(space, CONSOLE_INPUT_BUFFER_SIZE - offset));
+        if (count == 0)
+            break;
+
+        m_inputHead.store(head + count);
+        m_inputSignal.fetch_add(1);
+        m_inputSignal.notify_all();
+
+        if (m_interruptsEnabled.load() && !m_interruptPending.exchange(true))
+            Emulator::RaiseEvent({Emulator::EventType::ConsoleInput, reinterpret_cast<uint64_t>(this)});
+    }
+
+    m_inputEnded.store(true);
+    m_inputSignal.fetch_add(1);
+    m_inputSignal.notify_all();
+
+    // let an interrupt-driven guest see STATUS.EOI
+    if (m_interruptsEnabled.load() && !m_interruptPending.exchange(true))
+        Emulator::RaiseEvent({Emulator::EventType::ConsoleInput, reinterpret_cast<uint64_t>(this)});
+}
+
+bool ConsoleDevice::WaitForInput() {
+    StartInputThread();
+
+    uint64_t tail = m_inputTail.load();
+    while (true) {
+        uint64_t signal = m_inputSignal.load();
+        if (m_inputHead.load() != tail)
+            return true;
+        if (m_nonBlocking.load() || m_inputEnded.load())
+            return false;
+        m_inputSignal.wait(signal);
+    }
+}
+
+uint8_t ConsoleDevice::ReadInput() {
+    if (!WaitForInput())
+        return 0;
+
+    uint64_t tail = m_inputTail.load();
+    uint8_t data = m_inputBuffer[tail % CONSOLE_INPUT_BUFFER_SIZE];
+    m_inputTail.store(tail + 1);
+    m_inputTail.notify_one();
+    return data;
+}
+
+ConsoleDeviceStatus ConsoleDevice::GetStatus() const {
+    uint64_t count = m_inputHead.load() - m_inputTail.load();
+    ConsoleDeviceStatus status = {};
+    status.DA = count > 0 ? 1 : 0;
+    status.EOI = m_inputEnded.load() ? 1 : 0;
+    status.INTE = m_interruptsEnabled.load() ? 1 : 0;
+    status.INTP = m_interruptPending.load() ? 1 : 0;
+    status.NBLK = m_nonBlocking.load() ? 1 : 0;
+    status.ERR = m_error.load() ? 1 : 0;
+    status.TINTP = m_transferInterruptPending.load() ? 1 : 0;
+    status.COUNT = static_cast<uint32_t>(count);
+    return status;
 }
@@ -18,12 +18,67 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef _CONSOLE_IO_DEVICE_HPP
 #define _CONSOLE_IO_DEVICE_HPP
 
+#include <atomic>
+#include <thread>
+
 #include <IO/IODevice.hpp>
 #include <IO/IOInterfaceItem.hpp>
 
+#include <MMU/MMU.hpp>
+
+#define CONSOLE_INPUT_BUFFER_SIZE 4096
+#define CONSOLE_TRANSFER_CHUNK_SIZE 4096
+
+enum class ConsoleDeviceRegisters {
+    DATA = 0,
+    STATUS = 1,
+    CONTROL = 2,
+    COMMAND = 3,
+    REQUEST = 4
+};
+
+enum class ConsoleDeviceCommands {
+    WRITE = 0,
+    READ = 1
+};
+
+enum class ConsoleDeviceInterrupts {
+    INPUT = 0,
+    TRANSFER = 1
+};
+
+struct [[gnu::packed]] ConsoleDeviceStatus {
+    uint8_t DA     : 1;
+    uint8_t EOI    : 1;
+    uint8_t INTE   : 1;
+    uint8_t INTP   : 1;
+    uint8_t NBLK   : 1;
+    uint8_t ERR    : 1;
+    uint8_t TINTP  : 1;
+    uint32_t RSVD  : 25;
+    uint32_t COUNT : 32;
+};
+
+struct [[gnu::packed]] ConsoleDeviceControl {
+    uint8_t INTE  : 1;
+    uint8_t NBLK  : 1;
+    uint64_t RSVD : 62;
+};
+
+// Same for read and write
+struct [[gnu::packed]] ConsoleDevice_TransferRequest {
+    uint64_t ADDRESS;
+    uint64_t LENGTH;
+    struct [[gnu::packed]] CD_TRQ_FLAGS {
+        uint8_t INT   : 1;
+        uint64_t RSVD : 63;
+    } FLAGS;
+    uint64_t COUNT; // filled in by the device
+};
+
 class ConsoleDevice : public IODevice, public IOInterfaceItem {
 public:
-    ConsoleDevice(uint64_t size, const std::string_view& data);
+    ConsoleDevice(MMU* PhysicalMMU, uint64_t size, const std::string_view& data);
     virtual ~ConsoleDevice();
 
     virtual void InterfaceInit() override;
@@ -40,6 +95,44 @@ public:
     virtual void WriteWord(uint64_t address, uint16_t data) override;
     virtual void WriteDWord(uint64_t address, uint32_t data) override;
     virtual void WriteQWord(uint64_t address, uint64_t data) override;
+
+    // Called on the emulator thread in response to a ConsoleInput event
+    void HandleInputEvent();
+    // Called on the emulator thread in response to a ConsoleTransfer event
+    void HandleTransferEvent();
+
+private:
+    void StartInputThread();
+    void InputThread();
+
+    uint8_t ReadInput();
+    bool WaitForInput();
+
+    void HandleCommand(ConsoleDeviceCommands command);
+    uint64_t TransferToConsole(uint64_t address, uint64_t length);
+    uint64_t TransferFromConsole(uint64_t address, uint64_t length);
+    ConsoleDeviceStatus GetStatus() const;
+
+private:
+    MMU* m_PhysicalMMU;
+    uint64_t m_command;
+    uint64_t m_request;
+    std::atomic_bool m_error;
+    std::atomic_bool m_transferInterruptPending;
+
+    std::thread* m_inputThread;
+
+    // Single producer (the input thread), single consumer (the CPU). Both are free-running counters, the buffer index is the counter modulo the buffer size.
+    uint8_t m_inputBuffer[CONSOLE_INPUT_BUFFER_SIZE];
+    std::atomic_uint64_t m_inputHead;
+    std::atomic_uint64_t m_inputTail;
+    std::atomic_uint64_t m_inputSignal; // bumped whenever input arrives or ends, what a blocking read waits on
+    std::atomic_bool m_inputEnded;
+    std::atomic_bool m_inputStopping; // set when the device is destroyed, the input thread exits as soon as it sees it
+
+    std::atomic_bool m_interruptsEnabled;
+    std::atomic_bool m_interruptPending;
+    std::atomic_bool m_nonBlocking;
 };
 
 #endif /* _CONSOLE_IO_DEVICE_HPP */
\ No newline at end of file
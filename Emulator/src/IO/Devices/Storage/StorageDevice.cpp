@@ -19,6 +19,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <Emulator.hpp>
 
+#include <MMU/Epoch.hpp>
+
 #include "PhysicalRegionListBuffer.hpp"
 
 StorageDevice::StorageDevice(MMU* PhysicalMMU, const char* path)
@@ -94,17 +96,21 @@ void StorageDevice::WriteQWord(uint64_t address, uint64_t data) {
 }
 
 void StorageDevice::StartTransfer() {
-    if (!m_buffer->ParseList()) {
-        m_status.ERR = 1;
-        m_status.TRN = 0;
-        m_status.RDY = 1;
-        return;
-    }
+    {
+        // runs on the emulator thread, so the memory map can change under it
+        Epoch::ReadGuard guard;
+        if (!m_buffer->ParseList()) {
+            m_status.ERR = 1;
+            m_status.TRN = 0;
+            m_status.RDY = 1;
+            return;
+        }
 
-    if (m_transferCommandStatus.write)
-        m_buffer->Read(0, reinterpret_cast<uint8_t*>(reinterpret_cast<uint64_t>(m_file.GetData()) + (m_transferCommandStatus.LBA << 9)), m_transferCommandStatus.Count << 9);
-    else
-        m_buffer->Write(0, reinterpret_cast<const uint8_t*>(reinterpret_cast<uint64_t>(m_file.GetData()) + (m_transferCommandStatus.LBA << 9)), m_transferCommandStatus.Count << 9);
+        if (m_transferCommandStatus.write)
+            m_buffer->Read(0, reinterpret_cast<uint8_t*>(reinterpret_cast<uint64_t>(m_file.GetData()) + (m_transferCommandStatus.LBA << 9)), m_transferCommandStatus.Count << 9);
+        else
+            m_buffer->Write(0, reinterpret_cast<const uint8_t*>(reinterpret_cast<uint64_t>(m_file.GetData()) + (m_transferCommandStatus.LBA << 9)), m_transferCommandStatus.Count << 9);
+    }
 
     m_status.TRN = 0;
     m_status.ERR = 0;
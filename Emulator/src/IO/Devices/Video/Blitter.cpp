@@ -0,0 +1,97 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Blitter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // 4 pixels at a time. The compiler maps this onto the target's SIMD registers (SSE2 or NEON on the baseline targets) even at
+    // -O1, which the auto-vectoriser doesn't run at, and without per-ISA code.
+    typedef uint32_t Pixels4 __attribute__((vector_size(16)));
+
+    // the bit of each pixel in the high and low halves of a glyph bitmap byte, most significant first
+    constexpr Pixels4 GLYPH_BITS_HIGH = {0x80, 0x40, 0x20, 0x10};
+    constexpr Pixels4 GLYPH_BITS_LOW = {0x08, 0x04, 0x02, 0x01};
+
+    // rows are only 4-byte aligned
+    inline Pixels4 LoadPixels(const uint32_t* pixels) {
+        Pixels4 value;
+        memcpy(&value, pixels, sizeof(value));
+        return value;
+    }
+
+    inline void StorePixels(uint32_t* pixels, Pixels4 value) {
+        memcpy(pixels, &value, sizeof(value));
+    }
+}
+
+namespace Blitter {
+
+    void Fill(uint8_t* framebuffer, uint64_t pitch, const DamageRect& rect, uint32_t colour) {
+        Pixels4 colours = Pixels4{} + colour;
+        for (uint64_t y = rect.y; y < rect.y + rect.height; y++) {
+            uint32_t* row = reinterpret_cast<uint32_t*>(framebuffer + y * pitch) + rect.x;
+            uint64_t x = 0;
+            for (; x + 4 <= rect.width; x += 4)
+                StorePixels(row + x, colours);
+            std::fill_n(row + x, rect.width - x, colour);
+        }
+    }
+
+    void Copy(uint8_t* framebuffer, uint64_t pitch, uint32_t srcX, uint32_t srcY, const DamageRect& rect) {
+        uint64_t rowSize = static_cast<uint64_t>(rect.width) * 4;
+
+        // go against the direction of the move so rows aren't overwritten before they're copied, memmove handles overlap within a row
+        if (rect.y > srcY) {
+            for (uint64_t i = rect.height; i > 0; i--)
+                memmove(framebuffer + (rect.y + i - 1) * pitch + rect.x * 4, framebuffer + (srcY + i - 1) * pitch + srcX * 4, rowSize);
+        } else {
+            for (uint64_t i = 0; i < rect.height; i++)
+                memmove(framebuffer + (rect.y + i) * pitch + rect.x * 4, framebuffer + (srcY + i) * pitch + srcX * 4, rowSize);
+        }
+    }
+
+    void ExpandGlyph(uint8_t* framebuffer, uint64_t pitch, const DamageRect& rect, const uint8_t* bitmap, uint64_t stride, uint32_t foreground, uint32_t background, bool transparent) {
+        Pixels4 foregrounds = Pixels4{} + foreground;
+        Pixels4 backgrounds = Pixels4{} + background;
+        for (uint64_t y = 0; y < rect.height; y++) {
+            const uint8_t* bits = bitmap + y * stride;
+            uint32_t* row = reinterpret_cast<uint32_t*>(framebuffer + (rect.y + y) * pitch) + rect.x;
+
+            // a whole bitmap byte at a time, each pixel's mask is all ones where its bit is set
+            uint64_t x = 0;
+            for (; x + 8 <= rect.width; x += 8) {
+                uint32_t byte = bits[x / 8];
+                Pixels4 high = reinterpret_cast<Pixels4>((byte & GLYPH_BITS_HIGH) != 0);
+                Pixels4 low = reinterpret_cast<Pixels4>((byte & GLYPH_BITS_LOW) != 0);
+                Pixels4 unsetHigh = transparent ? LoadPixels(row + x) : backgrounds;
+                Pixels4 unsetLow = transparent ? LoadPixels(row + x + 4) : backgrounds;
+                StorePixels(row + x, (foregrounds & high) | (unsetHigh & ~high));
+                StorePixels(row + x + 4, (foregrounds & low) | (unsetLow & ~low));
+            }
+            for (; x < rect.width; x++) {
+                if (bits[x / 8] & (0x80 >> (x % 8)))
+                    row[x] = foreground;
+                else if (!transparent)
+                    row[x] = background;
+            }
+        }
+    }
+
+} // namespace Blitter
@@ -0,0 +1,36 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _VIDEO_BLITTER_HPP
+#define _VIDEO_BLITTER_HPP
+
+#include <cstdint>
+
+#include "DamageTracker.hpp"
+
+// 2D operations on a 32bpp framebuffer. Rectangles must already be clipped to it.
+namespace Blitter {
+    void Fill(uint8_t* framebuffer, uint64_t pitch, const DamageRect& rect, uint32_t colour);
+
+    // Copy the rectangle at (srcX, srcY) to rect, which may overlap it
+    void Copy(uint8_t* framebuffer, uint64_t pitch, uint32_t srcX, uint32_t srcY, const DamageRect& rect);
+
+    // Expand a 1bpp bitmap, most significant bit leftmost, with stride bytes per row. Clear bits are left alone if transparent is set.
+    void ExpandGlyph(uint8_t* framebuffer, uint64_t pitch, const DamageRect& rect, const uint8_t* bitmap, uint64_t stride, uint32_t foreground, uint32_t background, bool transparent);
+}
+
+#endif /* _VIDEO_BLITTER_HPP */
@@ -0,0 +1,157 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "DamageTracker.hpp"
+
+#include <cstring>
+
+#include <Common/Util.hpp>
+
+#include "VideoDevice.hpp"
+
+DamageTracker::DamageTracker()
+    : m_width(0), m_height(0), m_pitch(0), m_bytesPerPixel(1), m_rowStart(nullptr), m_rowEnd(nullptr), m_shadow(nullptr), m_damaged(false) {
+}
+
+DamageTracker::~DamageTracker() {
+}
+
+void DamageTracker::Reset(const VideoMode& mode) {
+    m_width = mode.width;
+    m_height = mode.height;
+    m_pitch = mode.pitch;
+    m_bytesPerPixel = MAX(mode.bpp / 8, 1);
+    m_rowStart = std::make_unique<std::atomic_uint32_t[]>(m_height);
+    m_rowEnd = std::make_unique<std::atomic_uint32_t[]>(m_height);
+    for (uint64_t i = 0; i < m_height; i++) {
+        m_rowStart[i].store(UINT32_MAX);
+        m_rowEnd[i].store(0);
+    }
+    m_shadow = std::make_unique<uint8_t[]>(m_pitch * m_height); // zeroed, like a new framebuffer
+    m_damaged.store(false);
+}
+
+void DamageTracker::AddRowDamage(uint64_t row, uint32_t start, uint32_t end) {
+    // only ever widen the span, and don't touch the cache line at all if it already covers the write
+    uint32_t current = m_rowStart[row].load(std::memory_order_relaxed);
+    while (start < current && !m_rowStart[row].compare_exchange_weak(current, start)) {
+    }
+    current = m_rowEnd[row].load(std::memory_order_relaxed);
+    while (end > current && !m_rowEnd[row].compare_exchange_weak(current, end)) {
+    }
+}
+
+void DamageTracker::AddDamage(const DamageRect& rect) {
+    if (rect.x >= m_width || rect.y >= m_height)
+        return;
+    uint32_t end = MIN(rect.x + rect.width, m_width);
+    uint64_t lastRow = MIN(static_cast<uint64_t>(rect.y) + rect.height, m_height);
+    for (uint64_t row = rect.y; row < lastRow; row++)
+        AddRowDamage(row, rect.x, end);
+    m_damaged.store(true);
+}
+
+void DamageTracker::AddFullDamage() {
+    AddDamage(DamageRect{0, 0, static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height)});
+}
+
+void DamageTracker::Scan(const uint8_t* framebuffer) {
+    if (framebuffer == nullptr || m_shadow == nullptr)
+        return;
+
+    uint64_t rowSize = m_width * m_bytesPerPixel;
+    bool damaged = false;
+    for (uint64_t row = 0; row < m_height; row++) {
+        const uint8_t* current = framebuffer + row * m_pitch;
+        uint8_t* shadow = m_shadow.get() + row * m_pitch;
+        if (memcmp(current, shadow, rowSize) == 0)
+            continue;
+
+        // narrow it down to the changed span. The guest can still be writing, so the row may match again by now.
+        uint64_t first = 0;
+        while (first < rowSize && current[first] == shadow[first])
+            first++;
+        uint64_t last = rowSize;
+        while (last > first && current[last - 1] == shadow[last - 1])
+            last--;
+        if (first == last)
+            continue;
+
+        // copied before the backend reads the framebuffer, so anything written after this shows up in the next scan
+        memcpy(shadow + first, current + first, last - first);
+        AddRowDamage(row, first / m_bytesPerPixel, (last - 1) / m_bytesPerPixel + 1);
+        damaged = true;
+    }
+    if (damaged)
+        m_damaged.store(true);
+}
+
+bool DamageTracker::Collect(std::vector<DamageRect>& rects, uint64_t maxRects) {
+    rects.clear();
+    if (!m_damaged.exchange(false))
+        return false;
+
+    // consecutive damaged rows become one rectangle spanning all of their spans
+    bool open = false;
+    DamageRect current = {};
+    for (uint64_t row = 0; row < m_height; row++) {
+        uint32_t start = m_rowStart[row].exchange(UINT32_MAX);
+        uint32_t end = m_rowEnd[row].exchange(0);
+        if (start >= end) {
+            if (open) {
+                rects.push_back(current);
+                open = false;
+            }
+            continue;
+        }
+
+        if (!open) {
+            current = {start, static_cast<uint32_t>(row), end - start, 1};
+            open = true;
+            continue;
+        }
+
+        uint32_t x = MIN(current.x, start);
+        current.width = MAX(current.x + current.width, end) - x;
+        current.x = x;
+        current.height++;
+    }
+    if (open)
+        rects.push_back(current);
+
+    // too many, fold the closest neighbours together until it fits
+    while (rects.size() > MAX(maxRects, 1)) {
+        uint64_t best = 0;
+        uint64_t bestGap = UINT64_MAX;
+        for (uint64_t i = 0; i + 1 < rects.size(); i++) {
+            uint64_t gap = rects[i + 1].y - (rects[i].y + rects[i].height);
+            if (gap < bestGap) {
+                bestGap = gap;
+                best = i;
+            }
+        }
+        DamageRect& a = rects[best];
+        const DamageRect& b = rects[best + 1];
+        uint32_t x = MIN(a.x, b.x);
+        a.width = MAX(a.x + a.width, b.x + b.width) - x;
+        a.x = x;
+        a.height = b.y + b.height - a.y;
+        rects.erase(rects.begin() + best + 1);
+    }
+
+    return !rects.empty();
+}
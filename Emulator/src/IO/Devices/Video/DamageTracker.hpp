@@ -0,0 +1,70 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _VIDEO_DAMAGE_TRACKER_HPP
+#define _VIDEO_DAMAGE_TRACKER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct VideoMode;
+
+struct DamageRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Records which parts of a framebuffer changed as a horizontal span per row. The guest's own stores go straight to the framebuffer, so
+// they are found by scanning it once per frame, anything else marks its damage directly. Collecting it merges the rows into a few
+// rectangles for the backend to present.
+class DamageTracker {
+   public:
+    DamageTracker();
+    ~DamageTracker();
+
+    void Reset(const VideoMode& mode);
+
+    void AddDamage(const DamageRect& rect);
+    void AddFullDamage();
+
+    // Mark whatever changed in framebuffer since the last scan. Only called on the render thread.
+    void Scan(const uint8_t* framebuffer);
+
+    // Clear the damage, storing at most maxRects rectangles covering it into rects. Returns false if there was no damage.
+    bool Collect(std::vector<DamageRect>& rects, uint64_t maxRects);
+
+   private:
+    void AddRowDamage(uint64_t row, uint32_t start, uint32_t end);
+
+   private:
+    uint64_t m_width;
+    uint64_t m_height;
+    uint64_t m_pitch;
+    uint64_t m_bytesPerPixel;
+
+    // damaged pixels of each row are [m_rowStart, m_rowEnd). No damage is m_rowStart > m_rowEnd.
+    std::unique_ptr<std::atomic_uint32_t[]> m_rowStart;
+    std::unique_ptr<std::atomic_uint32_t[]> m_rowEnd;
+    std::unique_ptr<uint8_t[]> m_shadow; // the framebuffer as of the last scan
+    std::atomic_bool m_damaged;
+};
+
+#endif /* _VIDEO_DAMAGE_TRACKER_HPP */
@@ -18,7 +18,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "VideoBackend.hpp"
 
 VideoBackend::VideoBackend(const VideoMode& mode)
-    : m_mode(mode) {
+    : m_mode({0, 0, 0, 0, 0}), m_outputMode({0, 0, 0, 0, 0}), m_vsyncCallback(nullptr), m_vsyncData(nullptr) {
+    SetRawMode(mode);
 }
 
 VideoBackend::~VideoBackend() {
@@ -28,6 +29,58 @@ VideoMode VideoBackend::GetRawMode() {
     return m_mode;
 }
 
-void VideoBackend::SetRawMode(const VideoMode& mode) {
+void VideoBackend::SetRawMode(const VideoMode& mode, const VideoScaling& scaling) {
     m_mode = mode;
+    m_outputMode = m_converter.Configure(mode, scaling);
+    if (m_converter.IsActive())
+        m_sourceBuffer = std::make_unique<uint8_t[]>(mode.pitch * mode.height);
+    else
+        m_sourceBuffer.reset();
+    m_damage.Reset(mode);
+}
+
+VideoMode VideoBackend::GetOutputMode() {
+    return m_outputMode;
+}
+
+uint8_t* VideoBackend::GetFramebuffer() {
+    return m_converter.IsActive() ? m_sourceBuffer.get() : GetOutputBuffer();
+}
+
+void VideoBackend::SetPalette(const uint32_t* entries) {
+    m_converter.SetPalette(entries);
+    if (m_mode.bpp == 8)
+        m_damage.AddFullDamage();
+}
+
+bool VideoBackend::CollectOutputDamage(std::vector<DamageRect>& rects, uint64_t maxRects) {
+    m_damage.Scan(GetFramebuffer());
+    if (!m_damage.Collect(rects, maxRects))
+        return false;
+
+    if (m_converter.IsActive()) {
+        uint8_t* output = GetOutputBuffer();
+        for (DamageRect& rect : rects)
+            m_converter.Convert(m_sourceBuffer.get(), output, rect);
+    }
+    return true;
+}
+
+DamageTracker& VideoBackend::GetDamageTracker() {
+    return m_damage;
+}
+
+void VideoBackend::SetVSyncCallback(VideoVSyncCallback callback, void* data) {
+    m_vsyncCallback = callback;
+    m_vsyncData = data;
+}
+
+void VideoBackend::VSync() {
+    if (m_vsyncCallback != nullptr)
+        m_vsyncCallback(m_vsyncData);
+}
+
+void VideoBackend::PrintStatistics(void (*write)(void* data, const char* format, ...), void* data) {
+    write(data, "Mode: %lux%lu @ %luHz\n", m_mode.width, m_mode.height, m_mode.refreshRate);
+    write(data, "No frame statistics are kept by this backend\n");
 }
\ No newline at end of file
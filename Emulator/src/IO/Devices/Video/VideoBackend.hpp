@@ -18,14 +18,24 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef _VIDEO_DEVICE_BACKEND_HPP
 #define _VIDEO_DEVICE_BACKEND_HPP
 
+#include <memory>
 #include <stdint.h>
+#include <vector>
 
+#include "DamageTracker.hpp"
+#include "VideoConverter.hpp"
 #include "VideoDevice.hpp"
 
+// Most rectangles a backend presents per frame, beyond this the damage is merged
+#define VIDEO_MAX_DAMAGE_RECTS 16
+
+typedef void (*VideoVSyncCallback)(void* data);
+
 enum class VideoBackendType {
     NONE,
     SDL,
-    XCB
+    XCB,
+    HEADLESS
 };
 
 class VideoBackend {
@@ -35,18 +45,49 @@ class VideoBackend {
     virtual ~VideoBackend();
 
     virtual void Init() = 0;
-    virtual void SetMode(VideoMode mode) = 0;
+    virtual void SetMode(VideoMode mode, VideoScaling scaling) = 0;
     virtual VideoMode GetMode() = 0;
 
-    virtual void Write(uint64_t offset, uint8_t* data, uint64_t size) = 0;
-    virtual void Read(uint64_t offset, uint8_t* data, uint64_t size) = 0;
+    // The pixel buffer for the current mode, which the guest writes to directly. Only valid until the next SetMode.
+    uint8_t* GetFramebuffer();
+
+    // Used for 8bpp modes, takes VIDEO_PALETTE_SIZE 0x00RRGGBB entries
+    void SetPalette(const uint32_t* entries);
+
+    // Damage marked here is presented on the next frame
+    DamageTracker& GetDamageTracker();
+
+    // Write the next frame out, if the backend has somewhere to write it. Returns false if it doesn't.
+    virtual bool RequestFrameDump() { return false; }
+    virtual void PrintStatistics(void (*write)(void* data, const char* format, ...), void* data);
+
+    // Called on the render thread at the start of every frame, before the damage is collected
+    void SetVSyncCallback(VideoVSyncCallback callback, void* data);
 
    protected:
     VideoMode GetRawMode();
-    void SetRawMode(const VideoMode& mode);
+    // Also resets the damage tracking for the new mode
+    void SetRawMode(const VideoMode& mode, const VideoScaling& scaling = NO_VIDEO_SCALING);
+
+    // What the backend actually presents, which is always 32bpp. The same as the raw mode unless it is scaled or in another format.
+    VideoMode GetOutputMode();
+    // The backend's pixel buffer, in the output mode
+    virtual uint8_t* GetOutputBuffer() = 0;
+
+    // Scan for what the guest drew, collect the damage and bring the output buffer up to date with it. The rectangles are in output
+    // coordinates. Has to be called every frame, since nothing else notices the guest's stores to the framebuffer.
+    bool CollectOutputDamage(std::vector<DamageRect>& rects, uint64_t maxRects);
+
+    void VSync();
 
    private:
     VideoMode m_mode;
+    VideoMode m_outputMode;
+    DamageTracker m_damage;
+    VideoConverter m_converter;
+    std::unique_ptr<uint8_t[]> m_sourceBuffer; // what the guest draws into when the output needs converting
+    VideoVSyncCallback m_vsyncCallback;
+    void* m_vsyncData;
 };
 
 #endif /* _VIDEO_DEVICE_BACKEND_HPP */
\ No newline at end of file
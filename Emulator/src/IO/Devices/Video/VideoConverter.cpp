@@ -0,0 +1,158 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "VideoConverter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // 4 pixels at a time, which the compiler maps onto SSE2 or NEON registers. The project builds at -O1, where the auto-vectoriser
+    // doesn't run, so loops that should use SIMD have to say so. The palette lookup is a gather and the bilinear filter works on
+    // clamped, per-pixel sample positions, so those stay scalar.
+    typedef uint32_t Pixels4 __attribute__((vector_size(16)));
+    typedef uint16_t Pixels4x16 __attribute__((vector_size(8)));
+
+    // w is out of 256, two channels at a time
+    inline uint32_t Lerp(uint32_t a, uint32_t b, uint32_t w) {
+        uint32_t rb = ((((a & 0x00FF'00FF) * (256 - w) + (b & 0x00FF'00FF) * w) >> 8) & 0x00FF'00FF);
+        uint32_t ag = ((((a >> 8) & 0x00FF'00FF) * (256 - w) + ((b >> 8) & 0x00FF'00FF) * w) & 0xFF00'FF00);
+        return rb | ag;
+    }
+
+    // Sample position of an output pixel in source pixels, out of 256. Pixel centres line up, so this can be negative at the edges.
+    inline int64_t SamplePosition(uint64_t output, uint64_t scale) {
+        return static_cast<int64_t>((2 * output + 1) * 128 / scale) - 128;
+    }
+}
+
+VideoConverter::VideoConverter()
+    : m_source({0, 0, 0, 0, 0}), m_output({0, 0, 0, 0, 0}), m_scaling(NO_VIDEO_SCALING), m_active(false) {
+    // default to 3-3-2 RGB, so 8bpp is usable without setting a palette
+    for (uint32_t i = 0; i < VIDEO_PALETTE_SIZE; i++) {
+        uint32_t r = ((i >> 5) & 7) * 255 / 7;
+        uint32_t g = ((i >> 2) & 7) * 255 / 7;
+        uint32_t b = (i & 3) * 255 / 3;
+        m_palette[i].store(r << 16 | g << 8 | b, std::memory_order_relaxed);
+    }
+}
+
+VideoConverter::~VideoConverter() {
+}
+
+VideoMode VideoConverter::Configure(const VideoMode& source, const VideoScaling& scaling) {
+    m_source = source;
+    m_scaling = scaling;
+    m_active = source.bpp != 32 || scaling.scale != 1;
+    m_output = {source.width * scaling.scale, source.height * scaling.scale, source.refreshRate, 32, source.width * scaling.scale * 4};
+    return m_active ? m_output : source;
+}
+
+void VideoConverter::SetPalette(const uint32_t* entries) {
+    for (uint32_t i = 0; i < VIDEO_PALETTE_SIZE; i++)
+        m_palette[i].store(entries[i] & 0x00FF'FFFF, std::memory_order_relaxed);
+}
+
+void VideoConverter::ConvertRow(const uint8_t* source, uint32_t* output, uint64_t count) const {
+    switch (m_source.bpp) {
+    case 8:
+        for (uint64_t i = 0; i < count; i++)
+            output[i] = m_palette[source[i]].load(std::memory_order_relaxed);
+        break;
+    case 16: {
+        uint64_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            Pixels4x16 packed;
+            memcpy(&packed, source + i * 2, sizeof(packed));
+            Pixels4 pixels = __builtin_convertvector(packed, Pixels4);
+            Pixels4 r = (pixels >> 11) & 0x1F;
+            Pixels4 g = (pixels >> 5) & 0x3F;
+            Pixels4 b = pixels & 0x1F;
+            Pixels4 result = (r << 3 | r >> 2) << 16 | (g << 2 | g >> 4) << 8 | (b << 3 | b >> 2);
+            memcpy(output + i, &result, sizeof(result));
+        }
+        const uint16_t* pixels = reinterpret_cast<const uint16_t*>(source);
+        for (; i < count; i++) {
+            uint32_t r = (pixels[i] >> 11) & 0x1F;
+            uint32_t g = (pixels[i] >> 5) & 0x3F;
+            uint32_t b = pixels[i] & 0x1F;
+            output[i] = (r << 3 | r >> 2) << 16 | (g << 2 | g >> 4) << 8 | (b << 3 | b >> 2);
+        }
+        break;
+    }
+    default:
+        std::copy_n(reinterpret_cast<const uint32_t*>(source), count, output);
+        break;
+    }
+}
+
+void VideoConverter::Convert(const uint8_t* source, uint8_t* output, DamageRect& rect) {
+    uint64_t scale = m_scaling.scale;
+    bool bilinear = m_scaling.filter == VideoFilter::BILINEAR && scale > 1;
+
+    // output pixels next to the damage blend with it when filtering, and they in turn need their other neighbour
+    uint64_t margin = bilinear ? 1 : 0;
+    uint64_t outX = (rect.x > margin ? rect.x - margin : 0) * scale;
+    uint64_t outY = (rect.y > margin ? rect.y - margin : 0) * scale;
+    uint64_t outEndX = std::min<uint64_t>(rect.x + rect.width + margin, m_source.width) * scale;
+    uint64_t outEndY = std::min<uint64_t>(rect.y + rect.height + margin, m_source.height) * scale;
+
+    uint64_t srcX = rect.x > 2 * margin ? rect.x - 2 * margin : 0;
+    uint64_t srcY = rect.y > 2 * margin ? rect.y - 2 * margin : 0;
+    uint64_t srcWidth = std::min<uint64_t>(rect.x + rect.width + 2 * margin, m_source.width) - srcX;
+    uint64_t srcHeight = std::min<uint64_t>(rect.y + rect.height + 2 * margin, m_source.height) - srcY;
+
+    m_buffer.resize(srcWidth * srcHeight);
+    uint64_t bytesPerPixel = m_source.bpp / 8;
+    for (uint64_t y = 0; y < srcHeight; y++)
+        ConvertRow(source + (srcY + y) * m_source.pitch + srcX * bytesPerPixel, m_buffer.data() + y * srcWidth, srcWidth);
+
+    if (!bilinear) {
+        // without a margin the output is whole blocks of scale x scale, so widen each source row once and copy it down the block
+        uint64_t rowSize = (outEndX - outX) * 4;
+        for (uint64_t y = 0; y < srcHeight; y++) {
+            const uint32_t* in = m_buffer.data() + y * srcWidth;
+            uint8_t* firstRow = output + (srcY + y) * scale * m_output.pitch + outX * 4;
+            uint32_t* out = reinterpret_cast<uint32_t*>(firstRow);
+            for (uint64_t x = 0; x < srcWidth; x++)
+                std::fill_n(out + x * scale, scale, in[x]);
+            for (uint64_t i = 1; i < scale; i++)
+                memcpy(firstRow + i * m_output.pitch, firstRow, rowSize);
+        }
+    } else {
+        int64_t maxX = static_cast<int64_t>(srcWidth) - 1;
+        int64_t maxY = static_cast<int64_t>(srcHeight) - 1;
+        for (uint64_t y = outY; y < outEndY; y++) {
+            int64_t sy = SamplePosition(y, scale);
+            int64_t y0 = (sy >> 8) - static_cast<int64_t>(srcY);
+            uint32_t wy = sy & 0xFF;
+            const uint32_t* row0 = m_buffer.data() + std::clamp<int64_t>(y0, 0, maxY) * srcWidth;
+            const uint32_t* row1 = m_buffer.data() + std::clamp<int64_t>(y0 + 1, 0, maxY) * srcWidth;
+            uint32_t* out = reinterpret_cast<uint32_t*>(output + y * m_output.pitch);
+            for (uint64_t x = outX; x < outEndX; x++) {
+                int64_t sx = SamplePosition(x, scale);
+                int64_t x0 = (sx >> 8) - static_cast<int64_t>(srcX);
+                uint32_t wx = sx & 0xFF;
+                int64_t left = std::clamp<int64_t>(x0, 0, maxX);
+                int64_t right = std::clamp<int64_t>(x0 + 1, 0, maxX);
+                out[x] = Lerp(Lerp(row0[left], row0[right], wx), Lerp(row1[left], row1[right], wx), wy);
+            }
+        }
+    }
+
+    rect = {static_cast<uint32_t>(outX), static_cast<uint32_t>(outY), static_cast<uint32_t>(outEndX - outX), static_cast<uint32_t>(outEndY - outY)};
+}
@@ -0,0 +1,76 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _VIDEO_CONVERTER_HPP
+#define _VIDEO_CONVERTER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "DamageTracker.hpp"
+#include "VideoDevice.hpp"
+
+#define VIDEO_MAX_SCALE 8
+#define VIDEO_PALETTE_SIZE 256
+
+enum class VideoFilter : uint8_t {
+    NEAREST = 0,
+    BILINEAR = 1
+};
+
+struct VideoScaling {
+    uint8_t scale;
+    VideoFilter filter;
+};
+
+#define NO_VIDEO_SCALING {1, VideoFilter::NEAREST}
+
+// Turns a framebuffer in the guest's format (8bpp palettised, 16bpp RGB565 or 32bpp) into the 32bpp image the backend presents,
+// scaled up by an integer factor. Only needed when the two differ, otherwise the backend presents the guest's framebuffer as it is.
+class VideoConverter {
+   public:
+    VideoConverter();
+    ~VideoConverter();
+
+    // Returns the mode of the output, which is always 32bpp
+    VideoMode Configure(const VideoMode& source, const VideoScaling& scaling);
+
+    bool IsActive() const { return m_active; }
+
+    // Takes VIDEO_PALETTE_SIZE 0x00RRGGBB entries
+    void SetPalette(const uint32_t* entries);
+
+    // Update the output for a damaged rectangle of the source, which is then changed to the rectangle of the output that changed
+    void Convert(const uint8_t* source, uint8_t* output, DamageRect& rect);
+
+   private:
+    void ConvertRow(const uint8_t* source, uint32_t* output, uint64_t count) const;
+
+   private:
+    VideoMode m_source;
+    VideoMode m_output;
+    VideoScaling m_scaling;
+    bool m_active;
+
+    std::atomic_uint32_t m_palette[VIDEO_PALETTE_SIZE];
+
+    // the damaged source pixels (and their neighbours for filtering) in 32bpp
+    std::vector<uint32_t> m_buffer;
+};
+
+#endif /* _VIDEO_CONVERTER_HPP */
@@ -19,8 +19,17 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <cstdint>
 
+#include <Emulator.hpp>
+
+#include <MMU/Epoch.hpp>
+
+#include <Common/Util.hpp>
+
+#include "Blitter.hpp"
 #include "VideoBackend.hpp"
 
+#include "backends/Headless/HeadlessVideoBackend.hpp"
+
 #ifdef ENABLE_SDL
 #include "backends/SDL/SDLVideoBackend.hpp"
 #endif
@@ -29,13 +38,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "backends/XCB/XCBVideoBackend.hpp"
 #endif
 
-void HandleVideoMemoryOperation(bool write, uint64_t address, uint8_t* buffer, size_t size, void* data) {
-    VideoDevice* device = static_cast<VideoDevice*>(data);
-    device->HandleMemoryOperation(write, address, buffer, size);
-}
-
 VideoDevice::VideoDevice(VideoBackendType backendType, MMU& mmu)
-    : IODevice(IODeviceID::VIDEO, 3), m_memoryRegion(nullptr), m_backendType(backendType), m_backend(nullptr), m_mmu(mmu), m_command(0), m_data(0), m_status(0), m_initialised(false), m_currentMode({0, 0, 0, 0, 0}), m_currentModeIndex(0), m_modes({}), m_MemoryOverrideData(nullptr) {
+    : IODevice(IODeviceID::VIDEO, 3, 2), m_memoryRegion(nullptr), m_backendType(backendType), m_backend(nullptr), m_mmu(mmu), m_command(0), m_data(0), m_status(0), m_initialised(false), m_currentMode({0, 0, 0, 0, 0}), m_currentModeIndex(0), m_modes({}), m_MemoryOverrideData(nullptr), m_flipLock(0), m_flipPending(false), m_flipAddress(0), m_flipSize(0), m_flipInterrupt(false), m_flipDropped(false) {
 }
 
 VideoDevice::~VideoDevice() {
@@ -48,7 +52,7 @@ uint8_t VideoDevice::ReadByte(uint64_t address) {
     if (address == static_cast<uint64_t>(VideoDevicePorts::DATA))
         return m_data & 0xFF;
     if (address == static_cast<uint64_t>(VideoDevicePorts::STATUS))
-        return m_status & 0xFF;
+        return GetStatus() & 0xFF;
     return 0;
 }
 
@@ -56,7 +60,7 @@ uint16_t VideoDevice::ReadWord(uint64_t address) {
     if (address == static_cast<uint64_t>(VideoDevicePorts::DATA))
         return m_data & 0xFFFF;
     if (address == static_cast<uint64_t>(VideoDevicePorts::STATUS))
-        return m_status & 0xFFFF;
+        return GetStatus() & 0xFFFF;
     return 0;
 }
 
@@ -64,7 +68,7 @@ uint32_t VideoDevice::ReadDWord(uint64_t address) {
     if (address == static_cast<uint64_t>(VideoDevicePorts::DATA))
         return m_data & 0xFFFF'FFFF;
     else if (address == static_cast<uint64_t>(VideoDevicePorts::STATUS))
-        return m_status & 0xFFFF'FFFF;
+        return GetStatus() & 0xFFFF'FFFF;
     else
         return 0;
 }
@@ -73,7 +77,7 @@ uint64_t VideoDevice::ReadQWord(uint64_t address) {
     if (address == static_cast<uint64_t>(VideoDevicePorts::DATA))
         return m_data;
     else if (address == static_cast<uint64_t>(VideoDevicePorts::STATUS))
-        return m_status;
+        return GetStatus();
     else
         return 0;
 }
@@ -110,24 +114,11 @@ void VideoDevice::WriteQWord(uint64_t address, uint64_t data) {
         m_data = data;
 }
 
-void VideoDevice::HandleMemoryOperation(bool write, uint64_t address, uint8_t* buffer, uint64_t size) {
-    if (!m_initialised)
-        return;
-#if defined(ENABLE_SDL) || defined(ENABLE_XCB)
-    if (write)
-        m_backend->Write(address, buffer, size);
-    else
-        m_backend->Read(address, buffer, size);
-#else
-    (void)write;
-    (void)address;
-    (void)buffer;
-    (void)size;
-#endif
+VideoBackend* VideoDevice::GetBackend() const {
+    return m_backend;
 }
 
 void VideoDevice::HandleCommand() {
-#if defined(ENABLE_SDL) || defined(ENABLE_XCB)
     switch (static_cast<VideoDeviceCommands>(m_command)) {
     case VideoDeviceCommands::INITIALISE: {
         if (m_initialised)
@@ -137,9 +128,12 @@ void VideoDevice::HandleCommand() {
 #ifdef ENABLE_SDL
             // bring the backend online
             SDLVideoBackend* backend = new SDLVideoBackend(NATIVE_VIDEO_MODE);
+            backend->SetVSyncCallback(VSyncCallback, this);
             backend->Init();
             m_backend = backend;
             m_status = 0;
+#else
+            m_status = 1;
 #endif
             break;
         }
@@ -147,12 +141,24 @@ void VideoDevice::HandleCommand() {
 #ifdef ENABLE_XCB
             // bring the backend online
             XCBVideoBackend* backend = new XCBVideoBackend(NATIVE_VIDEO_MODE);
+            backend->SetVSyncCallback(VSyncCallback, this);
             backend->Init();
             m_backend = backend;
             m_status = 0;
+#else
+            m_status = 1;
 #endif
             break;
         }
+        case VideoBackendType::HEADLESS: {
+            // bring the backend online
+            HeadlessVideoBackend* backend = new HeadlessVideoBackend(NATIVE_VIDEO_MODE);
+            backend->SetVSyncCallback(VSyncCallback, this);
+            backend->Init();
+            m_backend = backend;
+            m_status = 0;
+            break;
+        }
         default:
             m_status = 1;
             break;
@@ -166,6 +172,12 @@ void VideoDevice::HandleCommand() {
         m_modes.push_back({800, 600, 60, 32, 800 * 4});
         m_modes.push_back({1'280, 720, 60, 32, 1'280 * 4});
         m_modes.push_back({1'920, 1'080, 60, 32, 1'920 * 4});
+        // low resolution and smaller pixel formats, meant to be scaled up
+        m_modes.push_back({320, 240, 60, 32, 320 * 4});
+        m_modes.push_back({320, 240, 60, 16, 320 * 2});
+        m_modes.push_back({320, 240, 60, 8, 320});
+        m_modes.push_back({640, 480, 60, 16, 640 * 2});
+        m_modes.push_back({640, 480, 60, 8, 640});
 
         // set the current mode. no need to set the backend mode as it's already set
         m_currentMode = NATIVE_VIDEO_MODE;
@@ -237,10 +249,20 @@ void VideoDevice::HandleCommand() {
             return;
         }
 
+        // a scale of 0 is the same as 1, so older guests leaving it clear get an unscaled mode
+        VideoScaling scaling = {static_cast<uint8_t>(MAX(request.scale, 1)), static_cast<VideoFilter>(request.filter)};
+        if (scaling.scale > VIDEO_MAX_SCALE || request.filter > static_cast<uint8_t>(VideoFilter::BILINEAR) || m_modes[request.mode].width * scaling.scale > VIDEO_MAX_OUTPUT_SIZE || m_modes[request.mode].height * scaling.scale > VIDEO_MAX_OUTPUT_SIZE) {
+            m_status = 1;
+            return;
+        }
+
+        // the back buffer was laid out for the old mode
+        CancelFlip();
+
         if (m_memoryRegion != nullptr) {
             // remove the old region
             m_mmu.RemoveMemoryRegion(m_memoryRegion);
-            delete m_memoryRegion;
+            Epoch::Retire(m_memoryRegion);
             m_mmu.ReaddRegionSegment(m_MemoryOverrideData);
         }
 
@@ -253,10 +275,11 @@ void VideoDevice::HandleCommand() {
             return;
         }
 
-        m_memoryRegion = new VideoMemoryRegion(request.address, request.address + size, HandleVideoMemoryOperation, this);
-        m_mmu.AddMemoryRegion(m_memoryRegion);
+        // the backend reallocates its pixel buffer, so it has to be switched first
+        m_backend->SetMode(mode, scaling);
 
-        m_backend->SetMode(mode);
+        m_memoryRegion = new VideoMemoryRegion(request.address, request.address + size, m_backend->GetFramebuffer());
+        m_mmu.AddMemoryRegion(m_memoryRegion);
 
         m_currentMode = mode;
         m_currentModeIndex = request.mode;
@@ -265,8 +288,204 @@ void VideoDevice::HandleCommand() {
 
         break;
     }
+    case VideoDeviceCommands::FLIP: {
+        if (!m_initialised || m_flipPending.load()) {
+            m_status = 1;
+            return;
+        }
+
+        if (!m_mmu.ValidateRead(m_data, sizeof(VideoCommand::FlipRequest))) {
+            m_status = 1;
+            return;
+        }
+
+        VideoCommand::FlipRequest request;
+        m_mmu.ReadBuffer(m_data, reinterpret_cast<uint8_t*>(&request), sizeof(VideoCommand::FlipRequest));
+
+        // the back buffer has to be RAM the render thread can copy straight from, not a device or the framebuffer itself
+        uint64_t size = m_currentMode.pitch * m_currentMode.height;
+        if (request.address + size < request.address || !m_mmu.IsHostMemory(request.address, size)) {
+            m_status = 1;
+            return;
+        }
+        if (m_memoryRegion != nullptr && request.address < m_memoryRegion->getEnd() && request.address + size > m_memoryRegion->getStart()) {
+            m_status = 1;
+            return;
+        }
+
+        spinlock_acquire(&m_flipLock);
+        m_flipAddress = request.address;
+        m_flipSize = size;
+        m_flipInterrupt = request.interrupt != 0;
+        m_flipDropped.store(false);
+        m_flipPending.store(true);
+        spinlock_release(&m_flipLock);
+
+        m_status = 0;
+        break;
+    }
+    case VideoDeviceCommands::FILL:
+        m_status = HandleFill() ? 0 : 1;
+        break;
+    case VideoDeviceCommands::COPY:
+        m_status = HandleCopy() ? 0 : 1;
+        break;
+    case VideoDeviceCommands::BLIT:
+        m_status = HandleBlit() ? 0 : 1;
+        break;
+    case VideoDeviceCommands::GLYPH:
+        m_status = HandleGlyph() ? 0 : 1;
+        break;
+    case VideoDeviceCommands::SET_PALETTE: {
+        uint32_t palette[VIDEO_PALETTE_SIZE];
+        if (!ReadRequest(palette, sizeof(palette))) {
+            m_status = 1;
+            return;
+        }
+        m_backend->SetPalette(palette);
+        m_status = 0;
+        break;
+    }
     default:
         break;
     }
-#endif
+}
+
+uint64_t VideoDevice::GetStatus() const {
+    return m_status | (m_flipPending.load() ? VIDEO_STATUS_FLIP_PENDING : 0) | (m_flipDropped.load() ? VIDEO_STATUS_FLIP_DROPPED : 0);
+}
+
+void VideoDevice::HandleFlipEvent() {
+    RaiseInterrupt(static_cast<uint64_t>(VideoDeviceInterrupts::FLIP));
+}
+
+void VideoDevice::VSyncCallback(void* data) {
+    static_cast<VideoDevice*>(data)->HandleVSync();
+}
+
+void VideoDevice::HandleVSync() {
+    if (!m_flipPending.load())
+        return;
+
+    spinlock_acquire(&m_flipLock);
+    if (!m_flipPending.load()) {
+        spinlock_release(&m_flipLock);
+        return;
+    }
+
+    // present the whole back buffer in one go, so the guest never sees half a frame. It is checked again here since the guest can
+    // have removed the RAM since the flip, and this thread can't raise exceptions or go through devices.
+    bool presented;
+    {
+        Epoch::ReadGuard guard;
+        presented = m_mmu.ReadHostMemory(m_flipAddress, m_backend->GetFramebuffer(), m_flipSize);
+    }
+    if (presented)
+        m_backend->GetDamageTracker().AddFullDamage();
+    else
+        m_flipDropped.store(true);
+
+    bool interrupt = m_flipInterrupt;
+    m_flipPending.store(false);
+    spinlock_release(&m_flipLock);
+
+    // interrupts can't be raised from the render thread, so hand it to the emulator thread
+    if (interrupt)
+        Emulator::RaiseEvent({Emulator::EventType::VideoFlip, reinterpret_cast<uint64_t>(this)});
+}
+
+void VideoDevice::CancelFlip() {
+    spinlock_acquire(&m_flipLock);
+    m_flipPending.store(false);
+    spinlock_release(&m_flipLock);
+}
+
+void VideoDevice::HandleBlitEvent() {
+    RaiseInterrupt(static_cast<uint64_t>(VideoDeviceInterrupts::BLIT));
+}
+
+bool VideoDevice::ReadRequest(void* request, uint64_t size) {
+    if (!m_initialised || !m_mmu.ValidateRead(m_data, size))
+        return false;
+    m_mmu.ReadBuffer(m_data, static_cast<uint8_t*>(request), size);
+    return true;
+}
+
+bool VideoDevice::ValidateRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+    // done in 64-bit so it can't wrap
+    return m_currentMode.bpp == 32 && static_cast<uint64_t>(x) + width <= m_currentMode.width && static_cast<uint64_t>(y) + height <= m_currentMode.height;
+}
+
+void VideoDevice::CompleteBlit(uint32_t x, uint32_t y, uint32_t width, uint32_t height, bool interrupt) {
+    if (width > 0 && height > 0)
+        m_backend->GetDamageTracker().AddDamage(DamageRect{x, y, width, height});
+
+    // the operation itself is already done, but interrupts can't be raised from the CPU thread
+    if (interrupt)
+        Emulator::RaiseEvent({Emulator::EventType::VideoBlit, reinterpret_cast<uint64_t>(this)});
+}
+
+bool VideoDevice::HandleFill() {
+    VideoCommand::FillRequest request;
+    if (!ReadRequest(&request, sizeof(request)) || !ValidateRect(request.x, request.y, request.width, request.height))
+        return false;
+
+    Blitter::Fill(m_backend->GetFramebuffer(), m_currentMode.pitch, {request.x, request.y, request.width, request.height}, request.colour);
+    CompleteBlit(request.x, request.y, request.width, request.height, request.interrupt != 0);
+    return true;
+}
+
+bool VideoDevice::HandleCopy() {
+    VideoCommand::CopyRequest request;
+    if (!ReadRequest(&request, sizeof(request)) || !ValidateRect(request.srcX, request.srcY, request.width, request.height) || !ValidateRect(request.x, request.y, request.width, request.height))
+        return false;
+
+    Blitter::Copy(m_backend->GetFramebuffer(), m_currentMode.pitch, request.srcX, request.srcY, {request.x, request.y, request.width, request.height});
+    CompleteBlit(request.x, request.y, request.width, request.height, request.interrupt != 0);
+    return true;
+}
+
+bool VideoDevice::HandleBlit() {
+    VideoCommand::BlitRequest request;
+    if (!ReadRequest(&request, sizeof(request)) || !ValidateRect(request.x, request.y, request.width, request.height))
+        return false;
+
+    uint64_t rowSize = static_cast<uint64_t>(request.width) * 4;
+    if (request.width > 0 && request.height > 0) {
+        if (request.stride < rowSize)
+            return false;
+        uint64_t size = static_cast<uint64_t>(request.stride) * (request.height - 1) + rowSize;
+        if (request.address + size < request.address || !m_mmu.ValidateRead(request.address, size))
+            return false;
+    }
+
+    // straight from guest memory into the framebuffer, a row at a time
+    uint8_t* framebuffer = m_backend->GetFramebuffer();
+    for (uint64_t y = 0; y < request.height; y++)
+        m_mmu.ReadBuffer(request.address + y * request.stride, framebuffer + (request.y + y) * m_currentMode.pitch + request.x * 4, rowSize);
+
+    CompleteBlit(request.x, request.y, request.width, request.height, request.interrupt != 0);
+    return true;
+}
+
+bool VideoDevice::HandleGlyph() {
+    VideoCommand::GlyphRequest request;
+    if (!ReadRequest(&request, sizeof(request)) || !ValidateRect(request.x, request.y, request.width, request.height))
+        return false;
+
+    if (request.width > 0 && request.height > 0) {
+        uint64_t rowSize = (static_cast<uint64_t>(request.width) + 7) / 8;
+        if (request.stride < rowSize)
+            return false;
+        uint64_t size = static_cast<uint64_t>(request.stride) * (request.height - 1) + rowSize;
+        if (request.address + size < request.address || !m_mmu.ValidateRead(request.address, size))
+            return false;
+
+        m_blitBuffer.resize(size);
+        m_mmu.ReadBuffer(request.address, m_blitBuffer.data(), size);
+        Blitter::ExpandGlyph(m_backend->GetFramebuffer(), m_currentMode.pitch, {request.x, request.y, request.width, request.height}, m_blitBuffer.data(), request.stride, request.foreground, request.background, request.transparent != 0);
+    }
+
+    CompleteBlit(request.x, request.y, request.width, request.height, request.interrupt != 0);
+    return true;
 }
@@ -18,9 +18,12 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef _VIDEO_IO_DEVICE_HPP
 #define _VIDEO_IO_DEVICE_HPP
 
+#include <atomic>
 #include <stdint.h>
 #include <vector>
 
+#include <Common/Spinlock.hpp>
+
 #include <MMU/MMU.hpp>
 
 #include <IO/IODevice.hpp>
@@ -37,6 +40,9 @@ struct VideoMode {
 
 #define NATIVE_VIDEO_MODE {1024, 768, 60, 32, 4096}
 
+// Largest width or height of a mode once it has been scaled
+#define VIDEO_MAX_OUTPUT_SIZE 8192
+
 class VideoBackend;
 enum class VideoBackendType;
 
@@ -44,9 +50,26 @@ enum class VideoDeviceCommands {
     INITIALISE = 0,
     GET_SCREEN_INFO = 1,
     GET_MODE = 2,
-    SET_MODE = 3
+    SET_MODE = 3,
+    FLIP = 4,
+    FILL = 5,
+    COPY = 6,
+    BLIT = 7,
+    GLYPH = 8,
+    SET_PALETTE = 9
+};
+
+enum class VideoDeviceInterrupts {
+    FLIP = 0,
+    BLIT = 1
 };
 
+// Set in STATUS while a flip is waiting for the next frame
+#define VIDEO_STATUS_FLIP_PENDING 2
+
+// Set in STATUS when the last flip was dropped because its back buffer stopped being RAM before it was presented
+#define VIDEO_STATUS_FLIP_DROPPED 4
+
 enum class VideoDevicePorts {
     COMMAND = 0,
     DATA = 1,
@@ -79,7 +102,61 @@ namespace VideoCommand {
     struct [[gnu::packed]] SetModeRequest {
         uint64_t address;
         uint16_t mode;
-        uint8_t reserved[6];
+        uint8_t scale;
+        uint8_t filter;
+        uint8_t reserved[4];
+    };
+
+    struct [[gnu::packed]] FlipRequest {
+        uint64_t address;
+        uint8_t interrupt;
+        uint8_t reserved[7];
+    };
+
+    struct [[gnu::packed]] FillRequest {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+        uint32_t colour;
+        uint8_t interrupt;
+        uint8_t reserved[3];
+    };
+
+    struct [[gnu::packed]] CopyRequest {
+        uint32_t srcX;
+        uint32_t srcY;
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+        uint8_t interrupt;
+        uint8_t reserved[7];
+    };
+
+    struct [[gnu::packed]] BlitRequest {
+        uint64_t address;
+        uint32_t stride;
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+        uint8_t interrupt;
+        uint8_t reserved[3];
+    };
+
+    struct [[gnu::packed]] GlyphRequest {
+        uint64_t address;
+        uint32_t stride;
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+        uint32_t foreground;
+        uint32_t background;
+        uint8_t interrupt;
+        uint8_t transparent;
+        uint8_t reserved[2];
     };
 }
 
@@ -100,10 +177,28 @@ public:
     virtual void WriteDWord(uint64_t address, uint32_t data) override;
     virtual void WriteQWord(uint64_t address, uint64_t data) override;
 
-    void HandleMemoryOperation(bool write, uint64_t address, uint8_t* buffer, uint64_t size);
+    // nullptr until the guest initialises the device
+    VideoBackend* GetBackend() const;
+
+    void HandleFlipEvent();
+    void HandleBlitEvent();
 
 private:
     void HandleCommand();
+    uint64_t GetStatus() const;
+
+    static void VSyncCallback(void* data);
+    void HandleVSync();
+    void CancelFlip();
+
+    // Blitter commands. They return false if the request was invalid.
+    bool ReadRequest(void* request, uint64_t size);
+    bool ValidateRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+    void CompleteBlit(uint32_t x, uint32_t y, uint32_t width, uint32_t height, bool interrupt);
+    bool HandleFill();
+    bool HandleCopy();
+    bool HandleBlit();
+    bool HandleGlyph();
 
 private:
     VideoMemoryRegion* m_memoryRegion;
@@ -123,6 +218,16 @@ private:
     std::vector<VideoMode> m_modes;
 
     void* m_MemoryOverrideData;
+
+    // the back buffer waiting to be presented at the next frame
+    spinlock_t m_flipLock;
+    std::atomic_bool m_flipPending;
+    uint64_t m_flipAddress;
+    uint64_t m_flipSize;
+    bool m_flipInterrupt;
+    std::atomic_bool m_flipDropped;
+
+    std::vector<uint8_t> m_blitBuffer;
 };
 
 #endif /* _VIDEO_IO_DEVICE_HPP */
\ No newline at end of file
@@ -18,9 +18,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "VideoMemoryRegion.hpp"
 
 #include <cstdio>
+#include <cstring>
 
-VideoMemoryRegion::VideoMemoryRegion(uint64_t start, uint64_t end, void (*operationCallback)(bool write, uint64_t address, uint8_t* buffer, size_t size, void* data), void* data) : MemoryRegion(start, end), m_operationCallback(operationCallback), m_data(data) {
-
+VideoMemoryRegion::VideoMemoryRegion(uint64_t start, uint64_t end, uint8_t* framebuffer) : MemoryRegion(start, end), m_framebuffer(framebuffer) {
+    setHostBase(m_framebuffer);
 }
 
 VideoMemoryRegion::~VideoMemoryRegion() {
@@ -28,11 +29,13 @@ VideoMemoryRegion::~VideoMemoryRegion() {
 }
 
 void VideoMemoryRegion::read(uint64_t address, uint8_t* buffer, size_t size) {
-    m_operationCallback(false, address - getStart(), buffer, size, m_data);
+    if (isInside(address, size))
+        memcpy(buffer, m_framebuffer + (address - getStart()), size);
 }
 
 void VideoMemoryRegion::write(uint64_t address, const uint8_t* buffer, size_t size) {
-    m_operationCallback(true, address - getStart(), const_cast<uint8_t*>(buffer), size, m_data);
+    if (isInside(address, size))
+        memcpy(m_framebuffer + (address - getStart()), buffer, size);
 }
 
 void VideoMemoryRegion::dump(FILE* fp) {
@@ -41,4 +44,4 @@ void VideoMemoryRegion::dump(FILE* fp) {
 
 void VideoMemoryRegion::printData(void (*write)(void* data, const char* format, ...), void* data) {
     write(data, "VideoMemoryRegion: %lx-%lx\n", getStart(), getEnd());
-}
\ No newline at end of file
+}
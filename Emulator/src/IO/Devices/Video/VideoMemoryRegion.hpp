@@ -22,9 +22,11 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <MMU/MemoryRegion.hpp>
 
+// The framebuffer as the guest sees it. It is plain memory over the backend's pixel buffer, so accesses take the same paths as RAM.
+// Nothing is told about writes, the backend finds what changed by scanning the buffer every frame.
 class VideoMemoryRegion : public MemoryRegion {
 public:
-    VideoMemoryRegion(uint64_t start, uint64_t end, void (*operationCallback)(bool write, uint64_t address, uint8_t* buffer, size_t size, void* data), void* data);
+    VideoMemoryRegion(uint64_t start, uint64_t end, uint8_t* framebuffer);
     virtual ~VideoMemoryRegion();
 
     void read(uint64_t address, uint8_t* buffer, size_t size) override;
@@ -34,8 +36,7 @@ public:
     void printData(void (*write)(void* data, const char* format, ...), void* data) override;
 
 private:
-    void (*m_operationCallback)(bool write, uint64_t address, uint8_t* buffer, size_t size, void* data);
-    void* m_data;
+    uint8_t* m_framebuffer;
 };
 
-#endif /* _VIDEO_MEMORY_REGION_HPP */
\ No newline at end of file
+#endif /* _VIDEO_MEMORY_REGION_HPP */
@@ -0,0 +1,187 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "HeadlessVideoBackend.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#include <Emulator.hpp>
+
+HeadlessVideoConfig g_HeadlessVideoConfig;
+
+HeadlessVideoBackend::HeadlessVideoBackend(const VideoMode& mode)
+    : VideoBackend(mode), m_framebuffer(nullptr), m_dumpFile(nullptr), m_frameThread(nullptr), m_frameLock(0), m_dumpRequested(false), m_stats{0, 0, 0, 0, 0, 0, UINT64_MAX, 0, 0, 0}, m_statsLock(0) {
+}
+
+HeadlessVideoBackend::~HeadlessVideoBackend() {
+}
+
+void HeadlessVideoBackend::Init() {
+    if (!g_HeadlessVideoConfig.dumpPath.empty()) {
+        m_dumpFile = fopen(g_HeadlessVideoConfig.dumpPath.c_str(), "wb");
+        if (m_dumpFile == nullptr) {
+            std::stringstream ss = std::stringstream();
+            ss << "Failed to open frame dump file with error: " << strerror(errno);
+            Emulator::Crash(ss.str().c_str());
+        }
+    }
+
+    VideoMode mode = GetOutputMode();
+    m_framebuffer = new uint8_t[mode.pitch * mode.height]();
+
+    m_frameThread = new std::thread(&HeadlessVideoBackend::FrameLoop, this);
+}
+
+void HeadlessVideoBackend::SetMode(VideoMode mode, VideoScaling scaling) {
+    spinlock_acquire(&m_frameLock);
+
+    SetRawMode(mode, scaling);
+    VideoMode output = GetOutputMode();
+    delete[] m_framebuffer;
+    m_framebuffer = new uint8_t[output.pitch * output.height]();
+    GetDamageTracker().AddFullDamage();
+
+    spinlock_release(&m_frameLock);
+}
+
+VideoMode HeadlessVideoBackend::GetMode() {
+    return GetRawMode();
+}
+
+uint8_t* HeadlessVideoBackend::GetOutputBuffer() {
+    return m_framebuffer;
+}
+
+bool HeadlessVideoBackend::RequestFrameDump() {
+    if (m_dumpFile == nullptr)
+        return false;
+    m_dumpRequested.store(true);
+    return true;
+}
+
+void HeadlessVideoBackend::PrintStatistics(void (*write)(void* data, const char* format, ...), void* data) {
+    spinlock_acquire(&m_statsLock);
+    Statistics stats = m_stats;
+    spinlock_release(&m_statsLock);
+
+    VideoMode mode = GetRawMode();
+    write(data, "Mode: %lux%lu @ %luHz\n", mode.width, mode.height, mode.refreshRate);
+    write(data, "Frames: %lu (%lu with damage, %lu late, %lu dumped)\n", stats.frames, stats.damagedFrames, stats.lateFrames, stats.dumpedFrames);
+    write(data, "Damaged pixels: %lu\n", stats.damagedPixels);
+    if (stats.frames > 1)
+        write(data, "Frame interval: avg %.3fms, min %.3fms, max %.3fms\n", stats.totalIntervalNs / 1e6 / (stats.frames - 1), stats.minIntervalNs / 1e6, stats.maxIntervalNs / 1e6);
+    if (stats.frames > 0)
+        write(data, "Frame time: avg %.3fms, max %.3fms\n", stats.totalFrameTimeNs / 1e6 / stats.frames, stats.maxFrameTimeNs / 1e6);
+}
+
+void HeadlessVideoBackend::FrameLoop() {
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point next = clock::now();
+    clock::time_point last = {};
+    while (true) {
+        std::this_thread::sleep_until(next);
+        clock::time_point start = clock::now();
+
+        spinlock_acquire(&m_frameLock);
+        VideoMode mode = GetOutputMode();
+        clock::duration period = std::chrono::nanoseconds(1'000'000'000 / std::max<uint64_t>(mode.refreshRate, 1));
+
+        VSync();
+
+        uint64_t damagedPixels = 0;
+        if (CollectOutputDamage(m_damageRects, VIDEO_MAX_DAMAGE_RECTS)) {
+            for (const DamageRect& rect : m_damageRects)
+                damagedPixels += static_cast<uint64_t>(rect.width) * rect.height;
+        }
+
+        uint64_t frame;
+        spinlock_acquire(&m_statsLock);
+        frame = m_stats.frames;
+        spinlock_release(&m_statsLock);
+
+        bool dump = m_dumpFile != nullptr && (m_dumpRequested.exchange(false) || (g_HeadlessVideoConfig.dumpInterval > 0 && frame % g_HeadlessVideoConfig.dumpInterval == 0));
+        if (dump)
+            CaptureFrame(mode);
+        spinlock_release(&m_frameLock);
+
+        if (dump)
+            WriteFrame();
+
+        clock::time_point end = clock::now();
+        uint64_t frameTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        bool late = start - next > period;
+
+        spinlock_acquire(&m_statsLock);
+        if (m_stats.frames > 0) {
+            uint64_t interval = std::chrono::duration_cast<std::chrono::nanoseconds>(start - last).count();
+            m_stats.totalIntervalNs += interval;
+            m_stats.minIntervalNs = std::min(m_stats.minIntervalNs, interval);
+            m_stats.maxIntervalNs = std::max(m_stats.maxIntervalNs, interval);
+        }
+        m_stats.frames++;
+        if (damagedPixels > 0)
+            m_stats.damagedFrames++;
+        m_stats.damagedPixels += damagedPixels;
+        if (dump)
+            m_stats.dumpedFrames++;
+        if (late)
+            m_stats.lateFrames++;
+        m_stats.totalFrameTimeNs += frameTime;
+        m_stats.maxFrameTimeNs = std::max(m_stats.maxFrameTimeNs, frameTime);
+        spinlock_release(&m_statsLock);
+
+        // don't try to catch up on frames that were missed, just carry on from now
+        last = start;
+        next += period;
+        if (late)
+            next = end + period;
+    }
+}
+
+void HeadlessVideoBackend::CaptureFrame(const VideoMode& mode) {
+    if (g_HeadlessVideoConfig.dumpFormat == FrameDumpFormat::RAW) {
+        m_dumpBuffer.resize(mode.width * 4 * mode.height);
+        for (uint64_t y = 0; y < mode.height; y++)
+            memcpy(m_dumpBuffer.data() + y * mode.width * 4, m_framebuffer + y * mode.pitch, mode.width * 4);
+    } else {
+        char header[64];
+        size_t headerSize = static_cast<size_t>(snprintf(header, sizeof(header), "P6\n%lu %lu\n255\n", mode.width, mode.height));
+        m_dumpBuffer.resize(headerSize + mode.width * 3 * mode.height);
+        memcpy(m_dumpBuffer.data(), header, headerSize);
+        uint8_t* out = m_dumpBuffer.data() + headerSize;
+        for (uint64_t y = 0; y < mode.height; y++) {
+            // pixels are 0xAARRGGBB, so B, G, R in memory
+            const uint8_t* row = m_framebuffer + y * mode.pitch;
+            for (uint64_t x = 0; x < mode.width; x++) {
+                out[x * 3 + 0] = row[x * 4 + 2];
+                out[x * 3 + 1] = row[x * 4 + 1];
+                out[x * 3 + 2] = row[x * 4 + 0];
+            }
+            out += mode.width * 3;
+        }
+    }
+}
+
+void HeadlessVideoBackend::WriteFrame() {
+    fwrite(m_dumpBuffer.data(), 1, m_dumpBuffer.size(), m_dumpFile);
+    fflush(m_dumpFile);
+}
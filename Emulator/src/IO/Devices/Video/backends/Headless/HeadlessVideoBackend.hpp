@@ -0,0 +1,93 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _HEADLESS_VIDEO_BACKEND_HPP
+#define _HEADLESS_VIDEO_BACKEND_HPP
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Common/Spinlock.hpp>
+
+#include "../../VideoBackend.hpp"
+
+enum class FrameDumpFormat {
+    RAW, // rows of 32-bit pixels exactly as the guest sees them, no header
+    PPM  // binary (P6) PPM, one image per frame
+};
+
+struct HeadlessVideoConfig {
+    std::string dumpPath;  // file or pipe to append frames to, empty for none
+    FrameDumpFormat dumpFormat = FrameDumpFormat::PPM;
+    uint64_t dumpInterval = 0; // dump every N frames, 0 to only dump on request
+};
+
+extern HeadlessVideoConfig g_HeadlessVideoConfig;
+
+// Keeps the framebuffer in memory and runs frames at the mode's refresh rate without a display.
+class HeadlessVideoBackend : public VideoBackend {
+   public:
+    explicit HeadlessVideoBackend(const VideoMode& mode = NATIVE_VIDEO_MODE);
+    ~HeadlessVideoBackend() override;
+
+    void Init() override;
+    void SetMode(VideoMode mode, VideoScaling scaling) override;
+    VideoMode GetMode() override;
+
+    bool RequestFrameDump() override;
+    void PrintStatistics(void (*write)(void* data, const char* format, ...), void* data) override;
+
+   protected:
+    uint8_t* GetOutputBuffer() override;
+
+   private:
+    void FrameLoop();
+    // Encodes the framebuffer into m_dumpBuffer, called with m_frameLock held
+    void CaptureFrame(const VideoMode& mode);
+    // Writes out m_dumpBuffer without m_frameLock, as the dump file may be a pipe that blocks
+    void WriteFrame();
+
+   private:
+    uint8_t* m_framebuffer;
+    FILE* m_dumpFile;
+
+    std::thread* m_frameThread;
+    spinlock_t m_frameLock; // held for a whole frame, and while the mode changes
+
+    std::atomic_bool m_dumpRequested;
+    std::vector<DamageRect> m_damageRects;
+    std::vector<uint8_t> m_dumpBuffer; // only used by the frame thread
+
+    struct Statistics {
+        uint64_t frames;
+        uint64_t damagedFrames;
+        uint64_t damagedPixels;
+        uint64_t dumpedFrames;
+        uint64_t lateFrames;         // started more than a whole frame after they were due
+        uint64_t totalIntervalNs;    // time between the starts of consecutive frames
+        uint64_t minIntervalNs;
+        uint64_t maxIntervalNs;
+        uint64_t totalFrameTimeNs;   // time spent handling a frame
+        uint64_t maxFrameTimeNs;
+    } m_stats;
+    spinlock_t m_statsLock;
+};
+
+#endif /* _HEADLESS_VIDEO_BACKEND_HPP */
@@ -20,9 +20,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_events.h>
 
-#include <Emulator.hpp>
+#include <algorithm>
+#include <chrono>
 
-#include "IO/devices/Video/VideoBackend.hpp"
+#include <Emulator.hpp>
 
 void SDLBackend_EventHandler(void* data) {
     SDLVideoBackend* backend = static_cast<SDLVideoBackend*>(data);
@@ -30,7 +31,7 @@ void SDLBackend_EventHandler(void* data) {
 }
 
 SDLVideoBackend::SDLVideoBackend(const VideoMode& mode)
-    : VideoBackend(mode), m_window(nullptr), m_renderer(nullptr), m_texture(nullptr), m_framebuffer(nullptr), m_eventThread(nullptr), m_renderThread(nullptr), m_renderAllowed(true), m_renderRunning(false), m_framebufferDirty(false) {
+    : VideoBackend(mode), m_window(nullptr), m_renderer(nullptr), m_texture(nullptr), m_framebuffer(nullptr), m_eventThread(nullptr), m_renderThread(nullptr), m_renderAllowed(true), m_renderRunning(false), m_exposed(false) {
 }
 
 SDLVideoBackend::~SDLVideoBackend() {
@@ -44,7 +45,7 @@ void SDLVideoBackend::Init() {
         exit(1);
     }
 
-    VideoMode mode = GetRawMode();
+    VideoMode mode = GetOutputMode();
 
     if (!SDL_CreateWindowAndRenderer("Emulator", mode.width, mode.height, 0, &m_window, &m_renderer)) {
         printf("Failed to create window and renderer: %s\n", SDL_GetError());
@@ -56,19 +57,16 @@ void SDLVideoBackend::Init() {
     m_renderThread = new std::thread(&SDLVideoBackend::RenderLoop, this);
     m_eventThread = new std::thread(SDLBackend_EventHandler, this);
 
-    while (!m_renderRunning.load())
-        ;
+    m_renderRunning.wait(false);
 }
 
-void SDLVideoBackend::SetMode(VideoMode mode) {
+void SDLVideoBackend::SetMode(VideoMode mode, VideoScaling scaling) {
     m_renderAllowed.store(false);
-    while (m_renderRunning.load())
-        ;
 
     m_renderThread->join();
     delete m_renderThread;
 
-    SetRawMode(mode);
+    SetRawMode(mode, scaling);
 
     SDL_DestroyTexture(m_texture);
     delete[] m_framebuffer;
@@ -76,58 +74,54 @@ void SDLVideoBackend::SetMode(VideoMode mode) {
     m_renderAllowed.store(true);
     m_renderThread = new std::thread(&SDLVideoBackend::RenderLoop, this);
 
-    while (!m_renderRunning.load())
-        ;
+    m_renderRunning.wait(false);
 }
 
 VideoMode SDLVideoBackend::GetMode() {
     return GetRawMode();
 }
 
-void SDLVideoBackend::Write(uint64_t offset, uint8_t* data, uint64_t size) {
-    memcpy(m_framebuffer + offset, data, size);
-    m_framebufferDirty.store(true);
-}
-
-void SDLVideoBackend::Read(uint64_t offset, uint8_t* data, uint64_t size) {
-    memcpy(data, m_framebuffer + offset, size);
+uint8_t* SDLVideoBackend::GetOutputBuffer() {
+    return m_framebuffer;
 }
 
 void SDLVideoBackend::EnterEventLoop() {
-    while (true) {
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            switch (event.type) {
-            case SDL_EVENT_QUIT:
-                Emulator::Crash("User closed window");
-            default:
-                break;
-            }
+    SDL_Event event;
+    // sleeps in SDL until there is something to handle
+    while (SDL_WaitEvent(&event)) {
+        switch (event.type) {
+        case SDL_EVENT_QUIT:
+            Emulator::Crash("User closed window");
+        case SDL_EVENT_WINDOW_EXPOSED:
+            // the damage tracker belongs to the render thread, a mode change may be replacing it right now
+            m_exposed.store(true);
+            break;
+        default:
+            break;
         }
     }
+    printf("Failed to wait for SDL events: %s\n", SDL_GetError());
+    exit(1);
 }
 
 void SDLVideoBackend::Draw() {
-    if (!m_framebufferDirty.load())
+    if (!CollectOutputDamage(m_damageRects, VIDEO_MAX_DAMAGE_RECTS))
         return;
 
-    VideoMode mode = GetRawMode();
-
-    void* pixels;
-    int pitch;
+    VideoMode mode = GetOutputMode();
 
-    if (SDL_LockTexture(m_texture, nullptr, &pixels, &pitch)) {
-        memcpy(pixels, m_framebuffer, mode.width * mode.height * 4);
-        SDL_UnlockTexture(m_texture);
-        // SDL_RenderClear(m_renderer);
-        SDL_RenderTexture(m_renderer, m_texture, nullptr, nullptr);
-        SDL_RenderPresent(m_renderer);
-        m_framebufferDirty.store(false);
+    // only upload what changed, the texture keeps the rest from the previous frame
+    for (const DamageRect& rect : m_damageRects) {
+        SDL_Rect area = {static_cast<int>(rect.x), static_cast<int>(rect.y), static_cast<int>(rect.width), static_cast<int>(rect.height)};
+        SDL_UpdateTexture(m_texture, &area, m_framebuffer + rect.y * mode.pitch + rect.x * 4, static_cast<int>(mode.pitch));
     }
+
+    SDL_RenderTexture(m_renderer, m_texture, nullptr, nullptr);
+    SDL_RenderPresent(m_renderer);
 }
 
 void SDLVideoBackend::RenderLoop() {
-    VideoMode mode = GetRawMode();
+    VideoMode mode = GetOutputMode();
 
     m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, mode.width, mode.height);
     if (m_texture == nullptr) {
@@ -137,13 +131,26 @@ void SDLVideoBackend::RenderLoop() {
 
     m_framebuffer = new uint8_t[mode.width * mode.height * 4];
     memset(m_framebuffer, 0, mode.width * mode.height * 4);
+    GetDamageTracker().AddFullDamage(); // the new texture has undefined contents
 
     SDL_SetWindowSize(m_window, mode.width, mode.height);
 
+    std::chrono::steady_clock::duration period = std::chrono::nanoseconds(1'000'000'000 / std::max<uint64_t>(mode.refreshRate, 1));
+    std::chrono::steady_clock::time_point nextFrame = std::chrono::steady_clock::now();
+
     m_renderRunning.store(true);
+    m_renderRunning.notify_all();
     while (m_renderAllowed.load()) {
+        // once per refresh, anything drawn in the meantime goes out with this frame
+        std::this_thread::sleep_until(nextFrame);
+        nextFrame = std::max(nextFrame + period, std::chrono::steady_clock::now());
+
+        if (m_exposed.exchange(false))
+            GetDamageTracker().AddFullDamage();
+
+        VSync();
         Draw();
-        std::this_thread::sleep_for(std::chrono::milliseconds(16)); // roughly 60fps
     }
     m_renderRunning.store(false);
+    m_renderRunning.notify_all();
 }
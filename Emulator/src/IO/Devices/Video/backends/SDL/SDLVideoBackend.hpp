@@ -21,6 +21,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <SDL3/SDL.h>
 
 #include <thread>
+#include <vector>
 
 #include "../../VideoBackend.hpp"
 
@@ -30,15 +31,15 @@ class SDLVideoBackend : public VideoBackend {
     ~SDLVideoBackend() override;
 
     void Init() override;
-    void SetMode(VideoMode mode) override;
+    void SetMode(VideoMode mode, VideoScaling scaling) override;
     VideoMode GetMode() override;
 
-    void Write(uint64_t offset, uint8_t* data, uint64_t size) override;
-    void Read(uint64_t offset, uint8_t* data, uint64_t size) override;
-
     void EnterEventLoop();
     void RenderLoop();
 
+   protected:
+    uint8_t* GetOutputBuffer() override;
+
    private:
     void Draw();
 
@@ -54,7 +55,9 @@ class SDLVideoBackend : public VideoBackend {
 
     std::atomic_bool m_renderAllowed;
     std::atomic_bool m_renderRunning;
-    std::atomic_bool m_framebufferDirty;
+    std::atomic_bool m_exposed; // set by the event thread, turned into full damage by the render thread
+
+    std::vector<DamageRect> m_damageRects;
 };
 
 #endif /* _SDL_VIDEO_BACKEND_HPP */
\ No newline at end of file
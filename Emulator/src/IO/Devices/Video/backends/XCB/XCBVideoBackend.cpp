@@ -24,6 +24,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <xcb/xcb_image.h>
 #include <xcb/xproto.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <Emulator.hpp>
 
@@ -132,7 +134,7 @@ void XCBBackend_Loop(void* data) {
     backend->EnterEventLoop();
 }
 
-XCBVideoBackend::XCBVideoBackend(const VideoMode& mode) : VideoBackend(mode), m_connection(nullptr), m_window(0), m_shm_xcb_image(nullptr), m_gc(0), m_framebuffer(nullptr), m_eventThread(nullptr), m_renderThread(nullptr), m_renderAllowed(true), m_renderRunning(false), m_framebufferDirty(false) {
+XCBVideoBackend::XCBVideoBackend(const VideoMode& mode) : VideoBackend(mode), m_connection(nullptr), m_window(0), m_shm_xcb_image(nullptr), m_gc(0), m_framebuffer(nullptr), m_eventThread(nullptr), m_renderThread(nullptr), m_renderAllowed(true), m_renderRunning(false) {
 
 }
 
@@ -151,12 +153,7 @@ void XCBVideoBackend::Init() {
         Emulator::Crash("X server does not support the XCB SHM extension");
     }
 
-    VideoMode mode = GetRawMode();
-    if (mode.bpp != 32) {
-        xcb_disconnect(m_connection);
-        Emulator::Crash("XCB Video Backend only supports 32bpp modes");
-    }
-
+    VideoMode mode = GetOutputMode();
     m_shm_xcb_image = shm_xcb_image_create(m_connection, mode.width, mode.height, 24);
     if (m_shm_xcb_image == nullptr) {
         xcb_disconnect(m_connection);
@@ -192,40 +189,39 @@ void XCBVideoBackend::Init() {
     m_eventThread = new std::thread(XCBBackend_Loop, this);
 }
 
-void XCBVideoBackend::SetMode(VideoMode mode) {
+void XCBVideoBackend::SetMode(VideoMode mode, VideoScaling scaling) {
     m_renderAllowed.store(false);
     m_renderAllowed.notify_all();
-    m_framebufferDirty.store(true);
-    m_framebufferDirty.notify_all(); // wake the render thread if it's waiting
     while (m_renderRunning.load())
         ;
 
     m_renderThread->join();
     delete m_renderThread;
 
-    SetRawMode(mode);
-
-    if (mode.bpp != 32)
-        Emulator::Crash("XCB Video Backend only supports 32bpp modes");
+    SetRawMode(mode, scaling);
+    VideoMode output = GetOutputMode();
 
     shm_xcb_image_destroy(m_shm_xcb_image);
 
-    uint32_t values[2] = {static_cast<uint32_t>(mode.width), static_cast<uint32_t>(mode.height)};
+    uint32_t values[2] = {static_cast<uint32_t>(output.width), static_cast<uint32_t>(output.height)};
     xcb_configure_window(m_connection, m_window, XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
 
     XSizeHints hints = {};
     hints.flags = X_SIZE_HINT_P_MIN_SIZE | X_SIZE_HINT_P_MAX_SIZE | X_SIZE_HINT_P_SIZE;
-    hints.min_width = mode.width;
-    hints.min_height = mode.height;
-    hints.max_width = mode.width;
-    hints.max_height = mode.height;
+    hints.min_width = output.width;
+    hints.min_height = output.height;
+    hints.max_width = output.width;
+    hints.max_height = output.height;
 
     xcb_change_property(m_connection, XCB_PROP_MODE_REPLACE, m_window, XCB_ATOM_WM_NORMAL_HINTS, XCB_ATOM_WM_SIZE_HINTS, 32, sizeof(XSizeHints) / 4, &hints);
 
-    m_shm_xcb_image = shm_xcb_image_create(m_connection, mode.width, mode.height, 24);
+    m_shm_xcb_image = shm_xcb_image_create(m_connection, output.width, output.height, 24);
 
     xcb_flush(m_connection);
 
+    // the window still shows the old mode
+    GetDamageTracker().AddFullDamage();
+
     m_renderAllowed.store(true);
     m_renderThread = new std::thread(&XCBVideoBackend::RenderLoop, this);
 
@@ -237,14 +233,8 @@ VideoMode XCBVideoBackend::GetMode() {
     return GetRawMode();
 }
 
-void XCBVideoBackend::Write(uint64_t offset, uint8_t* data, uint64_t size) {
-    memcpy(m_shm_xcb_image->image->data + offset, data, size);
-    m_framebufferDirty.store(true);
-    m_framebufferDirty.notify_all();
-}
-
-void XCBVideoBackend::Read(uint64_t offset, uint8_t* data, uint64_t size) {
-    memcpy(data, m_shm_xcb_image->image->data + offset, size);
+uint8_t* XCBVideoBackend::GetOutputBuffer() {
+    return m_shm_xcb_image->image->data;
 }
 
 void XCBVideoBackend::EnterEventLoop() {
@@ -261,26 +251,46 @@ void XCBVideoBackend::EnterEventLoop() {
 }
 
 void XCBVideoBackend::RenderLoop() {
+    VideoMode mode = GetRawMode();
+    std::chrono::steady_clock::duration period = std::chrono::nanoseconds(1'000'000'000 / std::max<uint64_t>(mode.refreshRate, 1));
+    std::chrono::steady_clock::time_point nextFrame = std::chrono::steady_clock::now();
+
     while (m_renderAllowed.load()) {
         if (!m_renderRunning.load()) {
             m_renderRunning.store(true);
             m_renderRunning.notify_all();
         }
-        if (!m_framebufferDirty.load())
-            m_framebufferDirty.wait(false);
-        Draw();
-        m_framebufferDirty.store(false);
+
+        // once per refresh, so a flip always lands on a frame boundary
+        std::this_thread::sleep_until(nextFrame);
+        nextFrame = std::max(nextFrame + period, std::chrono::steady_clock::now());
+
+        VSync();
+        DrawDamage();
     }
     m_renderRunning.store(false);
     m_renderRunning.notify_all();
 }
 
 void XCBVideoBackend::Draw() {
+    PutImage(0, 0, m_shm_xcb_image->image->width, m_shm_xcb_image->image->height);
+    xcb_flush(m_connection);
+}
+
+void XCBVideoBackend::DrawDamage() {
+    if (!CollectOutputDamage(m_damageRects, VIDEO_MAX_DAMAGE_RECTS))
+        return;
+
+    for (const DamageRect& rect : m_damageRects)
+        PutImage(rect.x, rect.y, rect.width, rect.height);
+
+    xcb_flush(m_connection);
+}
+
+void XCBVideoBackend::PutImage(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
     xcb_shm_put_image(m_connection, m_window, m_gc,
-        m_shm_xcb_image->image->width, m_shm_xcb_image->image->height, 0, 0,
-        m_shm_xcb_image->image->width, m_shm_xcb_image->image->height, 0, 0,
+        m_shm_xcb_image->image->width, m_shm_xcb_image->image->height, x, y,
+        width, height, x, y,
         m_shm_xcb_image->image->depth, m_shm_xcb_image->image->format, 0,
         m_shm_xcb_image->shm_seg, 0);
-
-    xcb_flush(m_connection);
 }
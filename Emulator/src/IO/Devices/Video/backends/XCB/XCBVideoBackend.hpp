@@ -19,6 +19,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #define _XCB_VIDEO_BACKEND_HPP
 
 #include <thread>
+#include <vector>
 
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
@@ -39,17 +40,19 @@ class XCBVideoBackend : public VideoBackend {
     ~XCBVideoBackend() override;
 
     void Init() override;
-    void SetMode(VideoMode mode) override;
+    void SetMode(VideoMode mode, VideoScaling scaling) override;
     VideoMode GetMode() override;
 
-    void Write(uint64_t offset, uint8_t* data, uint64_t size) override;
-    void Read(uint64_t offset, uint8_t* data, uint64_t size) override;
-
     void EnterEventLoop();
     void RenderLoop();
 
+   protected:
+    uint8_t* GetOutputBuffer() override;
+
    private:
     void Draw();
+    void DrawDamage();
+    void PutImage(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
 
    private:
     xcb_connection_t* m_connection;
@@ -64,7 +67,8 @@ class XCBVideoBackend : public VideoBackend {
 
     std::atomic_bool m_renderAllowed;
     std::atomic_bool m_renderRunning;
-    std::atomic_bool m_framebufferDirty;
+
+    std::vector<DamageRect> m_damageRects;
 };
 
 #endif /* _XCB_VIDEO_BACKEND_HPP */
\ No newline at end of file
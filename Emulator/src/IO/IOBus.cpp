@@ -28,6 +28,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <Exceptions.hpp>
 #include <Interrupts.hpp>
 
+#include <MMU/Epoch.hpp>
+
 void IOBus_HandleDeviceInterrupt(IODeviceID device, uint64_t index, void* data) {
     if (IOBus* bus = static_cast<IOBus*>(data); bus != nullptr)
         bus->HandleDeviceInterrupt(device, index);
@@ -155,11 +157,13 @@ void IOBus::RunCommand(uint64_t command) {
             m_registers.status.error = true;
             break;
         }
+        // the old region going and the new one arriving are published together
+        MMU::MapBatch batch(m_MMU);
         if (uint64_t oldBaseAddress = device->GetBaseAddress(); oldBaseAddress != 0) {
             // need to delete the old region
             if (IOMemoryRegion* region = device->GetMemoryRegion(); region != nullptr) {
                 m_MMU->RemoveMemoryRegion(region);
-                delete region;
+                Epoch::Retire(region); // the storage or render thread can still be in the middle of using it
                 m_MMU->ReaddRegionSegment(device->GetReplacingRegionData());
             }
         }
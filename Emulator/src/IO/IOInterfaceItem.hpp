@@ -24,6 +24,8 @@ enum class IOInterfaceType {
     STDIO,
     FILE,
     NETWORK,
+    UNIX,
+    SHARED_MEMORY,
     UNKNOWN
 };
 
@@ -26,6 +26,18 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <OSSpecific/File.hpp>
 #include <OSSpecific/Network.hpp>
+#include <OSSpecific/SharedRing.hpp>
+
+// Strip an optional ":<policy>" suffix off a socket interface name
+TCPSocketPolicy ParseSocketPolicy(std::string_view& name) {
+    if (name.ends_with(":first-writer")) {
+        name.remove_suffix(sizeof(":first-writer") - 1);
+        return TCPSocketPolicy::FIRST_WRITER;
+    }
+    if (name.ends_with(":broadcast"))
+        name.remove_suffix(sizeof(":broadcast") - 1);
+    return TCPSocketPolicy::BROADCAST;
+}
 
 IOInterfaceManager::IOInterfaceManager() {
 
@@ -45,23 +57,42 @@ void IOInterfaceManager::AddInterfaceItem(IOInterfaceItem* item) {
             item->SetType(IOInterfaceType::FILE);
         else if (data.starts_with("port:"))
             item->SetType(IOInterfaceType::NETWORK);
+        else if (data.starts_with("unix:"))
+            item->SetType(IOInterfaceType::UNIX);
+        else if (data.starts_with("shm:"))
+            item->SetType(IOInterfaceType::SHARED_MEMORY);
     }
 
     std::string_view name;
-    if (item->GetType() == IOInterfaceType::FILE || item->GetType() == IOInterfaceType::NETWORK) {
+    if (item->GetType() != IOInterfaceType::STDIO && item->GetType() != IOInterfaceType::UNKNOWN) {
         // need to remove the prefix
         name = item->GetStringData().substr(item->GetStringData().find(':') + 1);
     }
 
     switch (item->GetType()) {
     case IOInterfaceType::STDIO:
-        // nothing to do
+        // stdin is shared, so each item can only stop its own reads
+        item->SetRawData(CreateFileReadCancel());
         break;
     case IOInterfaceType::FILE:
         item->SetRawData(FILE_HANDLE_TO_VOID_PTR(OpenFile(name.data(), true))); // OpenFile already crashes on error
         break;
-    case IOInterfaceType::NETWORK:
-        item->SetRawData(OpenTCPSocket(static_cast<int>(strtol(name.data(), nullptr, 10))));
+    case IOInterfaceType::NETWORK: {
+        // port:<port>[:<policy>]
+        TCPSocketPolicy policy = ParseSocketPolicy(name);
+        if (name.find(':') != std::string_view::npos)
+            Emulator::Crash("Unknown socket policy");
+        item->SetRawData(OpenTCPSocket(static_cast<int>(strtol(name.data(), nullptr, 10)), policy));
+        break;
+    }
+    case IOInterfaceType::UNIX: {
+        // unix:<path>[:<policy>]
+        TCPSocketPolicy policy = ParseSocketPolicy(name);
+        item->SetRawData(OpenUnixSocket(std::string(name).c_str(), policy));
+        break;
+    }
+    case IOInterfaceType::SHARED_MEMORY:
+        item->SetRawData(OpenSharedRing(name.data()));
         break;
     case IOInterfaceType::UNKNOWN:
         Emulator::Crash("Unknown IO interface type");
@@ -69,26 +100,68 @@ void IOInterfaceManager::AddInterfaceItem(IOInterfaceItem* item) {
     }
 }
 
-void IOInterfaceManager::RemoveInterfaceItem(IOInterfaceItem*) {
+void IOInterfaceManager::RemoveInterfaceItem(IOInterfaceItem* item) {
+    if (item == nullptr)
+        return;
+
+    switch (item->GetType()) {
+    case IOInterfaceType::STDIO:
+        CancelFileRead(static_cast<FileReadCancel_t*>(item->GetRawData()));
+        break;
+    case IOInterfaceType::FILE:
+        // reads never wait, and a reader may still be using the handle, so it stays open
+        break;
+    case IOInterfaceType::NETWORK:
+    case IOInterfaceType::UNIX:
+        CloseTCPSocket(reinterpret_cast<TCPSocketHandle_t*>(item->GetRawData()));
+        break;
+    case IOInterfaceType::SHARED_MEMORY:
+        CloseSharedRing(reinterpret_cast<SharedRingHandle_t*>(item->GetRawData()));
+        break;
+    case IOInterfaceType::UNKNOWN:
+        break;
+    }
 }
 
-void IOInterfaceManager::Read(IOInterfaceItem* item, void* buffer, size_t size) {
+void IOInterfaceManager::DestroyInterfaceItem(IOInterfaceItem* item) {
     if (item == nullptr)
         return;
 
     switch (item->GetType()) {
     case IOInterfaceType::STDIO:
-        ReadFile(GetFileHandleForStdIn(), buffer, size, SIZE_MAX);
+        DestroyFileReadCancel(static_cast<FileReadCancel_t*>(item->GetRawData()));
+        item->SetRawData(nullptr);
         break;
     case IOInterfaceType::FILE:
-        ReadFile(VOID_PTR_TO_FILE_HANDLE(item->GetRawData()), buffer, size, SIZE_MAX);
-        break;
     case IOInterfaceType::NETWORK:
-        ReadFromTCPSocket(reinterpret_cast<TCPSocketHandle_t*>(item->GetRawData()), buffer, size);
+    case IOInterfaceType::UNIX:
+    case IOInterfaceType::SHARED_MEMORY:
+    case IOInterfaceType::UNKNOWN:
+        // nothing more to free than closing already did
         break;
+    }
+}
+
+size_t IOInterfaceManager::Read(IOInterfaceItem* item, void* buffer, size_t size) {
+    if (item == nullptr)
+        return 0;
+
+    switch (item->GetType()) {
+    case IOInterfaceType::STDIO:
+        return ReadFileCancellable(GetFileHandleForStdIn(), buffer, size, static_cast<FileReadCancel_t*>(item->GetRawData()));
+    case IOInterfaceType::FILE:
+        return ReadFile(VOID_PTR_TO_FILE_HANDLE(item->GetRawData()), buffer, size, SIZE_MAX);
+    case IOInterfaceType::NETWORK:
+    case IOInterfaceType::UNIX: {
+        ssize_t read_size = ReadFromTCPSocket(reinterpret_cast<TCPSocketHandle_t*>(item->GetRawData()), buffer, size);
+        return read_size < 0 ? 0 : static_cast<size_t>(read_size);
+    }
+    case IOInterfaceType::SHARED_MEMORY:
+        return static_cast<size_t>(ReadFromSharedRing(reinterpret_cast<SharedRingHandle_t*>(item->GetRawData()), buffer, size));
     case IOInterfaceType::UNKNOWN:
         break;
     }
+    return 0;
 }
 
 void IOInterfaceManager::Write(IOInterfaceItem* item, const void* buffer, size_t size) {
@@ -103,8 +176,12 @@ void IOInterfaceManager::Write(IOInterfaceItem* item, const void* buffer, size_t
         WriteFile(VOID_PTR_TO_FILE_HANDLE(item->GetRawData()), buffer, size, SIZE_MAX);
         break;
     case IOInterfaceType::NETWORK:
+    case IOInterfaceType::UNIX:
         WriteToTCPSocket(reinterpret_cast<TCPSocketHandle_t*>(item->GetRawData()), buffer, size);
         break;
+    case IOInterfaceType::SHARED_MEMORY:
+        WriteToSharedRing(reinterpret_cast<SharedRingHandle_t*>(item->GetRawData()), buffer, size);
+        break;
     case IOInterfaceType::UNKNOWN:
         break;
     }
@@ -30,10 +30,13 @@ public:
     ~IOInterfaceManager();
 
     void AddInterfaceItem(IOInterfaceItem* item);
+    // Closes the interface of item. A Read blocked on it returns 0, as does any later Read unless the interface is a file.
     void RemoveInterfaceItem(IOInterfaceItem* item);
+    // Frees what is left of the interface of item after RemoveInterfaceItem. Only once nothing can be reading from it anymore.
+    void DestroyInterfaceItem(IOInterfaceItem* item);
 
-    // Read data from the interface type of the item
-    void Read(IOInterfaceItem* item, void* buffer, size_t size);
+    // Read data from the interface type of the item. Returns the number of bytes read, 0 meaning the end of the input.
+    size_t Read(IOInterfaceItem* item, void* buffer, size_t size);
     // Write data to the interface type of the item
     void Write(IOInterfaceItem* item, const void* buffer, size_t size);
 
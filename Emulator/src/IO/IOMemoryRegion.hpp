@@ -20,37 +20,28 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <cstdint>
 
-#include <MMU/MemoryRegion.hpp>
+#include <MMU/MMIOMemoryRegion.hpp>
 
 #include "IOBus.hpp"
 
-class IOMemoryRegion : public MemoryRegion {
+// Registers of a device on the I/O bus, each a QWORD
+class IOMemoryRegion : public MMIOMemoryRegion {
    public:
-    IOMemoryRegion(uint64_t start, uint64_t end, IOBus* bus);
     IOMemoryRegion(uint64_t start, uint64_t end, IODevice* device);
     ~IOMemoryRegion() override;
 
-    virtual void read(uint64_t address, uint8_t* buffer, size_t size) override;
-    virtual void write(uint64_t address, const uint8_t* buffer, size_t size) override;
-
-    virtual void read8(uint64_t address, uint8_t* buffer) override;
-    virtual void read16(uint64_t address, uint16_t* buffer) override;
-    virtual void read32(uint64_t address, uint32_t* buffer) override;
-    virtual void read64(uint64_t address, uint64_t* buffer) override;
-    virtual void write8(uint64_t address, const uint8_t* buffer) override;
-    virtual void write16(uint64_t address, const uint16_t* buffer) override;
-    virtual void write32(uint64_t address, const uint32_t* buffer) override;
-    virtual void write64(uint64_t address, const uint64_t* buffer) override;
-
     virtual void dump(FILE* fp) override;
     virtual void printData(void (*write)(void* data, const char* format, ...), void* data) override;
 
+   protected:
+    virtual uint64_t ReadRegister(uint64_t index, uint8_t width) override;
+    virtual void WriteRegister(uint64_t index, uint64_t data, uint8_t width) override;
+
+    // device registers are always accessed from their start, whatever the address inside them
+    virtual bool AlignsAccesses(uint64_t) const override { return true; }
+
    private:
-    union {
-        IOBus* bus;
-        IODevice* device;
-    } m_data;
-    bool m_isBus;
+    IODevice* m_device;
 };
 
 #endif /* _IO_MEMORY_REGION_HPP */
\ No newline at end of file
@@ -134,6 +134,8 @@ void InitInstructionSubsystem(uint64_t startingIP, MMU* mmu) {
     SETINSFUNC(SYSCALL, ins_syscall, 0);
     SETINSFUNC(SYSRET, ins_sysret, 0);
     SETINSFUNC(ENTERUSER, ins_enteruser, 1);
+    SETINSFUNC(INVLPG, ins_invlpg, 1);
+    SETINSFUNC(INVASID, ins_invasid, 1);
 #undef SETINSFUNC
 
     g_rawIPPointer = Emulator::GetRawIPPointer();
@@ -384,7 +386,7 @@ void ExecutionLoop() {
                 }
                 case InsEncoding::OperandType::MEMORY: {
                     uint64_t* temp = static_cast<uint64_t*>(op->data);
-                    g_currentInstruction->operands[i] = Operand(static_cast<OperandSize>(op->size), *temp, Emulator::HandleMemoryOperation);
+                    g_currentInstruction->operands[i] = Operand(static_cast<OperandSize>(op->size), *temp, Emulator::g_memoryOperation);
                     break;
                 }
                 case InsEncoding::OperandType::COMPLEX: {
@@ -432,7 +434,7 @@ void ExecutionLoop() {
                         }
                     } else
                         complex[i].offset.present = false;
-                    g_currentInstruction->operands[i] = Operand(static_cast<OperandSize>(op->size), &complex[i], Emulator::HandleMemoryOperation);
+                    g_currentInstruction->operands[i] = Operand(static_cast<OperandSize>(op->size), &complex[i], Emulator::g_memoryOperation);
                     break;
                 }
                 default:
@@ -822,4 +824,18 @@ void ins_enteruser(Operand* dst) {
     if (Emulator::isInProtectedMode() && Emulator::isInUserMode())
         g_ExceptionHandler->RaiseException(Exception::USER_MODE_VIOLATION);
     Emulator::EnterUserMode(dst->GetValue());
+}
+
+void ins_invlpg(Operand* address) {
+    PRINT_INS_INFO1(address);
+    if (Emulator::isInProtectedMode() && Emulator::isInUserMode())
+        g_ExceptionHandler->RaiseException(Exception::USER_MODE_VIOLATION);
+    Emulator::InvalidatePage(address->GetValue());
+}
+
+void ins_invasid(Operand* asid) {
+    PRINT_INS_INFO1(asid);
+    if (Emulator::isInProtectedMode() && Emulator::isInUserMode())
+        g_ExceptionHandler->RaiseException(Exception::USER_MODE_VIOLATION);
+    Emulator::InvalidateAddressSpace(asid->GetValue());
 }
\ No newline at end of file
@@ -90,5 +90,7 @@ void ins_iret();
 void ins_syscall();
 void ins_sysret();
 void ins_enteruser(Operand* dst);
+void ins_invlpg(Operand* address);
+void ins_invasid(Operand* asid);
 
 #endif /* _INSTRUCTION_HPP */
\ No newline at end of file
@@ -17,11 +17,12 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "InstructionCache.hpp"
 
+#include <algorithm>
 #include <cstring>
 
 #include <MMU/MMU.hpp>
 
-InstructionCache::InstructionCache() : m_cache{0}, m_cacheOffset(INSTRUCTION_CACHE_SIZE), m_mmu(nullptr), m_base_address(0) {
+InstructionCache::InstructionCache() : m_cache{0}, m_cacheOffset(INSTRUCTION_CACHE_SIZE), m_cacheSize(INSTRUCTION_CACHE_SIZE), m_mmu(nullptr), m_base_address(0) {
 
 }
 
@@ -60,8 +61,8 @@ void InstructionCache::ReadStream(uint8_t* data, size_t size) const {
 }
 
 void InstructionCache::WriteStream8(uint8_t data) {
-    if (m_cacheOffset >= INSTRUCTION_CACHE_SIZE)
-        CacheMiss();
+    if (m_cacheOffset >= m_cacheSize)
+        CacheMiss(m_cacheSize);
 
     m_cache[m_cacheOffset++] = data;
 }
@@ -69,11 +70,11 @@ void InstructionCache::WriteStream8(uint8_t data) {
 // ReadStream8 is in the header file as it is a very hot path
 
 void InstructionCache::WriteStream16(uint16_t data) {
-    if (m_cacheOffset + 2 > INSTRUCTION_CACHE_SIZE) {
-        if (m_cacheOffset >= INSTRUCTION_CACHE_SIZE)
-            CacheMiss();
+    if (m_cacheOffset + 2 > m_cacheSize) {
+        if (m_cacheOffset >= m_cacheSize)
+            CacheMiss(m_cacheSize, 2);
         else
-            CacheMiss(m_cacheOffset);
+            CacheMiss(m_cacheOffset, 2);
     }
 
     *reinterpret_cast<uint16_t*>(&m_cache[m_cacheOffset]) = data;
@@ -81,11 +82,11 @@ void InstructionCache::WriteStream16(uint16_t data) {
 }
 
 void InstructionCache::ReadStream16(uint16_t& data) {
-    if (m_cacheOffset + 2 > INSTRUCTION_CACHE_SIZE) {
-        if (m_cacheOffset >= INSTRUCTION_CACHE_SIZE)
-            CacheMiss();
+    if (m_cacheOffset + 2 > m_cacheSize) {
+        if (m_cacheOffset >= m_cacheSize)
+            CacheMiss(m_cacheSize, 2);
         else
-            CacheMiss(m_cacheOffset);
+            CacheMiss(m_cacheOffset, 2);
     }
 
     data = *reinterpret_cast<uint16_t*>(&m_cache[m_cacheOffset]);
@@ -93,11 +94,11 @@ void InstructionCache::ReadStream16(uint16_t& data) {
 }
 
 void InstructionCache::WriteStream32(uint32_t data) {
-    if (m_cacheOffset + 4 > INSTRUCTION_CACHE_SIZE) {
-        if (m_cacheOffset >= INSTRUCTION_CACHE_SIZE)
-            CacheMiss();
+    if (m_cacheOffset + 4 > m_cacheSize) {
+        if (m_cacheOffset >= m_cacheSize)
+            CacheMiss(m_cacheSize, 4);
         else
-            CacheMiss(m_cacheOffset);
+            CacheMiss(m_cacheOffset, 4);
     }
 
     *reinterpret_cast<uint32_t*>(&m_cache[m_cacheOffset]) = data;
@@ -105,11 +106,11 @@ void InstructionCache::WriteStream32(uint32_t data) {
 }
 
 void InstructionCache::ReadStream32(uint32_t& data) {
-    if (m_cacheOffset + 4 > INSTRUCTION_CACHE_SIZE) {
-        if (m_cacheOffset >= INSTRUCTION_CACHE_SIZE)
-            CacheMiss();
+    if (m_cacheOffset + 4 > m_cacheSize) {
+        if (m_cacheOffset >= m_cacheSize)
+            CacheMiss(m_cacheSize, 4);
         else
-            CacheMiss(m_cacheOffset);
+            CacheMiss(m_cacheOffset, 4);
     }
 
     data = *reinterpret_cast<uint32_t*>(&m_cache[m_cacheOffset]);
@@ -117,11 +118,11 @@ void InstructionCache::ReadStream32(uint32_t& data) {
 }
 
 void InstructionCache::WriteStream64(uint64_t data) {
-    if (m_cacheOffset + 8 > INSTRUCTION_CACHE_SIZE) {
-        if (m_cacheOffset >= INSTRUCTION_CACHE_SIZE)
-            CacheMiss();
+    if (m_cacheOffset + 8 > m_cacheSize) {
+        if (m_cacheOffset >= m_cacheSize)
+            CacheMiss(m_cacheSize, 8);
         else
-            CacheMiss(m_cacheOffset);
+            CacheMiss(m_cacheOffset, 8);
     }
 
     *reinterpret_cast<uint64_t*>(&m_cache[m_cacheOffset]) = data;
@@ -129,11 +130,11 @@ void InstructionCache::WriteStream64(uint64_t data) {
 }
 
 void InstructionCache::ReadStream64(uint64_t& data) {
-    if (m_cacheOffset + 8 > INSTRUCTION_CACHE_SIZE) {
-        if (m_cacheOffset >= INSTRUCTION_CACHE_SIZE)
-            CacheMiss();
+    if (m_cacheOffset + 8 > m_cacheSize) {
+        if (m_cacheOffset >= m_cacheSize)
+            CacheMiss(m_cacheSize, 8);
         else
-            CacheMiss(m_cacheOffset);
+            CacheMiss(m_cacheOffset, 8);
     }
 
     data = *reinterpret_cast<uint64_t*>(&m_cache[m_cacheOffset]);
@@ -141,7 +142,7 @@ void InstructionCache::ReadStream64(uint64_t& data) {
 }
 
 void InstructionCache::SeekStream(uint64_t offset) {
-    if (offset >= INSTRUCTION_CACHE_SIZE)
+    if (offset >= m_cacheSize)
         CacheMiss(offset - m_cacheOffset);
     else
         m_cacheOffset = static_cast<uint64_t>(offset);
@@ -160,14 +161,14 @@ void InstructionCache::SetBaseAddress(uint64_t base_address) {
 }
 
 void InstructionCache::MaybeSetBaseAddress(uint64_t base_address) {
-    if (base_address < m_base_address || base_address > m_base_address + INSTRUCTION_CACHE_SIZE) {
+    if (base_address < m_base_address || base_address > m_base_address + m_cacheSize) {
         m_base_address = base_address;
         CacheMiss(0);
     }
     else {
         m_cacheOffset = base_address - m_base_address;
-        if (m_cacheOffset >= INSTRUCTION_CACHE_SIZE)
-            CacheMiss();
+        if (m_cacheOffset >= m_cacheSize)
+            CacheMiss(m_cacheSize);
     }
 }
 
@@ -179,8 +180,10 @@ uint64_t InstructionCache::GetOffset() const {
     return m_base_address + m_cacheOffset;
 }
 
-void InstructionCache::CacheMiss(uint64_t offset) {
+void InstructionCache::CacheMiss(uint64_t offset, uint64_t required) {
     m_cacheOffset = 0;
     m_base_address += offset;
-    m_mmu->ReadBuffer(m_base_address, m_cache, INSTRUCTION_CACHE_SIZE);
+    uint64_t boundary = INSTRUCTION_CACHE_FETCH_BOUNDARY - (m_base_address & (INSTRUCTION_CACHE_FETCH_BOUNDARY - 1));
+    m_cacheSize = std::clamp<uint64_t>(boundary, required, INSTRUCTION_CACHE_SIZE);
+    m_mmu->ReadBuffer(m_base_address, m_cache, m_cacheSize);
 }
@@ -25,6 +25,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <Common/DataStructures/Buffer.hpp>
 
 #define INSTRUCTION_CACHE_SIZE 256 // Size of the instruction cache in bytes
+#define INSTRUCTION_CACHE_FETCH_BOUNDARY 4096 // Fills stop here unless an access needs more, so a page is not fetched before it is executed
 
 class InstructionCache : public StreamBuffer {
 public:
@@ -44,8 +45,8 @@ public:
 
     void WriteStream8(uint8_t data) override;
     [[gnu::always_inline]] inline void ReadStream8(uint8_t& data) override __attribute__((always_inline)) {
-        if (__builtin_expect(m_cacheOffset >= INSTRUCTION_CACHE_SIZE, 0))
-            CacheMiss();
+        if (__builtin_expect(m_cacheOffset >= m_cacheSize, 0))
+            CacheMiss(m_cacheSize);
 
         data = m_cache[m_cacheOffset++];
     }
@@ -69,11 +70,13 @@ public:
     [[nodiscard]] uint64_t GetOffset() const override;
 
 private:
-    [[gnu::cold]] void CacheMiss(uint64_t offset = INSTRUCTION_CACHE_SIZE);
+    // Moves the base address forward by offset and fills the cache, with at least required bytes
+    [[gnu::cold]] void CacheMiss(uint64_t offset, uint64_t required = 1);
 
 private:
     uint8_t m_cache[INSTRUCTION_CACHE_SIZE]; // Instruction cache
     uint64_t m_cacheOffset; // Current offset in the instruction cache
+    uint64_t m_cacheSize; // Number of valid bytes in the instruction cache
     MMU* m_mmu; // MMU instance
     uint64_t m_base_address; // Base address of the cache
 };
@@ -30,6 +30,9 @@ public:
 
     virtual bool isBIOS() override { return true; }
 
+    // the ROM image is not ordinary RAM, so it is never split or merged
+    virtual bool canSplit() override { return false; }
+
 private:
     uint64_t m_real_size;
 };
@@ -0,0 +1,149 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "Epoch.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <Common/Spinlock.hpp>
+
+#include "Emulator.hpp"
+
+// Most threads that can be reading guest memory at once
+#define EPOCH_MAX_READERS 64
+
+namespace Epoch {
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch; // the epoch the reader came in during, 0 while it isn't reading
+        std::atomic<bool> used;
+    };
+
+    struct RetiredObject {
+        void* object;
+        void (*free)(void* object);
+        uint64_t epoch;
+    };
+
+    struct ThreadState {
+        ReaderSlot* slot = nullptr;
+        uint64_t readDepth = 0;
+        uint64_t exclusiveDepth = 0;
+
+        ~ThreadState() {
+            if (slot == nullptr)
+                return;
+            slot->epoch.store(0);
+            slot->used.store(false);
+        }
+    };
+
+    ReaderSlot g_slots[EPOCH_MAX_READERS];
+    std::atomic<uint64_t> g_epoch = 1;
+    std::atomic<bool> g_exclusive = false;
+
+    std::vector<RetiredObject> g_retired;
+    spinlock_new(g_retiredLock);
+
+    thread_local ThreadState t_state;
+
+    ReaderSlot* ClaimSlot() {
+        for (ReaderSlot& slot : g_slots) {
+            bool used = false;
+            if (slot.used.compare_exchange_strong(used, true))
+                return &slot;
+        }
+        Emulator::Crash("Too many threads reading guest memory");
+    }
+
+    ReadGuard::ReadGuard() {
+        // the thread changing the map doesn't need to keep it from itself
+        if (t_state.readDepth++ > 0 || t_state.exclusiveDepth > 0)
+            return;
+        if (t_state.slot == nullptr)
+            t_state.slot = ClaimSlot();
+        while (true) {
+            t_state.slot->epoch.store(g_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+            // pairs with the fences in ExclusiveGuard and Advance, so either they see this reader or it sees what they published
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!g_exclusive.load(std::memory_order_relaxed)) [[likely]]
+                return;
+            t_state.slot->epoch.store(0, std::memory_order_release);
+            g_exclusive.wait(true);
+        }
+    }
+
+    ReadGuard::~ReadGuard() {
+        if (--t_state.readDepth > 0 || t_state.slot == nullptr)
+            return;
+        t_state.slot->epoch.store(0, std::memory_order_release);
+    }
+
+    ExclusiveGuard::ExclusiveGuard() {
+        if (t_state.exclusiveDepth++ > 0)
+            return;
+        g_exclusive.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // readers only ever hold it for one transfer or frame, so they are waited out rather than put to sleep on
+        for (ReaderSlot& slot : g_slots) {
+            if (&slot == t_state.slot)
+                continue;
+            while (slot.epoch.load(std::memory_order_acquire) != 0)
+                std::this_thread::yield();
+        }
+    }
+
+    ExclusiveGuard::~ExclusiveGuard() {
+        if (--t_state.exclusiveDepth > 0)
+            return;
+        g_exclusive.store(false, std::memory_order_release);
+        g_exclusive.notify_all();
+    }
+
+    void Retire(void* object, void (*free)(void* object)) {
+        spinlock_acquire(&g_retiredLock);
+        g_retired.push_back({object, free, g_epoch.load(std::memory_order_relaxed)});
+        spinlock_release(&g_retiredLock);
+    }
+
+    void Advance() {
+        g_epoch.fetch_add(1, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // anything retired before the oldest reader came in can't be seen by any of them
+        uint64_t oldest = UINT64_MAX;
+        for (ReaderSlot& slot : g_slots) {
+            if (uint64_t epoch = slot.epoch.load(std::memory_order_acquire); epoch != 0)
+                oldest = std::min(oldest, epoch);
+        }
+
+        std::vector<RetiredObject> expired;
+        spinlock_acquire(&g_retiredLock);
+        auto split = std::partition(g_retired.begin(), g_retired.end(), [oldest](const RetiredObject& retired) { return retired.epoch >= oldest; });
+        expired.assign(split, g_retired.end());
+        g_retired.erase(split, g_retired.end());
+        spinlock_release(&g_retiredLock);
+
+        for (RetiredObject& retired : expired)
+            retired.free(retired.object);
+    }
+
+}
@@ -0,0 +1,56 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _EPOCH_HPP
+#define _EPOCH_HPP
+
+#include <cstdint>
+
+// Epoch based reclamation for the physical memory map. The execution thread is the only one that changes the map, and does so by
+// publishing a new version of it. Whatever the old version used is retired rather than freed, until no reader that could have seen it is left.
+namespace Epoch {
+
+    // Marks the calling thread as reading guest memory until it goes out of scope. Needed on every thread other than the execution thread.
+    class ReadGuard {
+       public:
+        ReadGuard();
+        ~ReadGuard();
+    };
+
+    // Waits for current readers to leave, and keeps new ones out until it goes out of scope.
+    // For changes that move host memory out from under a published region.
+    class ExclusiveGuard {
+       public:
+        ExclusiveGuard();
+        ~ExclusiveGuard();
+    };
+
+    // Calls free on object once no reader can still be using it
+    void Retire(void* object, void (*free)(void* object));
+
+    template <typename T>
+    void Retire(T* object) {
+        Retire(object, [](void* item) { delete static_cast<T*>(item); });
+    }
+
+    // Starts a new epoch once a new version has been published, freeing whatever no reader can see anymore
+    void Advance();
+
+}
+
+#endif /* _EPOCH_HPP */
@@ -0,0 +1,128 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "MMIOMemoryRegion.hpp"
+
+#include <bit>
+#include <cstring>
+
+#include <Common/Util.hpp>
+
+MMIOMemoryRegion::MMIOMemoryRegion(uint64_t start, uint64_t end, uint8_t registerSize)
+    : MemoryRegion(start, end), m_registerShift(std::countr_zero(registerSize)) {
+}
+
+MMIOMemoryRegion::~MMIOMemoryRegion() {
+}
+
+void MMIOMemoryRegion::read(uint64_t address, uint8_t* buffer, size_t size) {
+    uint64_t registerSize = 1ULL << m_registerShift;
+    uint64_t offset = address - getStart();
+    while (size > 0) {
+        uint64_t index = offset >> m_registerShift;
+        uint8_t byte = offset & (registerSize - 1);
+        uint8_t count = MIN(registerSize - byte, size);
+        uint64_t data;
+        if (AlignsAccesses(index))
+            data = ReadRegister(index, std::bit_ceil(count));
+        else if (byte == 0 && std::has_single_bit(count))
+            data = ReadRegister(index, count);
+        else
+            data = ReadRegister(index, registerSize) >> (byte * 8);
+        memcpy(buffer, &data, count);
+        offset += count;
+        buffer += count;
+        size -= count;
+    }
+}
+
+void MMIOMemoryRegion::write(uint64_t address, const uint8_t* buffer, size_t size) {
+    uint64_t registerSize = 1ULL << m_registerShift;
+    uint64_t offset = address - getStart();
+    while (size > 0) {
+        uint64_t index = offset >> m_registerShift;
+        uint8_t byte = offset & (registerSize - 1);
+        uint8_t count = MIN(registerSize - byte, size);
+        uint64_t data = 0;
+        memcpy(&data, buffer, count);
+        if (AlignsAccesses(index))
+            WriteRegister(index, data, std::bit_ceil(count));
+        else if (byte == 0 && std::has_single_bit(count))
+            WriteRegister(index, data, count);
+        else {
+            // only part of the register is covered, so merge it with the rest
+            uint64_t mask = ((1ULL << (count * 8)) - 1) << (byte * 8);
+            uint64_t current = ReadRegister(index, registerSize);
+            WriteRegister(index, (current & ~mask) | ((data << (byte * 8)) & mask), registerSize);
+        }
+        offset += count;
+        buffer += count;
+        size -= count;
+    }
+}
+
+template <typename T>
+void MMIOMemoryRegion::ReadWidth(uint64_t address, T* buffer) {
+    uint64_t offset = address - getStart();
+    uint64_t index = offset >> m_registerShift;
+    if (sizeof(T) <= (1ULL << m_registerShift) && ((offset & ((1ULL << m_registerShift) - 1)) == 0 || AlignsAccesses(index)))
+        *buffer = static_cast<T>(ReadRegister(index, sizeof(T)));
+    else
+        read(address, reinterpret_cast<uint8_t*>(buffer), sizeof(T));
+}
+
+template <typename T>
+void MMIOMemoryRegion::WriteWidth(uint64_t address, const T* buffer) {
+    uint64_t offset = address - getStart();
+    uint64_t index = offset >> m_registerShift;
+    if (sizeof(T) <= (1ULL << m_registerShift) && ((offset & ((1ULL << m_registerShift) - 1)) == 0 || AlignsAccesses(index)))
+        WriteRegister(index, *buffer, sizeof(T));
+    else
+        write(address, reinterpret_cast<const uint8_t*>(buffer), sizeof(T));
+}
+
+void MMIOMemoryRegion::read8(uint64_t address, uint8_t* buffer) {
+    ReadWidth(address, buffer);
+}
+
+void MMIOMemoryRegion::read16(uint64_t address, uint16_t* buffer) {
+    ReadWidth(address, buffer);
+}
+
+void MMIOMemoryRegion::read32(uint64_t address, uint32_t* buffer) {
+    ReadWidth(address, buffer);
+}
+
+void MMIOMemoryRegion::read64(uint64_t address, uint64_t* buffer) {
+    ReadWidth(address, buffer);
+}
+
+void MMIOMemoryRegion::write8(uint64_t address, const uint8_t* buffer) {
+    WriteWidth(address, buffer);
+}
+
+void MMIOMemoryRegion::write16(uint64_t address, const uint16_t* buffer) {
+    WriteWidth(address, buffer);
+}
+
+void MMIOMemoryRegion::write32(uint64_t address, const uint32_t* buffer) {
+    WriteWidth(address, buffer);
+}
+
+void MMIOMemoryRegion::write64(uint64_t address, const uint64_t* buffer) {
+    WriteWidth(address, buffer);
+}
@@ -0,0 +1,67 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MMIO_MEMORY_REGION_HPP
+#define _MMIO_MEMORY_REGION_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "MemoryRegion.hpp"
+
+// Region made up of registers of one power of 2 size, packed from the start of the region.
+// An access at the start of a register that is no wider than it goes to ReadRegister/WriteRegister in one call.
+// Anything else, including buffer accesses, is split at register boundaries so each register is accessed once.
+class MMIOMemoryRegion : public MemoryRegion {
+   public:
+    MMIOMemoryRegion(uint64_t start, uint64_t end, uint8_t registerSize = 8);
+    ~MMIOMemoryRegion() override;
+
+    virtual void read(uint64_t address, uint8_t* buffer, size_t size) override;
+    virtual void write(uint64_t address, const uint8_t* buffer, size_t size) override;
+
+    virtual void read8(uint64_t address, uint8_t* buffer) override;
+    virtual void read16(uint64_t address, uint16_t* buffer) override;
+    virtual void read32(uint64_t address, uint32_t* buffer) override;
+    virtual void read64(uint64_t address, uint64_t* buffer) override;
+    virtual void write8(uint64_t address, const uint8_t* buffer) override;
+    virtual void write16(uint64_t address, const uint16_t* buffer) override;
+    virtual void write32(uint64_t address, const uint32_t* buffer) override;
+    virtual void write64(uint64_t address, const uint64_t* buffer) override;
+
+   protected:
+    // width is 1, 2, 4 or 8 bytes, and never more than the register size. Only the low width bytes of the result are used.
+    virtual uint64_t ReadRegister(uint64_t index, uint8_t width) = 0;
+    virtual void WriteRegister(uint64_t index, uint64_t data, uint8_t width) = 0;
+
+    // Whether accesses inside the register act as if they were at its start, instead of reading or merging just the bytes covered
+    virtual bool AlignsAccesses(uint64_t index) const {
+        (void)index;
+        return false;
+    }
+
+   private:
+    template <typename T>
+    void ReadWidth(uint64_t address, T* buffer);
+    template <typename T>
+    void WriteWidth(uint64_t address, const T* buffer);
+
+   private:
+    uint8_t m_registerShift;
+};
+
+#endif /* _MMIO_MEMORY_REGION_HPP */
@@ -17,252 +17,159 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "MMU.hpp"
 
+#include <optional>
+#include <vector>
+
 #include <Common/Util.hpp>
 #include <Exceptions.hpp>
+#include <OSSpecific/Memory.hpp>
 
 #include "Emulator.hpp"
+#include "Epoch.hpp"
 #include "MemoryRegion.hpp"
 #include "StandardMemoryRegion.hpp"
 
-MMU::MMU() {
+// Regions in one page that RefreshPage can collect without going to the heap
+#define MMU_MIXED_PAGE_BUFFER_SIZE 8
+
+MMU::MMU()
+    : m_mapBatchDepth(0), m_mapChanged(false), m_layoutGeneration(0), m_sharedRAM(nullptr) {
 }
 
 MMU::~MMU() {
 }
 
+MMU::MapBatch::MapBatch(MMU* mmu) : m_mmu(mmu) {
+    m_mmu->m_mapBatchDepth++;
+}
+
+MMU::MapBatch::~MapBatch() {
+    if (--m_mmu->m_mapBatchDepth == 0)
+        m_mmu->PublishMap();
+}
+
 void MMU::ReadBuffer(uint64_t address, uint8_t* data, size_t size) {
-    MemoryRegion* startingRegion = nullptr;
-    uint64_t regionIndex = 0;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address)) {
-            startingRegion = region;
-            regionIndex++;
-            break;
-        }
-    }
-    if (startingRegion == nullptr) {
-        // no region found
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
-    }
-    size_t remainingSize = size;
-    uint64_t currentAddress = address;
-    while (remainingSize > 0) {
-        size_t currentSize = startingRegion->getEnd() - currentAddress;
-        if (currentSize > remainingSize)
-            currentSize = remainingSize;
-        startingRegion->read(currentAddress, data, currentSize);
-        remainingSize -= currentSize;
-        if (remainingSize == 0)
-            break;
-        currentAddress += currentSize;
-        data = reinterpret_cast<uint8_t*>(reinterpret_cast<uint64_t>(data) + currentSize * sizeof(uint8_t));
-        startingRegion = nullptr;
-        for (auto iterator = m_regions.at(regionIndex); iterator != m_regions.end(); ++iterator) {
-            MemoryRegion* region = *iterator;
-            if (region->isInside(currentAddress)) {
-                startingRegion = region;
-                regionIndex++;
-                break;
-            }
-        }
-        if (startingRegion == nullptr) {
+    while (size > 0) {
+        MemoryRegion* region = FindRegion(address);
+        if (region == nullptr) {
             // no region found
-            g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, currentAddress);
+            g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
         }
+        size_t currentSize = MIN(region->getEnd() - address, size);
+        region->read(address, data, currentSize);
+        address += currentSize;
+        data += currentSize;
+        size -= currentSize;
     }
 }
 
 void MMU::WriteBuffer(uint64_t address, const uint8_t* data, size_t size) {
-    MemoryRegion* startingRegion = nullptr;
-    uint64_t regionIndex = 0;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address)) {
-            startingRegion = region;
-            regionIndex++;
-            break;
-        }
-    }
-    if (startingRegion == nullptr) {
-        // no region found
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
-    }
-    size_t remainingSize = size;
-    uint64_t currentAddress = address;
-    while (remainingSize > 0) {
-        size_t currentSize = startingRegion->getEnd() - currentAddress;
-        if (currentSize > remainingSize)
-            currentSize = remainingSize;
-        startingRegion->write(currentAddress, data, currentSize);
-        remainingSize -= currentSize;
-        if (remainingSize == 0)
-            break;
-        currentAddress += currentSize;
-        data = reinterpret_cast<uint8_t*>(reinterpret_cast<uint64_t>(data) + currentSize * sizeof(uint8_t));
-        startingRegion = nullptr;
-        for (auto iterator = m_regions.at(regionIndex); iterator != m_regions.end(); ++iterator) {
-            MemoryRegion* region = *iterator;
-            if (region->isInside(currentAddress)) {
-                startingRegion = region;
-                regionIndex++;
-                break;
-            }
-        }
-        if (startingRegion == nullptr) {
+    while (size > 0) {
+        MemoryRegion* region = FindRegion(address);
+        if (region == nullptr) {
             // no region found
-            g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, currentAddress);
+            g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
         }
+        size_t currentSize = MIN(region->getEnd() - address, size);
+        region->write(address, data, currentSize);
+        address += currentSize;
+        data += currentSize;
+        size -= currentSize;
     }
 }
 
 uint8_t MMU::read8(uint64_t address) {
-    uint8_t data = 0;
-    bool found = false;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address)) {
-            region->read8(address, &data);
-            found = true;
-            break;
-        }
-    }
-    if (!found)
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
-    return data;
+    return ReadPhysical<uint8_t>(address);
 }
 
 uint16_t MMU::read16(uint64_t address) {
-    uint16_t data = 0;
-    bool found = false;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address, 2)) {
-            region->read16(address, &data);
-            found = true;
-            break;
-        }
-    }
-    if (!found)
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
-    return data;
+    return ReadPhysical<uint16_t>(address);
 }
 
 uint32_t MMU::read32(uint64_t address) {
-    uint32_t data = 0;
-    bool found = false;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address, 4)) {
-            region->read32(address, &data);
-            found = true;
-            break;
-        }
-    }
-    if (!found)
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
-    return data;
+    return ReadPhysical<uint32_t>(address);
 }
 
 uint64_t MMU::read64(uint64_t address) {
-    uint64_t data = 0;
-    bool found = false;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address, 8)) {
-            region->read64(address, &data);
-            found = true;
-            break;
-        }
-    }
-    if (!found)
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
-    return data;
+    return ReadPhysical<uint64_t>(address);
 }
 
 void MMU::write8(uint64_t address, uint8_t data) {
-    bool found = false;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address)) {
-            region->write8(address, &data);
-            found = true;
-            break;
-        }
-    }
-    if (!found)
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
+    WritePhysical<uint8_t>(address, data);
 }
 
 void MMU::write16(uint64_t address, uint16_t data) {
-    bool found = false;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address, 2)) {
-            region->write16(address, &data);
-            found = true;
-            break;
-        }
-    }
-    if (!found)
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
+    WritePhysical<uint16_t>(address, data);
 }
 
 void MMU::write32(uint64_t address, uint32_t data) {
-    bool found = false;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address, 4)) {
-            region->write32(address, &data);
-            found = true;
-            break;
-        }
-    }
-    if (!found)
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);    
+    WritePhysical<uint32_t>(address, data);
 }
 
 void MMU::write64(uint64_t address, uint64_t data) {
-    bool found = false;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address, 8)) {
-            region->write64(address, &data);
-            found = true;
-            break;
-        }
-    }
-    if (!found)
+    WritePhysical<uint64_t>(address, data);
+}
+
+uint64_t MMU::ReadRegion(MemoryRegion* region, uint64_t address, uint8_t size) {
+    if (region == nullptr || !region->isInside(address, size))
         g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
+    switch (size) {
+    case 1: {
+        uint8_t data = 0;
+        region->read8(address, &data);
+        return data;
+    }
+    case 2: {
+        uint16_t data = 0;
+        region->read16(address, &data);
+        return data;
+    }
+    case 4: {
+        uint32_t data = 0;
+        region->read32(address, &data);
+        return data;
+    }
+    default: {
+        uint64_t data = 0;
+        region->read64(address, &data);
+        return data;
+    }
+    }
 }
 
-bool MMU::ValidateRead(uint64_t address, size_t size) {
-    MemoryRegion* startingRegion = nullptr;
-    uint64_t regionIndex = 0;
-    for (MemoryRegion* region : m_regions) {
-        if (region->isInside(address)) {
-            startingRegion = region;
-            regionIndex++;
-            break;
-        }
+void MMU::WriteRegion(MemoryRegion* region, uint64_t address, uint64_t data, uint8_t size) {
+    if (region == nullptr || !region->isInside(address, size))
+        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
+    switch (size) {
+    case 1: {
+        uint8_t value = data;
+        region->write8(address, &value);
+        break;
     }
-    if (startingRegion == nullptr) {
-        // no region found
-        return false;
+    case 2: {
+        uint16_t value = data;
+        region->write16(address, &value);
+        break;
     }
-    size_t remainingSize = size;
-    uint64_t currentAddress = address;
-    while (remainingSize > 0) {
-        size_t currentSize = startingRegion->getEnd() - currentAddress;
-        if (currentSize > remainingSize)
-            currentSize = remainingSize;
-        remainingSize -= currentSize;
-        if (remainingSize == 0)
-            break;
-        currentAddress += currentSize;
-        startingRegion = nullptr;
-        for (auto iterator = m_regions.at(regionIndex); iterator != m_regions.end(); ++iterator) {
-            MemoryRegion* region = *iterator;
-            if (region->isInside(currentAddress)) {
-                startingRegion = region;
-                regionIndex++;
-                break;
-            }
-        }
-        if (startingRegion == nullptr) {
-            // no region found
+    case 4: {
+        uint32_t value = data;
+        region->write32(address, &value);
+        break;
+    }
+    default:
+        region->write64(address, &data);
+        break;
+    }
+}
+
+bool MMU::ValidateRead(uint64_t address, size_t size) {
+    while (size > 0) {
+        MemoryRegion* region = FindRegion(address);
+        if (region == nullptr)
             return false;
-        }
+        size_t currentSize = MIN(region->getEnd() - address, size);
+        address += currentSize;
+        size -= currentSize;
     }
     return true;
 }
@@ -277,132 +184,270 @@ bool MMU::ValidateExecute(uint64_t address, size_t size) {
 }
 
 void MMU::AddMemoryRegion(MemoryRegion* region) {
-    // find the correct place to insert the region
-    if (m_regions.getCount() == 0) {
-        m_regions.insert(region);
+    m_layoutGeneration++;
+    m_regions.insert(region->getStart(), region);
+    MapRange(region->getStart(), region->getEnd(), region);
+}
+
+void MMU::RemoveMemoryRegion(MemoryRegion* region) {
+    if (m_regions.find(region->getStart()) != region)
+        return;
+    m_layoutGeneration++;
+    m_regions.remove(region->getStart());
+    MapRange(region->getStart(), region->getEnd(), nullptr);
+}
+
+void MMU::AddRAM(uint64_t start, uint64_t end) {
+    MemoryRegion* previous = start > 0 ? m_regions.findOrLower(start - 1) : nullptr;
+    MemoryRegion* next = m_regions.find(end);
+    if (previous == nullptr || previous->getEnd() != start || !previous->canSplit()) {
+        // nothing to grow into, so it gets its own region. Merging into next would mean copying all of next.
+        AddMemoryRegion(new StandardMemoryRegion(start, end));
+        MapSharedRAM(start, end);
         return;
     }
-    for (auto iterator = m_regions.begin(); iterator != m_regions.end(); ++iterator) {
-        MemoryRegion* currentRegion = *iterator;
-        if (region->getStart() < currentRegion->getStart()) {
-            m_regions.insertAfter(iterator, region);
-            return;
-        }
+
+    // grow the region below, which leaves its contents where they are
+    m_layoutGeneration++;
+    StandardMemoryRegion* ram = static_cast<StandardMemoryRegion*>(previous);
+    bool merge = next != nullptr && next->canSplit();
+
+    // moving RAM in host memory would pull it out from under readers on other threads
+    std::optional<Epoch::ExclusiveGuard> exclusive;
+    if (merge || ram->mayMove(end))
+        exclusive.emplace();
+
+    ram->resize(end);
+    MapRange(start, end, ram);
+    MapSharedRAM(start, end);
+
+    // and if that closed a gap, take in the region above as well
+    if (merge) {
+        m_regions.remove(next->getStart());
+        ram->merge(static_cast<StandardMemoryRegion*>(next));
+        MapRange(next->getStart(), next->getEnd(), ram);
+        Epoch::Retire(next);
     }
+
+    // readers can't be let back in until the map no longer leads them to memory that moved
+    if (exclusive)
+        PublishMap();
 }
 
-void MMU::RemoveMemoryRegion(MemoryRegion* region) {
-    m_regions.remove(region);
+bool MMU::DiscardRAM(uint64_t start, uint64_t end) {
+    // check all of it first, so a bad range leaves everything alone
+    for (uint64_t address = start; address < end;) {
+        MemoryRegion* region = m_regions.findOrLower(address);
+        if (region == nullptr || region->getEnd() <= address || !region->canSplit())
+            return false;
+        address = region->getEnd();
+    }
+
+    for (uint64_t address = start; address < end;) {
+        StandardMemoryRegion* ram = static_cast<StandardMemoryRegion*>(m_regions.findOrLower(address));
+        uint64_t rangeEnd = MIN(ram->getEnd(), end);
+        ram->discard(address, rangeEnd - address);
+        address = rangeEnd;
+    }
+    return true;
+}
+
+bool MMU::MapFileIntoRAM(uint64_t start, uint64_t end, FileHandle_t handle, size_t offset, bool shared) {
+    MemoryRegion* region = m_regions.findOrLower(start);
+    if (region == nullptr || region->getEnd() < end || !region->canSplit())
+        return false;
+    static_cast<StandardMemoryRegion*>(region)->mapFile(start, end - start, handle, offset, shared);
+    return true;
+}
+
+void MMU::MapSharedRAM(uint64_t start, uint64_t end) {
+    if (m_sharedRAM == nullptr)
+        return;
+    m_sharedRAM->ForEachRange(start, end, [this](uint64_t from, uint64_t to, uint64_t offset) {
+        MapFileIntoRAM(from, to, m_sharedRAM->GetHandle(), offset, true);
+    });
+}
+
+MemoryRegion* MMU::NextRegion(MemoryRegion* region) const {
+    // regions never overlap, so the next one starts at or after the end of this one
+    return m_regions.findOrHigher(region == nullptr ? 0 : region->getEnd());
+}
+
+void MMU::MapRange(uint64_t start, uint64_t end, MemoryRegion* entry) {
+    uint64_t firstPage = ALIGN_UP_BASE2(start, PHYS_MAP_PAGE_SIZE) >> PHYS_MAP_PAGE_SHIFT;
+    uint64_t lastPage = ALIGN_DOWN_BASE2(end, PHYS_MAP_PAGE_SIZE) >> PHYS_MAP_PAGE_SHIFT;
+    if (firstPage < lastPage)
+        m_map.Set(firstPage, lastPage - firstPage, entry);
+    // pages the range only partly covers can be shared, so they depend on every region
+    if (start & (PHYS_MAP_PAGE_SIZE - 1))
+        RefreshPage(start >> PHYS_MAP_PAGE_SHIFT);
+    if (end & (PHYS_MAP_PAGE_SIZE - 1))
+        RefreshPage(end >> PHYS_MAP_PAGE_SHIFT);
+    m_mapChanged = true;
+    if (m_mapBatchDepth == 0)
+        PublishMap();
+}
+
+void MMU::RefreshPage(uint64_t page) {
+    uint64_t pageStart = page << PHYS_MAP_PAGE_SHIFT;
+    uint64_t pageEnd = pageStart + PHYS_MAP_PAGE_SIZE;
+    MemoryRegion* first = m_regions.findOrLower(pageStart);
+    if (first == nullptr || first->getEnd() <= pageStart)
+        first = m_regions.findOrHigher(pageStart);
+
+    // a page rarely holds more than a few regions, so only an unusually crowded one needs the heap
+    MemoryRegion* buffer[MMU_MIXED_PAGE_BUFFER_SIZE];
+    uint64_t count = 0;
+    for (MemoryRegion* region = first; region != nullptr && region->getStart() < pageEnd; region = NextRegion(region)) {
+        if (count < MMU_MIXED_PAGE_BUFFER_SIZE)
+            buffer[count] = region;
+        count++;
+    }
+
+    if (count == 0)
+        m_map.Set(page, 1, nullptr);
+    else if (count == 1 && first->getStart() <= pageStart && first->getEnd() >= pageEnd)
+        m_map.Set(page, 1, first);
+    else if (count <= MMU_MIXED_PAGE_BUFFER_SIZE)
+        m_map.SetMixed(page, buffer, count);
+    else {
+        std::vector<MemoryRegion*> regions;
+        for (MemoryRegion* region = first; region != nullptr && region->getStart() < pageEnd; region = NextRegion(region))
+            regions.push_back(region);
+        m_map.SetMixed(page, regions.data(), regions.size());
+    }
+}
+
+void MMU::PublishMap() {
+    if (!m_mapChanged)
+        return;
+    m_map.Publish();
+    m_mapChanged = false;
 }
 
 void MMU::DumpMemory(FILE* fp) const {
-    for (MemoryRegion* region = m_regions.get(0); region != nullptr; region = m_regions.getNext(region))
+    for (MemoryRegion* region = NextRegion(nullptr); region != nullptr; region = NextRegion(region))
         region->dump(fp);
 }
 
 void MMU::PrintRegions(void (*write)(void* data, const char* format, ...), void* data) const {
     write(data, "Physical Memory Regions:\n");
-    for (MemoryRegion* region = m_regions.get(0); region != nullptr; region = m_regions.getNext(region))
+    for (MemoryRegion* region = NextRegion(nullptr); region != nullptr; region = NextRegion(region))
         region->printData(write, data);
+
+    OSSpecific::COWMemoryStats stats = OSSpecific::GetCOWMemoryStats();
+    write(data, "Host memory: %lu KiB allocated, %lu KiB from huge page pool (%lu fallbacks), %lu KiB advised for huge pages, %lu KiB prefaulted, %lu KiB locked (%lu failures), %lu KiB given back\n",
+          stats.allocatedBytes / 1024, stats.hugeTLBBytes / 1024, stats.hugeTLBFallbacks, stats.advisedBytes / 1024, stats.prefaultedBytes / 1024, stats.lockedBytes / 1024, stats.lockFailures, stats.discardedBytes / 1024);
+    if (m_sharedRAM != nullptr)
+        write(data, "Shared RAM: %s, map at %s\n", m_sharedRAM->GetPath().c_str(), m_sharedRAM->GetMapPath().c_str());
 }
 
 bool MMU::RemoveRegionSegment(uint64_t start, uint64_t end, void** data_out) {
-    for (auto iterator = m_regions.begin(); iterator != m_regions.end(); ++iterator) {
-        if (MemoryRegion* region = *iterator; start >= region->getStart() && end > region->getStart() && region->getEnd() > start) {
-            if (!region->canSplit())
-                return false;
-            uint64_t regionStart = region->getStart();
-            uint64_t regionEnd = region->getEnd();
-
-            if (regionEnd < end) {
-                if (MemoryRegion* region2 = m_regions.getNext(iterator); region2 != nullptr) {
-                    if (region2->getStart() < end)
-                        return false;
-                }
-            }
-
-            RemoveMemoryRegion(region);
-            delete region;
-
-            // check if the region starts at start
-            if (regionStart < start) {
-                StandardMemoryRegion* newRegion = new StandardMemoryRegion(regionStart, start);
-                AddMemoryRegion(newRegion);
-            }
-
-            // check if the region ends at end
-            if (regionEnd > end) {
-                StandardMemoryRegion* newRegion = new StandardMemoryRegion(end, regionEnd);
-                AddMemoryRegion(newRegion);
-            }
-
-            RegionSegmentInfo* info = new RegionSegmentInfo();
-            info->start = start;
-            info->end = MIN(end, regionEnd);
-            *data_out = info;
-
-            return true;
-        }
+    MemoryRegion* region = m_regions.findOrLower(start);
+    if (region == nullptr || region->getEnd() <= start) {
+        // didn't find a region
+        *data_out = nullptr;
+        return true;
+    }
+    if (!region->canSplit())
+        return false;
+    uint64_t regionStart = region->getStart();
+    uint64_t regionEnd = region->getEnd();
+    if (regionEnd < end) {
+        if (MemoryRegion* region2 = NextRegion(region); region2 != nullptr && region2->getStart() < end)
+            return false;
+    }
+
+    // split the segment out, keeping the contents on either side of it
+    m_layoutGeneration++;
+    StandardMemoryRegion* ram = static_cast<StandardMemoryRegion*>(region);
+
+    // splitting moves the tail in host memory, so readers on other threads have to wait until the map says where it went
+    std::optional<Epoch::ExclusiveGuard> exclusive;
+    if (regionEnd > end || regionStart < start)
+        exclusive.emplace();
+
+    if (regionEnd > end) {
+        StandardMemoryRegion* tail = ram->split(end);
+        m_regions.insert(end, tail);
+        MapRange(end, regionEnd, tail);
     }
+    if (regionStart < start)
+        Epoch::Retire(ram->split(start));
+    else {
+        m_regions.remove(regionStart);
+        Epoch::Retire(ram);
+    }
+    MapRange(start, MIN(end, regionEnd), nullptr);
+    if (m_sharedRAM != nullptr)
+        m_sharedRAM->ExcludeRange(start, MIN(end, regionEnd));
+
+    // readers can't be let back in until the map says where the tail went
+    if (exclusive)
+        PublishMap();
+
+    RegionSegmentInfo* info = new RegionSegmentInfo();
+    info->start = start;
+    info->end = MIN(end, regionEnd);
+    *data_out = info;
 
-    // didn't find a region
-    *data_out = nullptr;
     return true;
 }
 
 bool MMU::ReaddRegionSegment(void* data_in) {
     if (data_in == nullptr)
         return true;
-    uint64_t start = static_cast<RegionSegmentInfo*>(data_in)->start;
-    uint64_t end = static_cast<RegionSegmentInfo*>(data_in)->end;
-    MemoryRegion* region = nullptr;
-    MemoryRegion* previousRegion = nullptr;
-    for (auto i_region : m_regions) {
-        previousRegion = region;
-        region = i_region;
-        if (previousRegion == nullptr)
-            continue;
-        if (start >= previousRegion->getEnd() && end <= region->getStart()) {
-            if (start == previousRegion->getEnd() && end == region->getStart()) {
-                uint64_t newStart = previousRegion->getStart();
-                uint64_t newEnd = region->getEnd();
-                RemoveMemoryRegion(previousRegion);
-                RemoveMemoryRegion(region);
-                StandardMemoryRegion* newRegion = new StandardMemoryRegion(newStart, newEnd);
-                AddMemoryRegion(newRegion);
-            } else if (start == previousRegion->getEnd()) {
-                uint64_t newStart = previousRegion->getStart();
-                RemoveMemoryRegion(previousRegion);
-                StandardMemoryRegion* newRegion = new StandardMemoryRegion(newStart, end);
-                AddMemoryRegion(newRegion);
-            } else if (end == region->getStart()) {
-                uint64_t newEnd = region->getEnd();
-                RemoveMemoryRegion(region);
-                StandardMemoryRegion* newRegion = new StandardMemoryRegion(start, newEnd);
-                AddMemoryRegion(newRegion);
-            } else {
-                StandardMemoryRegion* newRegion = new StandardMemoryRegion(start, end);
-                AddMemoryRegion(newRegion);
-            }
-            return true;
+    RegionSegmentInfo* info = static_cast<RegionSegmentInfo*>(data_in);
+    bool free = !HasRegion(info->start, info->end - info->start);
+    if (free) {
+        AddRAM(info->start, info->end);
+        // shared RAM still holds whatever was there before the segment was taken out
+        if (m_sharedRAM != nullptr) {
+            DiscardRAM(info->start, info->end);
+            m_sharedRAM->IncludeRange(info->start);
         }
     }
-    return false;
+    delete info;
+    return free;
 }
 
 bool MMU::HasRegion(uint64_t address, size_t size) {
-    for (MemoryRegion* region : m_regions) {
-        uint64_t start = region->getStart();
-        uint64_t end = region->getEnd();
-        // need all conditions where part of the range is inside the region
-        if (address >= start && address + size <= end)
-            return true;
-        if (address + size > start && address + size < end)
-            return true;
-        if (address < end && address > start)
-            return true;
-        if (start > address + size)
-            break;
+    // the last region starting before the end of the range is the only one that can reach into it
+    MemoryRegion* region = m_regions.findOrLower(address + size - 1);
+    return region != nullptr && region->getEnd() > address;
+}
+
+uint8_t* MMU::GetHostPointer(uint64_t address, size_t size) {
+    MemoryRegion* region = FindRegion(address);
+    return region == nullptr ? nullptr : region->getHostPointer(address, size);
+}
+
+bool MMU::IsHostMemory(uint64_t address, size_t size) const {
+    while (size > 0) {
+        MemoryRegion* region = FindRegion(address);
+        if (region == nullptr || region->getHostPointer(address) == nullptr)
+            return false;
+        size_t currentSize = MIN(region->getEnd() - address, size);
+        address += currentSize;
+        size -= currentSize;
     }
-    return false;
+    return true;
+}
+
+bool MMU::ReadHostMemory(uint64_t address, uint8_t* data, size_t size) const {
+    // checked first so nothing is copied from a range that turns out not to be usable
+    if (!IsHostMemory(address, size))
+        return false;
+    while (size > 0) {
+        MemoryRegion* region = FindRegion(address);
+        uint8_t* host = region == nullptr ? nullptr : region->getHostPointer(address);
+        if (host == nullptr)
+            return false; // the map changed since the check
+        size_t currentSize = MIN(region->getEnd() - address, size);
+        memcpy(data, host, currentSize);
+        address += currentSize;
+        data += currentSize;
+        size -= currentSize;
+    }
+    return true;
 }
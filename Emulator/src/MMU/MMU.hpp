@@ -20,10 +20,15 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
-#include <Common/DataStructures/LinkedList.hpp>
+#include <Common/DataStructures/AVLTree.hpp>
+
+#include <OSSpecific/File.hpp>
 
 #include "MemoryRegion.hpp"
+#include "PhysicalMemoryMap.hpp"
+#include "SharedRAM.hpp"
 
 class MMU {
    public:
@@ -50,6 +55,30 @@ class MMU {
     virtual void AddMemoryRegion(MemoryRegion* region);
     virtual void RemoveMemoryRegion(MemoryRegion* region);
 
+    // Adds zeroed RAM from start to end, growing an adjacent RAM region instead of adding a new one where possible
+    virtual void AddRAM(uint64_t start, uint64_t end);
+
+    // Gives the host pages of the RAM from start to end back, which read as zero afterwards. Fails without changing anything if any of it isn't RAM.
+    virtual bool DiscardRAM(uint64_t start, uint64_t end);
+
+    // Fills the RAM from start to end, which has to be in one region, with a private copy-on-write mapping of the file from offset.
+    // With shared set, writes go to the file instead.
+    virtual bool MapFileIntoRAM(uint64_t start, uint64_t end, FileHandle_t handle, size_t offset, bool shared = false);
+
+    // RAM added from now on is backed by the parts of shared that cover it
+    void SetSharedRAM(SharedRAM* shared) { m_sharedRAM = shared; }
+
+    // Holds back publishing changes to the region map until it goes out of scope, so a command that makes several only publishes once.
+    // Until then other threads can still find regions that have been removed, but never memory that has moved.
+    class MapBatch {
+       public:
+        explicit MapBatch(MMU* mmu);
+        ~MapBatch();
+
+       private:
+        MMU* m_mmu;
+    };
+
     virtual void DumpMemory(FILE* fp) const;
     virtual void PrintRegions(void (*write)(void* data, const char* format, ...), void* data) const;
 
@@ -59,13 +88,104 @@ class MMU {
     // check if there are any existing regions with the specified address range
     virtual bool HasRegion(uint64_t address, size_t size);
 
+    // Host pointer to size bytes at address, if they are all in one region of plain memory. nullptr otherwise.
+    virtual uint8_t* GetHostPointer(uint64_t address, size_t size);
+
+    // Whether size bytes at address are all plain memory, so they can be read without going through a device
+    bool IsHostMemory(uint64_t address, size_t size) const;
+
+    // Copies size bytes at address to data through their host pointers. Never raises an exception, so it can be used off the
+    // execution thread under an Epoch::ReadGuard. Returns false if any of it isn't plain memory.
+    bool ReadHostMemory(uint64_t address, uint8_t* data, size_t size) const;
+
+    // Changes whenever regions are added or removed, so anything holding host pointers knows to drop them
+    uint64_t GetLayoutGeneration() const { return m_layoutGeneration; }
+
+    // Region containing address, or nullptr if there is none. Safe on any thread, but anything other than the execution thread
+    // has to hold an Epoch::ReadGuard for as long as it uses the region.
+    [[gnu::always_inline]] inline MemoryRegion* FindRegion(uint64_t address) const {
+        return m_map.Get(address);
+    }
+
+    // Width-templated physical accesses. Plain memory is accessed in place, only other regions go through their read/write.
+    template <typename T>
+    [[gnu::always_inline]] inline T ReadPhysical(uint64_t address) {
+        MemoryRegion* region = FindRegion(address);
+        if (region != nullptr) [[likely]] {
+            if (uint8_t* host = region->getHostPointer(address, sizeof(T)); host != nullptr) [[likely]] {
+                T data;
+                memcpy(&data, host, sizeof(T));
+                return data;
+            }
+        }
+        return static_cast<T>(ReadRegion(region, address, sizeof(T)));
+    }
+
+    template <typename T>
+    [[gnu::always_inline]] inline void WritePhysical(uint64_t address, T data) {
+        MemoryRegion* region = FindRegion(address);
+        if (region != nullptr) [[likely]] {
+            if (uint8_t* host = region->getHostPointer(address, sizeof(T)); host != nullptr) [[likely]] {
+                memcpy(host, &data, sizeof(T));
+                return;
+            }
+        }
+        WriteRegion(region, address, data, sizeof(T));
+    }
+
+    // Width-templated forms of read8..read64 and write8..write64
+    template <typename T>
+    [[gnu::always_inline]] inline T read(uint64_t address) {
+        if constexpr (sizeof(T) == 1)
+            return read8(address);
+        else if constexpr (sizeof(T) == 2)
+            return read16(address);
+        else if constexpr (sizeof(T) == 4)
+            return read32(address);
+        else
+            return read64(address);
+    }
+
+    template <typename T>
+    [[gnu::always_inline]] inline void write(uint64_t address, T data) {
+        if constexpr (sizeof(T) == 1)
+            write8(address, data);
+        else if constexpr (sizeof(T) == 2)
+            write16(address, data);
+        else if constexpr (sizeof(T) == 4)
+            write32(address, data);
+        else
+            write64(address, data);
+    }
+
+   private:
+    // Slow paths for ReadPhysical/WritePhysical, raising an exception if region is nullptr or too small
+    [[gnu::cold]] uint64_t ReadRegion(MemoryRegion* region, uint64_t address, uint8_t size);
+    [[gnu::cold]] void WriteRegion(MemoryRegion* region, uint64_t address, uint64_t data, uint8_t size);
+
+    // Next region above region, or the lowest one if region is nullptr
+    MemoryRegion* NextRegion(MemoryRegion* region) const;
+
+    // Points every page from start to end at entry, then recomputes the pages it only partly covers, and publishes the result unless in a MapBatch
+    void MapRange(uint64_t start, uint64_t end, MemoryRegion* entry);
+    void RefreshPage(uint64_t page);
+    void PublishMap();
+
+    // Maps whatever of the shared RAM covers start to end into the RAM there
+    void MapSharedRAM(uint64_t start, uint64_t end);
+
    private:
     struct RegionSegmentInfo {
         uint64_t start;
         uint64_t end;
     };
 
-    LinkedList::SimpleLinkedList<MemoryRegion> m_regions;
+    AVLTree::SimpleAVLTree<uint64_t, MemoryRegion*> m_regions; // keyed by start address
+    PhysicalMemoryMap m_map;
+    uint64_t m_mapBatchDepth;
+    bool m_mapChanged; // since the last publish
+    uint64_t m_layoutGeneration;
+    SharedRAM* m_sharedRAM;
 };
 
 #endif /* _MMU_HPP */
\ No newline at end of file
@@ -23,10 +23,37 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "Emulator.hpp"
 #include "Exceptions.hpp"
 #include "MMU.hpp"
-#include "StandardMemoryRegion.hpp"
 
-MemoryControlSystem::MemoryControlSystem(uint64_t RAMSize, MMU* mmu) : m_Status(0), m_Data{0, 0, 0, 0}, m_RAMSize(RAMSize), m_currentUsedRAM(0), m_MMU(mmu) {
+#include <Common/Util.hpp>
 
+#include <OSSpecific/Memory.hpp>
+
+MemoryControlSystem::MemoryControlSystem(uint64_t RAMSize, MMU* mmu) : m_Status(0), m_Data{0, 0, 0, 0}, m_RAMSize(RAMSize), m_currentUsedRAM(0), m_balloonTarget(0), m_balloonSize(0), m_freedSize(0), m_MMU(mmu), m_hasImage(false), m_image(), m_imageSize(0), m_sharedRAM(nullptr) {
+    if (!OSSpecific::g_GuestMemoryConfig.imagePath.empty()) {
+        m_image = OpenFileReadOnly(OSSpecific::g_GuestMemoryConfig.imagePath.c_str());
+        m_imageSize = GetFileSize(m_image);
+        m_hasImage = true;
+    }
+
+    if (!OSSpecific::g_GuestMemoryConfig.exportPath.empty()) {
+        m_sharedRAM = new SharedRAM(RAMSize, OSSpecific::g_GuestMemoryConfig.exportPath);
+        m_MMU->SetSharedRAM(m_sharedRAM);
+        // shared RAM has to be one file, so the image gets copied in instead of mapped
+        if (m_hasImage) {
+            m_sharedRAM->Load(m_image, m_imageSize);
+            CloseFile(m_image);
+            m_hasImage = false;
+        }
+    }
+}
+
+MemoryControlSystem::~MemoryControlSystem() {
+    if (m_hasImage)
+        CloseFile(m_image);
+    if (m_sharedRAM != nullptr) {
+        m_MMU->SetSharedRAM(nullptr);
+        delete m_sharedRAM;
+    }
 }
 
 uint64_t MemoryControlSystem::ReadRegister(uint64_t offset) {
@@ -68,6 +95,8 @@ void MemoryControlSystem::RunCommand(uint64_t command) {
     switch (comm) {
     case Commands::GET_INFO:
         m_Data[0] = m_RAMSize;
+        m_Data[1] = m_balloonTarget;
+        m_Data[2] = m_balloonSize;
         break;
     case Commands::SET_REGION: {
         uint64_t base = m_Data[0];
@@ -76,13 +105,50 @@ void MemoryControlSystem::RunCommand(uint64_t command) {
             m_Status = 1; // error: not aligned or zero size, not enough RAM, or region already exists
             break;
         }
-        StandardMemoryRegion* region = new StandardMemoryRegion(base, base + size);
-        m_MMU->AddMemoryRegion(region);
+        MMU::MapBatch batch(m_MMU);
+        if (m_sharedRAM != nullptr)
+            m_sharedRAM->AddRange(base, base + size, m_currentUsedRAM);
+        m_MMU->AddRAM(base, base + size);
+        // RAM is handed out in order, so this is the part of the image from the RAM used so far
+        if (m_hasImage && m_currentUsedRAM < m_imageSize)
+            m_MMU->MapFileIntoRAM(base, base + MIN(size, m_imageSize - m_currentUsedRAM), m_image, m_currentUsedRAM);
         m_currentUsedRAM += size;
         break;
     }
+    case Commands::FREE_PAGES:
+        if (!DiscardRange()) {
+            m_Status = 1; // error: not aligned, zero size, or not all RAM
+            break;
+        }
+        m_freedSize += m_Data[1];
+        break;
+    case Commands::INFLATE_BALLOON:
+        if (m_balloonSize + m_Data[1] > m_RAMSize || !DiscardRange()) {
+            m_Status = 1; // error: not aligned, zero size, not all RAM, or more than there is RAM
+            break;
+        }
+        m_balloonSize += m_Data[1];
+        break;
+    case Commands::DEFLATE_BALLOON: {
+        uint64_t size = m_Data[1];
+        if (size % 4096 != 0 || size > m_balloonSize) {
+            m_Status = 1; // error: not aligned, or more than is in the balloon
+            break;
+        }
+        // the pages were zeroed when the balloon took them, so there is nothing to give back
+        m_balloonSize -= size;
+        break;
+    }
     default:
         m_Status = 1; // error: unknown command
         break;
     }
 }
+
+bool MemoryControlSystem::DiscardRange() {
+    uint64_t base = m_Data[0];
+    uint64_t size = m_Data[1];
+    if (base % 4096 != 0 || size % 4096 != 0 || size == 0 || base + size < base)
+        return false;
+    return m_MMU->DiscardRAM(base, base + size);
+}
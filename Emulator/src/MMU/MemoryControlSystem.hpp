@@ -18,18 +18,30 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef _MEM_CONTROL_SYSTEM_HPP
 #define _MEM_CONTROL_SYSTEM_HPP
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 
 #include "MMU.hpp"
+#include "SharedRAM.hpp"
+
+#include <OSSpecific/File.hpp>
 
 class MemoryControlSystem {
 public:
     MemoryControlSystem(uint64_t RAMSize, MMU* mmu);
+    ~MemoryControlSystem();
 
     uint64_t ReadRegister(uint64_t offset);
     void WriteRegister(uint64_t offset, uint64_t data);
 
+    // Host side balloon control. The guest sees the target through GET_INFO and is expected to inflate or deflate towards it.
+    void SetBalloonTarget(uint64_t size) { m_balloonTarget = size; }
+    uint64_t GetBalloonTarget() const { return m_balloonTarget; }
+    uint64_t GetBalloonSize() const { return m_balloonSize; }
+    uint64_t GetFreedSize() const { return m_freedSize; }
+    uint64_t GetRAMSize() const { return m_RAMSize; }
+
 private:
     enum class Registers {
         COMMAND = 0,
@@ -42,17 +54,30 @@ private:
 
     enum class Commands {
         GET_INFO = 0,
-        SET_REGION = 1
+        SET_REGION = 1,
+        FREE_PAGES = 2,
+        INFLATE_BALLOON = 3,
+        DEFLATE_BALLOON = 4
     };
 
     void RunCommand(uint64_t command);
 
+    // Checks the base and size in the data registers describe a page aligned range of RAM, and gives it back to the host
+    bool DiscardRange();
+
 private:
     uint64_t m_Status;
     uint64_t m_Data[4];
     uint64_t m_RAMSize;
     uint64_t m_currentUsedRAM;
+    std::atomic<uint64_t> m_balloonTarget;
+    std::atomic<uint64_t> m_balloonSize;
+    std::atomic<uint64_t> m_freedSize; // reported free by the guest, over its whole run
     MMU* m_MMU; // always the physical MMU
+    bool m_hasImage;
+    FileHandle_t m_image; // initial contents of RAM, in the order it is handed out
+    size_t m_imageSize;
+    SharedRAM* m_sharedRAM; // nullptr unless RAM is being shared with other processes
 };
 
 #endif /* _MEM_CONTROL_SYSTEM_HPP */
\ No newline at end of file
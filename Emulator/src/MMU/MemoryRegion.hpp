@@ -57,12 +57,35 @@ class MemoryRegion {
 
     virtual bool canSplit() { return false; }
 
+    // Where address is in host memory, if the region is plain memory that can be accessed directly. nullptr otherwise.
+    [[gnu::always_inline]] inline uint8_t* getHostPointer(uint64_t address) const {
+        return m_hostBase == nullptr ? nullptr : m_hostBase + (address - m_start);
+    }
+
+    // Same as above, but also nullptr unless all size bytes are inside the region
+    [[gnu::always_inline]] inline uint8_t* getHostPointer(uint64_t address, size_t size) const {
+        if (m_hostBase == nullptr || address < m_start || address + size > m_end)
+            return nullptr;
+        return m_hostBase + (address - m_start);
+    }
+
     virtual bool isBIOS() { return false; }
 
+   protected:
+    // Marks the region as plain memory starting at base, so the MMU can skip read/write for it
+    void setHostBase(uint8_t* base) { m_hostBase = base; }
+
+    // For regions that can be resized or split. The MMU has to be told about the change.
+    void setEnd(uint64_t end) {
+        m_end = end;
+        m_size = end - m_start + 1;
+    }
+
    private:
     uint64_t m_start;
     uint64_t m_end;
     size_t m_size;
+    uint8_t* m_hostBase;
 };
 
 #endif /* _MEMORY_REGION_HPP */
\ No newline at end of file
@@ -0,0 +1,147 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PhysicalMemoryMap.hpp"
+
+#include <algorithm>
+
+#include "Epoch.hpp"
+
+PhysicalMemoryMap::PhysicalMemoryMap() : m_root(nullptr), m_working(nullptr), m_generation(1) {
+}
+
+PhysicalMemoryMap::~PhysicalMemoryMap() {
+    if (m_working != nullptr)
+        FreeNode(m_working, PHYS_MAP_LEVEL_COUNT - 1);
+}
+
+void PhysicalMemoryMap::Set(uint64_t page, uint64_t count, MemoryRegion* entry) {
+    constexpr uint64_t leafSize = 1ULL << PHYS_MAP_LEVEL_BITS;
+    while (count > 0) {
+        uint64_t index = page & (leafSize - 1);
+        uint64_t span = std::min(leafSize - index, count);
+        // only copy the path down to the leaf if something readers can see has to change, which filling empty pages doesn't
+        Node* leaf = FindLeaf(page, entry != nullptr);
+        if (leaf != nullptr && std::any_of(leaf->slots + index, leaf->slots + index + span, [](void* slot) { return slot != nullptr; })) {
+            leaf = GetLeaf(page, false);
+            for (uint64_t i = index; i < index + span; i++)
+                SetEntry(leaf->slots[i], entry);
+        } else if (leaf != nullptr && entry != nullptr) {
+            for (uint64_t i = index; i < index + span; i++)
+                std::atomic_ref<void*>(leaf->slots[i]).store(entry, std::memory_order_release);
+        }
+        page += span;
+        count -= span;
+    }
+}
+
+void PhysicalMemoryMap::SetMixed(uint64_t page, MemoryRegion* const* regions, uint64_t count) {
+    MemoryRegion** list = new MemoryRegion*[count + 1];
+    std::copy_n(regions, count, list);
+    list[count] = nullptr;
+    SetEntry(GetLeaf(page, true)->slots[page & ((1 << PHYS_MAP_LEVEL_BITS) - 1)], reinterpret_cast<void*>(reinterpret_cast<uint64_t>(list) | PHYS_MAP_MIXED_TAG));
+}
+
+void PhysicalMemoryMap::Publish() {
+    m_root.store(m_working, std::memory_order_release);
+    m_generation++;
+    Epoch::Advance();
+}
+
+MemoryRegion* PhysicalMemoryMap::GetMixed(void* entry, uint64_t address) {
+    for (MemoryRegion* const* region = reinterpret_cast<MemoryRegion* const*>(reinterpret_cast<uint64_t>(entry) & ~PHYS_MAP_MIXED_TAG); *region != nullptr; region++) {
+        if ((*region)->isInside(address))
+            return *region;
+    }
+    return nullptr;
+}
+
+PhysicalMemoryMap::Node* PhysicalMemoryMap::GetLeaf(uint64_t page, bool create) {
+    if (m_working == nullptr) {
+        if (!create)
+            return nullptr;
+        m_working = new Node();
+        m_working->generation = m_generation;
+    }
+    m_working = MakeWritable(m_working);
+    Node* node = m_working;
+    for (uint8_t level = PHYS_MAP_LEVEL_COUNT - 1; level > 0; level--) {
+        void*& slot = node->slots[(page >> (level * PHYS_MAP_LEVEL_BITS)) & ((1 << PHYS_MAP_LEVEL_BITS) - 1)];
+        if (slot == nullptr) {
+            if (!create)
+                return nullptr;
+            Node* child = new Node();
+            child->generation = m_generation;
+            slot = child;
+        }
+        slot = MakeWritable(static_cast<Node*>(slot));
+        node = static_cast<Node*>(slot);
+    }
+    return node;
+}
+
+PhysicalMemoryMap::Node* PhysicalMemoryMap::FindLeaf(uint64_t page, bool create) {
+    if (m_working == nullptr) {
+        if (!create)
+            return nullptr;
+        // readers only see the root once it is published
+        m_working = new Node();
+        m_working->generation = m_generation;
+    }
+    Node* node = m_working;
+    for (uint8_t level = PHYS_MAP_LEVEL_COUNT - 1; level > 0; level--) {
+        void*& slot = node->slots[(page >> (level * PHYS_MAP_LEVEL_BITS)) & ((1 << PHYS_MAP_LEVEL_BITS) - 1)];
+        if (slot == nullptr) {
+            if (!create)
+                return nullptr;
+            // the table is complete before it is linked in, and readers can see it from then on if they can see its parent
+            Node* child = new Node();
+            child->generation = node->generation == m_generation ? m_generation : 0;
+            std::atomic_ref<void*>(slot).store(child, std::memory_order_release);
+        }
+        node = static_cast<Node*>(slot);
+    }
+    return node;
+}
+
+PhysicalMemoryMap::Node* PhysicalMemoryMap::MakeWritable(Node* node) {
+    if (node->generation == m_generation)
+        return node;
+    // readers can be walking it, so they keep the old one until they are done
+    Node* copy = new Node(*node);
+    copy->generation = m_generation;
+    Epoch::Retire(node);
+    return copy;
+}
+
+void PhysicalMemoryMap::SetEntry(void*& slot, void* entry) {
+    if (uint64_t old = reinterpret_cast<uint64_t>(slot); old & PHYS_MAP_MIXED_TAG)
+        Epoch::Retire(reinterpret_cast<void*>(old & ~PHYS_MAP_MIXED_TAG), [](void* list) { delete[] static_cast<MemoryRegion**>(list); });
+    slot = entry;
+}
+
+void PhysicalMemoryMap::FreeNode(Node* node, uint8_t level) {
+    for (void* child : node->slots) {
+        if (child == nullptr)
+            continue;
+        if (level > 0)
+            FreeNode(static_cast<Node*>(child), level - 1);
+        else if (uint64_t entry = reinterpret_cast<uint64_t>(child); entry & PHYS_MAP_MIXED_TAG)
+            delete[] reinterpret_cast<MemoryRegion**>(entry & ~PHYS_MAP_MIXED_TAG);
+    }
+    delete node;
+}
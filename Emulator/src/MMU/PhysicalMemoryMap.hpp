@@ -0,0 +1,99 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PHYSICAL_MEMORY_MAP_HPP
+#define _PHYSICAL_MEMORY_MAP_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include "MemoryRegion.hpp"
+
+#define PHYS_MAP_PAGE_SHIFT 12
+#define PHYS_MAP_PAGE_SIZE (1ULL << PHYS_MAP_PAGE_SHIFT)
+#define PHYS_MAP_LEVEL_BITS 13
+#define PHYS_MAP_LEVEL_COUNT 4 // 4 levels of 13 bits covers all 52 bits of a 4KiB page number
+
+// Set in the entry for a page that is shared by more than one region, or only partly covered by one.
+// The rest of the entry points at a nullptr terminated list of the regions in the page.
+#define PHYS_MAP_MIXED_TAG 1ULL
+
+// Sparse radix tree from physical page to the region that covers it.
+// Changes go to a working copy, which copies any node readers can see before changing it, and readers on any thread see them all at once on Publish.
+// The exception is filling pages that map to nothing. No reader can be relying on an empty slot, so those are filled in place and seen straight away,
+// which keeps adding RAM a page at a time from copying the path down to it each time.
+class PhysicalMemoryMap {
+   public:
+    PhysicalMemoryMap();
+    ~PhysicalMemoryMap();
+
+    // Sets count pages from page to entry, which can be nullptr to clear them
+    void Set(uint64_t page, uint64_t count, MemoryRegion* entry);
+
+    // Sets page to be searched through the count regions in it
+    void SetMixed(uint64_t page, MemoryRegion* const* regions, uint64_t count);
+
+    // Makes everything Set since the last call visible, retiring whatever only the old version used
+    void Publish();
+
+    [[gnu::always_inline]] inline MemoryRegion* Get(uint64_t address) const {
+        uint64_t page = address >> PHYS_MAP_PAGE_SHIFT;
+        const Node* node = m_root.load(std::memory_order_acquire);
+        for (uint8_t level = PHYS_MAP_LEVEL_COUNT - 1; level > 0 && node != nullptr; level--)
+            node = static_cast<const Node*>(LoadSlot(node, (page >> (level * PHYS_MAP_LEVEL_BITS)) & ((1 << PHYS_MAP_LEVEL_BITS) - 1)));
+        if (node == nullptr)
+            return nullptr;
+        void* entry = LoadSlot(node, page & ((1 << PHYS_MAP_LEVEL_BITS) - 1));
+        if (reinterpret_cast<uint64_t>(entry) & PHYS_MAP_MIXED_TAG) [[unlikely]]
+            return GetMixed(entry, address);
+        return static_cast<MemoryRegion*>(entry);
+    }
+
+   private:
+    struct Node {
+        void* slots[1 << PHYS_MAP_LEVEL_BITS];
+        uint64_t generation; // readers can see the node once the Publish for this generation is done, 0 if they already can
+    };
+
+    // Slots can be filled in place while readers walk the node
+    [[gnu::always_inline]] static inline void* LoadSlot(const Node* node, uint64_t index) {
+        return std::atomic_ref<void*>(const_cast<void*&>(node->slots[index])).load(std::memory_order_acquire);
+    }
+
+    static MemoryRegion* GetMixed(void* entry, uint64_t address);
+
+    // Returns the working copy of the leaf covering page, creating it and any tables above it if create is set
+    Node* GetLeaf(uint64_t page, bool create);
+
+    // Returns the leaf covering page in the working version without copying anything, creating missing tables in place if create is set
+    Node* FindLeaf(uint64_t page, bool create);
+
+    // Returns a copy of node that can be changed in place, retiring node if readers can see it
+    Node* MakeWritable(Node* node);
+
+    // Replaces the entry in slot, retiring the old one's region list if it had one
+    static void SetEntry(void*& slot, void* entry);
+
+    void FreeNode(Node* node, uint8_t level);
+
+   private:
+    std::atomic<Node*> m_root; // the version readers see
+    Node* m_working;
+    uint64_t m_generation;
+};
+
+#endif /* _PHYSICAL_MEMORY_MAP_HPP */
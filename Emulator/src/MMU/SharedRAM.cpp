@@ -0,0 +1,154 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "SharedRAM.hpp"
+
+#include <cstdio>
+
+#include <Emulator.hpp>
+
+#include <OSSpecific/Memory.hpp>
+
+#define SHARED_RAM_LOAD_CHUNK (1024 * 1024)
+
+SharedRAM::SharedRAM(size_t size, const std::string& mapPath)
+    : m_size(size), m_mapPath(mapPath), m_generation(0), m_publishPending(false) {
+    m_handle = OSSpecific::CreateSharedMemory(size, m_path);
+    WriteMap(FormatMap());
+}
+
+SharedRAM::~SharedRAM() {
+    uint64_t start = 0;
+    while (Range* range = m_ranges.findOrHigher(0, &start)) {
+        m_ranges.remove(start);
+        delete range;
+    }
+    // the shared memory goes away with us, so the map would only point at nothing
+    remove(m_mapPath.c_str());
+    OSSpecific::DestroySharedMemory(m_handle, m_path);
+}
+
+void SharedRAM::AddRange(uint64_t start, uint64_t end, uint64_t offset) {
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    // RAM is mostly added in order, so extend the range below where it continues it
+    uint64_t previousStart = 0;
+    Range* previous = start > 0 ? m_ranges.findOrLower(start - 1, &previousStart) : nullptr;
+    Range* range;
+    if (previous != nullptr && previous->end == start && previous->offset + (start - previousStart) == offset) {
+        previous->end = end;
+        range = previous;
+    } else {
+        range = new Range{end, offset};
+        m_ranges.insert(start, range);
+        previousStart = start;
+    }
+
+    // and take in the range above if this closed the gap to it
+    if (Range* next = m_ranges.find(end); next != nullptr && next->offset == range->offset + (end - previousStart)) {
+        range->end = next->end;
+        m_ranges.remove(end);
+        delete next;
+    }
+
+    RequestPublish();
+}
+
+void SharedRAM::ExcludeRange(uint64_t start, uint64_t end) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_excluded.remove(start);
+    m_excluded.insert(start, end);
+    RequestPublish();
+}
+
+void SharedRAM::IncludeRange(uint64_t start) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_excluded.remove(start);
+    RequestPublish();
+}
+
+void SharedRAM::HandlePublishEvent() {
+    // anything changed after this gets another event
+    m_publishPending.store(false);
+    std::string map;
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        map = FormatMap();
+    }
+    WriteMap(map);
+}
+
+void SharedRAM::Load(FileHandle_t handle, size_t size) {
+    uint8_t* buffer = new uint8_t[SHARED_RAM_LOAD_CHUNK];
+    for (size_t offset = 0; offset < size && offset < m_size;) {
+        size_t bytesRead = ReadFile(handle, buffer, MIN(size - offset, static_cast<size_t>(SHARED_RAM_LOAD_CHUNK)), offset);
+        if (bytesRead == 0)
+            break;
+        WriteFile(m_handle, buffer, bytesRead, offset);
+        offset += bytesRead;
+    }
+    delete[] buffer;
+}
+
+void SharedRAM::RequestPublish() {
+    if (!m_publishPending.exchange(true))
+        Emulator::RaiseEvent({Emulator::EventType::SharedRAMPublish, reinterpret_cast<uint64_t>(this)});
+}
+
+std::string SharedRAM::FormatMap() {
+    char line[128];
+    snprintf(line, sizeof(line), "generation %lu\n", ++m_generation);
+    std::string map = line;
+    map += "memory " + m_path + "\n";
+    snprintf(line, sizeof(line), "size %#lx\n", m_size);
+    map += line;
+    uint64_t start = 0;
+    for (Range* range = m_ranges.findOrHigher(0, &start); range != nullptr; range = m_ranges.findOrHigher(range->end, &start)) {
+        // split around whatever is excluded inside the range
+        uint64_t from = start;
+        uint64_t excludedStart = 0;
+        uint64_t excludedEnd = m_excluded.findOrLower(from, &excludedStart);
+        if (excludedEnd <= from)
+            excludedEnd = m_excluded.findOrHigher(from, &excludedStart);
+        while (from < range->end) {
+            uint64_t to = excludedEnd != 0 && excludedStart < range->end ? MAX(excludedStart, from) : range->end;
+            if (to > from) {
+                snprintf(line, sizeof(line), "range %#lx %#lx %#lx\n", from, to, range->offset + (from - start));
+                map += line;
+            }
+            if (to == range->end)
+                break;
+            from = excludedEnd;
+            excludedEnd = m_excluded.findOrHigher(from, &excludedStart);
+        }
+    }
+    return map;
+}
+
+void SharedRAM::WriteMap(const std::string& map) {
+    // written next to the map and renamed over it, so readers never see half of one
+    std::string temp = m_mapPath + ".tmp";
+    FILE* fp = fopen(temp.c_str(), "w");
+    if (fp == nullptr)
+        Emulator::Crash("Failed to publish the shared RAM map");
+
+    fwrite(map.data(), 1, map.size(), fp);
+
+    if (fclose(fp) != 0 || rename(temp.c_str(), m_mapPath.c_str()) != 0)
+        Emulator::Crash("Failed to publish the shared RAM map");
+}
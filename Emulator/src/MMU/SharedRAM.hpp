@@ -0,0 +1,98 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _SHARED_RAM_HPP
+#define _SHARED_RAM_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include <Common/DataStructures/AVLTree.hpp>
+#include <Common/Util.hpp>
+
+#include <OSSpecific/File.hpp>
+
+// Guest RAM kept in host memory that other processes can map, with a published map of where each part of it is in guest physical memory
+class SharedRAM {
+public:
+    // Creates size bytes of shared memory, and publishes its map at mapPath
+    SharedRAM(size_t size, const std::string& mapPath);
+    ~SharedRAM();
+
+    // Records that guest physical memory from start to end is at offset in the shared memory
+    void AddRange(uint64_t start, uint64_t end, uint64_t offset);
+
+    // Leaves start to end out of the published map while a device has taken it over. It keeps its place in the shared memory for when it is included again.
+    void ExcludeRange(uint64_t start, uint64_t end);
+    void IncludeRange(uint64_t start);
+
+    // Writes out the map. Changes are gathered up and published by this on the emulator thread, so adding RAM a page at a time doesn't rewrite the file for each page.
+    void HandlePublishEvent();
+
+    // Calls callback(start, end, offset) for each part of start to end that is in the shared memory
+    template <typename F>
+    void ForEachRange(uint64_t start, uint64_t end, F callback) const {
+        uint64_t rangeStart = 0;
+        Range* range = m_ranges.findOrLower(start, &rangeStart);
+        if (range == nullptr || range->end <= start)
+            range = m_ranges.findOrHigher(start, &rangeStart);
+        while (range != nullptr && rangeStart < end) {
+            uint64_t from = MAX(start, rangeStart);
+            uint64_t to = MIN(end, range->end);
+            callback(from, to, range->offset + (from - rangeStart));
+            range = m_ranges.findOrHigher(range->end, &rangeStart);
+        }
+    }
+
+    // Copies the first size bytes of a file to the start of the shared memory
+    void Load(FileHandle_t handle, size_t size);
+
+    FileHandle_t GetHandle() const { return m_handle; }
+    const std::string& GetPath() const { return m_path; }
+    const std::string& GetMapPath() const { return m_mapPath; }
+
+private:
+    // Called with m_lock held
+    void RequestPublish();
+    std::string FormatMap();
+
+    void WriteMap(const std::string& map);
+
+private:
+    struct Range {
+        uint64_t end;
+        uint64_t offset;
+    };
+
+    FileHandle_t m_handle;
+    size_t m_size;
+    std::string m_path; // where other processes can open the shared memory
+    std::string m_mapPath;
+    uint64_t m_generation; // bumped on every publish, so readers can tell the map changed
+    AVLTree::SimpleAVLTree<uint64_t, Range*> m_ranges; // keyed by guest physical start
+    AVLTree::SimpleAVLTree<uint64_t, uint64_t> m_excluded; // end of each excluded range, keyed by its start
+
+    // Only the execution thread changes the ranges, so it only needs this to keep them from the emulator thread while it is writing them out
+    std::mutex m_lock;
+    std::atomic_bool m_publishPending;
+};
+
+#endif /* _SHARED_RAM_HPP */
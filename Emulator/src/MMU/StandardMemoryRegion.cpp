@@ -19,15 +19,23 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <string.h>
 
+#include <Common/Util.hpp>
 #include <OSSpecific/Memory.hpp>
 
 StandardMemoryRegion::StandardMemoryRegion(uint64_t start, uint64_t end)
-    : MemoryRegion(start, end) {
-    m_data = static_cast<uint8_t*>(OSSpecific::AllocateCOWMemory(MemoryRegion::getSize()));
+    : MemoryRegion(start, end), m_dataSize(end - start), m_capacity(end - start), m_backing(OSSpecific::COWBacking::ANONYMOUS) {
+    m_data = static_cast<uint8_t*>(OSSpecific::AllocateCOWMemory(m_capacity));
+    setHostBase(m_data);
+}
+
+StandardMemoryRegion::StandardMemoryRegion(uint64_t start, uint64_t end, uint8_t* data, size_t capacity)
+    : MemoryRegion(start, end), m_data(data), m_dataSize(end - start), m_capacity(capacity), m_backing(OSSpecific::COWBacking::ANONYMOUS) {
+    setHostBase(m_data);
 }
 
 StandardMemoryRegion::~StandardMemoryRegion() {
-    OSSpecific::FreeCOWMemory(m_data);
+    if (m_data != nullptr)
+        OSSpecific::FreeSizedCOWMemory(m_data, m_capacity);
 }
 
 void StandardMemoryRegion::read(uint64_t address, uint8_t* buffer, size_t size) {
@@ -39,3 +47,68 @@ void StandardMemoryRegion::write(uint64_t address, const uint8_t* buffer, size_t
     if (isInside(address, size))
         memcpy(m_data + (address - getStart()), buffer, size);
 }
+
+void StandardMemoryRegion::printData(void (*write)(void* data, const char* format, ...), void* data) {
+    if (OSSpecific::COWMemoryUsage usage; OSSpecific::QueryCOWMemory(m_data, m_dataSize, usage))
+        write(data, "StandardMemoryRegion: %lx - %lx, resident = %lu KiB, shared = %lu KiB, huge pages = %lu KiB, locked = %lu KiB\n", getStart(), getEnd(), usage.residentBytes / 1024,
+              usage.sharedBytes / 1024, usage.hugePageBytes / 1024, usage.lockedBytes / 1024);
+    else
+        write(data, "StandardMemoryRegion: %lx - %lx\n", getStart(), getEnd());
+}
+
+void StandardMemoryRegion::resize(uint64_t end) {
+    size_t newSize = end - getStart();
+    // memory already mapped past the end has never been reachable, so growing into it needs no clearing
+    if (mayMove(end)) {
+        size_t capacity = newSize > m_dataSize ? newSize + MIN(newSize, STANDARD_REGION_MAX_RESERVE) : newSize;
+        m_data = static_cast<uint8_t*>(OSSpecific::ResizeCOWMemory(m_data, m_capacity, capacity, m_dataSize));
+        m_capacity = capacity;
+    }
+    // the reserve is only faulted in or locked as it comes into use
+    if (newSize > m_dataSize)
+        OSSpecific::PrepareCOWMemory(m_data + m_dataSize, newSize - m_dataSize);
+    m_dataSize = newSize;
+    setEnd(end);
+    setHostBase(m_data);
+}
+
+bool StandardMemoryRegion::mayMove(uint64_t end) {
+    size_t newSize = end - getStart();
+    return newSize > m_capacity || newSize < m_dataSize;
+}
+
+void StandardMemoryRegion::merge(StandardMemoryRegion* next) {
+    uint64_t offset = getEnd() - getStart();
+    resize(next->getEnd());
+    OSSpecific::MoveCOWMemory(m_data + offset, next->m_data, next->m_dataSize);
+    m_backing = MAX(m_backing, next->m_backing);
+
+    // freed now rather than with next, which can outlive this by a while once it is retired. By then the host may have reused the addresses.
+    OSSpecific::FreeSizedCOWMemory(next->m_data, next->m_capacity);
+    next->m_data = nullptr;
+    next->m_capacity = 0;
+    next->setHostBase(nullptr);
+}
+
+void StandardMemoryRegion::discard(uint64_t address, size_t size) {
+    if (isInside(address, size))
+        OSSpecific::DiscardCOWMemory(m_data + (address - getStart()), size, m_backing);
+}
+
+void StandardMemoryRegion::mapFile(uint64_t address, size_t size, FileHandle_t handle, size_t offset, bool shared) {
+    if (!isInside(address, size))
+        return;
+    OSSpecific::MapFileIntoCOWMemory(m_data + (address - getStart()), size, handle, offset, shared);
+    m_backing = MAX(m_backing, shared ? OSSpecific::COWBacking::SHARED_FILE : OSSpecific::COWBacking::PRIVATE_FILE);
+}
+
+StandardMemoryRegion* StandardMemoryRegion::split(uint64_t address) {
+    size_t offset = address - getStart();
+    uint8_t* data = static_cast<uint8_t*>(OSSpecific::SplitCOWMemory(m_data, m_capacity, offset));
+    StandardMemoryRegion* tail = new StandardMemoryRegion(address, getEnd(), data, m_capacity - offset);
+    tail->m_backing = m_backing;
+    m_dataSize = offset;
+    m_capacity = offset;
+    setEnd(address);
+    return tail;
+}
@@ -22,6 +22,11 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "MemoryRegion.hpp"
 
+#include <OSSpecific/Memory.hpp>
+
+// most a region reserves past its end when it grows, so guests adding RAM in small chunks don't remap it every time
+#define STANDARD_REGION_MAX_RESERVE (256ULL * 1024 * 1024)
+
 class StandardMemoryRegion : public MemoryRegion {
 public:
     StandardMemoryRegion(uint64_t start, uint64_t end);
@@ -32,8 +37,36 @@ public:
 
     virtual bool canSplit() override { return true; }
 
+    virtual void printData(void (*write)(void* data, const char* format, ...), void* data) override;
+
+    // Moves the end of the region, keeping everything below it. Memory added at the end is zeroed.
+    void resize(uint64_t end);
+
+    // Whether resizing to end can move the region in host memory
+    bool mayMove(uint64_t end);
+
+    // Appends the contents of next, which has to start where this region ends. next is left empty.
+    void merge(StandardMemoryRegion* next);
+
+    // Drops the contents of size bytes at address, giving the host pages back. They read as zero afterwards.
+    void discard(uint64_t address, size_t size);
+
+    // Backs size bytes at address with a private copy-on-write mapping of the file from offset, which has to cover all of it.
+    // With shared set, writes go to the file instead, and the range has to be page aligned.
+    void mapFile(uint64_t address, size_t size, FileHandle_t handle, size_t offset, bool shared = false);
+
+    // Cuts the region at address, returning a new region with everything from address onwards
+    StandardMemoryRegion* split(uint64_t address);
+
+private:
+    // takes ownership of capacity bytes at data, which has to come from OSSpecific::AllocateCOWMemory
+    StandardMemoryRegion(uint64_t start, uint64_t end, uint8_t* data, size_t capacity);
+
 private:
     uint8_t* m_data;
+    size_t m_dataSize;
+    size_t m_capacity; // bytes mapped at m_data, which can run past the end of the region
+    OSSpecific::COWBacking m_backing; // the most special thing mapped into any of it
 };
 
 #endif /* _STANDARD_MEMORY_REGION_HPP */
\ No newline at end of file
@@ -19,13 +19,12 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <cstddef>
 #include <cstdint>
-#include <IO/IOMemoryRegion.hpp>
 
 #include "Emulator.hpp"
 #include "Exceptions.hpp"
 #include "MemoryControlSystem.hpp"
 
-SystemControlMemoryRegion::SystemControlMemoryRegion(uint64_t start, uint64_t end, IOBus* bus, uint64_t RAMSize, MMU* mmu) : MemoryRegion(start, end), m_IORegion(start + 0x10, start + 0x40, bus), m_MemControl(RAMSize, mmu) {
+SystemControlMemoryRegion::SystemControlMemoryRegion(uint64_t start, uint64_t end, IOBus* bus, uint64_t RAMSize, MMU* mmu) : MMIOMemoryRegion(start, end), m_bus(bus), m_MemControl(RAMSize, mmu) {
 
 }
 
@@ -33,83 +32,23 @@ SystemControlMemoryRegion::~SystemControlMemoryRegion() {
 
 }
 
-void SystemControlMemoryRegion::read(uint64_t address, uint8_t* buffer, size_t size) {
-    if (uint64_t offset = address - getStart(); offset < 0x10) {
-        for (size_t i = 0; i < size; i++)
-            buffer[i] = ReadRegister((offset + i) / 8) >> ((address + i) % 8 * 8) & 0xFF;
-    } else if (offset < 0x40)
-        m_IORegion.read(address, buffer, size);
-    else if (offset < 0x70) {
-        for (size_t i = 0; i < size; i++)
-            buffer[i] = m_MemControl.ReadRegister((offset + i) / 8) >> ((address + i) % 8 * 8) & 0xFF;
-    } else
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
+uint64_t SystemControlMemoryRegion::ReadRegister(uint64_t index, uint8_t) {
+    if (index < SYSCTRL_IO_BUS_INDEX)
+        return 0; // the system control registers are unused
+    else if (index < SYSCTRL_MEMCTRL_INDEX)
+        return m_bus->ReadRegister(index - SYSCTRL_IO_BUS_INDEX);
+    else if (index < SYSCTRL_END_INDEX)
+        return m_MemControl.ReadRegister(index - SYSCTRL_MEMCTRL_INDEX);
+    g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, getStart() + index * 8);
 }
 
-void SystemControlMemoryRegion::write(uint64_t address, const uint8_t* buffer, size_t size) {
-    if (uint64_t offset = address - getStart(); offset < 0x10) {
-        for (size_t i = 0; i < size; i++) {
-            uint64_t currentData = ReadRegister((offset + i) / 8);
-            currentData &= ~(0xFFULL << ((address + i) % 8 * 8));
-            currentData |= static_cast<uint64_t>(buffer[i]) << ((address + i) % 8 * 8);
-            WriteRegister((offset + i) / 8, currentData);
-        }
-    } else if (offset < 0x40)
-        m_IORegion.write(address, buffer, size);
-    else if (offset < 0x70) {
-        for (size_t i = 0; i < size; i++) {
-            uint64_t currentData = ReadRegister((offset + i) / 8);
-            currentData &= ~(0xFFULL << ((address + i) % 8 * 8));
-            currentData |= static_cast<uint64_t>(buffer[i]) << ((address + i) % 8 * 8);
-            m_MemControl.WriteRegister((offset + i) / 8, currentData);
-        }
-    }
+void SystemControlMemoryRegion::WriteRegister(uint64_t index, uint64_t data, uint8_t) {
+    if (index < SYSCTRL_IO_BUS_INDEX)
+        return;
+    else if (index < SYSCTRL_MEMCTRL_INDEX)
+        m_bus->WriteRegister(index - SYSCTRL_IO_BUS_INDEX, data);
+    else if (index < SYSCTRL_END_INDEX)
+        m_MemControl.WriteRegister(index - SYSCTRL_MEMCTRL_INDEX, data);
     else
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);
-}
-
-#define SYSCTRLReadFunc(size) \
-void SystemControlMemoryRegion::read##size(uint64_t address, uint##size##_t* buffer) {  \
-    if (uint64_t offset = address - getStart(); offset < 0x10)                          \
-        *buffer = ReadRegister(offset / 8);                                             \
-    else if (offset < 0x40)                                                             \
-        m_IORegion.read##size(address, buffer);                                         \
-    else if (offset < 0x70)                                                             \
-        *buffer = m_MemControl.ReadRegister((offset - 0x40) / 8);                       \
-    else                                                                                \
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);     \
-}
-
-#define SYSCTRLWriteFunc(size) \
-void SystemControlMemoryRegion::write##size(uint64_t address, const uint##size##_t* buffer) {  \
-    if (uint64_t offset = address - getStart(); offset < 0x10)                                 \
-        WriteRegister(offset / 8, *buffer);                                                    \
-    else if (offset < 0x40)                                                                    \
-        m_IORegion.write##size(address, buffer);                                               \
-    else if (offset < 0x70)                                                                    \
-        m_MemControl.WriteRegister((offset - 0x40) / 8, *buffer);                              \
-    else                                                                                       \
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, address);            \
-}
-
-SYSCTRLReadFunc(8)
-SYSCTRLReadFunc(16)
-SYSCTRLReadFunc(32)
-SYSCTRLReadFunc(64)
-SYSCTRLWriteFunc(8)
-SYSCTRLWriteFunc(16)
-SYSCTRLWriteFunc(32)
-SYSCTRLWriteFunc(64)
-
-#undef SYSCTRLReadFunc
-#undef SYSCTRLWriteFunc
-
-uint64_t SystemControlMemoryRegion::ReadRegister(uint64_t offset) {
-    (void)offset;
-    return 0;
-}
-
-void SystemControlMemoryRegion::WriteRegister(uint64_t offset, uint64_t data) {
-    (void)offset;
-    (void)data;
+        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, getStart() + index * 8);
 }
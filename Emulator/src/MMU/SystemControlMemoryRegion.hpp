@@ -21,37 +21,35 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <cstddef>
 #include <cstdint>
 
-#include <IO/IOMemoryRegion.hpp>
+#include <IO/IOBus.hpp>
 
-#include "MemoryRegion.hpp"
+#include "MMIOMemoryRegion.hpp"
 #include "MemoryControlSystem.hpp"
 #include "MMU.hpp"
 
-class SystemControlMemoryRegion : public MemoryRegion {
+// QWORD register indexes of each part of the region
+#define SYSCTRL_IO_BUS_INDEX 2  // 0x10
+#define SYSCTRL_MEMCTRL_INDEX 8 // 0x40
+#define SYSCTRL_END_INDEX 14    // 0x70
+
+class SystemControlMemoryRegion : public MMIOMemoryRegion {
 public:
     SystemControlMemoryRegion(uint64_t start, uint64_t end, IOBus* bus, uint64_t RAMSize, MMU* mmu);
     virtual ~SystemControlMemoryRegion() override;
 
-    virtual void read(uint64_t address, uint8_t* buffer, size_t size) override;
-    virtual void write(uint64_t address, const uint8_t* buffer, size_t size) override;
+    virtual bool canSplit() override { return false; }
 
-    virtual void read8(uint64_t address, uint8_t* buffer) override;
-    virtual void read16(uint64_t address, uint16_t* buffer) override;
-    virtual void read32(uint64_t address, uint32_t* buffer) override;
-    virtual void read64(uint64_t address, uint64_t* buffer) override;
-    virtual void write8(uint64_t address, const uint8_t* buffer) override;
-    virtual void write16(uint64_t address, const uint16_t* buffer) override;
-    virtual void write32(uint64_t address, const uint32_t* buffer) override;
-    virtual void write64(uint64_t address, const uint64_t* buffer) override;
+    MemoryControlSystem* GetMemoryControl() { return &m_MemControl; }
 
-    virtual bool canSplit() override { return false; }
+protected:
+    virtual uint64_t ReadRegister(uint64_t index, uint8_t width) override;
+    virtual void WriteRegister(uint64_t index, uint64_t data, uint8_t width) override;
 
-private:
-    uint64_t ReadRegister(uint64_t offset);
-    void WriteRegister(uint64_t offset, uint64_t data);
+    // like device registers, I/O bus registers are always accessed from their start
+    virtual bool AlignsAccesses(uint64_t index) const override { return index >= SYSCTRL_IO_BUS_INDEX && index < SYSCTRL_MEMCTRL_INDEX; }
 
 private:
-    IOMemoryRegion m_IORegion;
+    IOBus* m_bus;
     MemoryControlSystem m_MemControl;
 };
 
@@ -17,279 +17,394 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "VirtualMMU.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 #include <Common/Util.hpp>
 
 #include <Emulator.hpp>
 #include <Exceptions.hpp>
 
-VirtualMMU::VirtualMMU(MMU* physicalMMU, uint64_t pageTableRoot, PageSize pageSize, PageTableLevelCount pageTableLevelCount)
-    : m_physicalMMU(physicalMMU), m_pageTableRoot(pageTableRoot), m_pageSize(pageSize), m_pageTableLevelCount(pageTableLevelCount) {
+std::atomic_uint64_t g_TLBHits = 0;
+
+namespace {
+    // only ever incremented from the CPU thread, atomic so the debugger can read them
+    std::atomic_uint64_t g_TLBMisses = 0;
+    std::atomic_uint64_t g_TLBFlushes = 0;
+    std::atomic_uint64_t g_WalkCacheHits = 0;
+    std::atomic_uint64_t g_WalkCacheFlushes = 0;
+
+    inline void Increment(std::atomic_uint64_t& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+VirtualMMU::VirtualMMU(MMU* physicalMMU, uint64_t pageTableRoot, uint8_t pageShift, uint8_t levelCount)
+    : m_physicalMMU(physicalMMU), m_pageTableRoot(pageTableRoot), m_asid(0), m_pageShift(pageShift), m_levelCount(levelCount), m_tlb(), m_walkCache(), m_layoutGeneration(0), m_largeMappings(false) {
     assert(m_physicalMMU != nullptr);
+    FlushTLB();
 }
 
 VirtualMMU::~VirtualMMU() {
 }
 
-void VirtualMMU::ReadBuffer(uint64_t address, uint8_t* data, size_t size) {
-    m_physicalMMU->ReadBuffer(TranslateAddress(address, PageTranslateMode::Read), data, size);
+void VirtualMMU::AddMemoryRegion(MemoryRegion* region) {
+    (void)region;
 }
 
-void VirtualMMU::WriteBuffer(uint64_t address, const uint8_t* data, size_t size) {
-    m_physicalMMU->WriteBuffer(TranslateAddress(address, PageTranslateMode::Write), data, size);
+void VirtualMMU::RemoveMemoryRegion(MemoryRegion* region) {
+    (void)region;
 }
 
-uint8_t VirtualMMU::read8(uint64_t address) {
-    return m_physicalMMU->read8(TranslateAddress(address, PageTranslateMode::Read));
+void VirtualMMU::AddRAM(uint64_t, uint64_t) {
 }
 
-uint16_t VirtualMMU::read16(uint64_t address) {
-    return m_physicalMMU->read16(TranslateAddress(address, PageTranslateMode::Read));
+bool VirtualMMU::DiscardRAM(uint64_t, uint64_t) {
+    return false;
 }
 
-uint32_t VirtualMMU::read32(uint64_t address) {
-    return m_physicalMMU->read32(TranslateAddress(address, PageTranslateMode::Read));
+bool VirtualMMU::MapFileIntoRAM(uint64_t, uint64_t, FileHandle_t, size_t, bool) {
+    return false;
 }
 
-uint64_t VirtualMMU::read64(uint64_t address) {
-    return m_physicalMMU->read64(TranslateAddress(address, PageTranslateMode::Read));
+void VirtualMMU::DumpMemory(FILE*) const {
 }
 
-void VirtualMMU::write8(uint64_t address, uint8_t data) {
-    m_physicalMMU->write8(TranslateAddress(address, PageTranslateMode::Write), data);
+bool VirtualMMU::RemoveRegionSegment(uint64_t, uint64_t, void**) {
+    return false;
 }
 
-void VirtualMMU::write16(uint64_t address, uint16_t data) {
-    m_physicalMMU->write16(TranslateAddress(address, PageTranslateMode::Write), data);
+bool VirtualMMU::ReaddRegionSegment(void*) {
+    return false;
 }
 
-void VirtualMMU::write32(uint64_t address, uint32_t data) {
-    m_physicalMMU->write32(TranslateAddress(address, PageTranslateMode::Write), data);
+void VirtualMMU::SetPageTableRoot(uint64_t pageTableRoot, uint16_t asid, bool keepTranslations) {
+    m_pageTableRoot = pageTableRoot;
+    m_asid = asid;
+    if (!keepTranslations)
+        FlushAddressSpace(asid);
 }
 
-void VirtualMMU::write64(uint64_t address, uint64_t data) {
-    m_physicalMMU->write64(TranslateAddress(address, PageTranslateMode::Write), data);
+void VirtualMMU::InvalidatePage(uint64_t address) {
+    uint64_t page = address >> m_pageShift;
+    TLBEntry& entry = m_tlb[(page ^ m_asid) & (VMMU_TLB_SIZE - 1)];
+    if (entry.page == page && entry.asid == m_asid)
+        entry.page = UINT64_MAX;
+
+    // other pages of a large mapping are cached under their own entries
+    if (m_largeMappings) {
+        for (TLBEntry& other : m_tlb) {
+            if (other.page != UINT64_MAX && other.mappingShift > 0 && other.asid == m_asid && (other.page >> other.mappingShift) == (page >> other.mappingShift))
+                other.page = UINT64_MAX;
+        }
+    }
+
+    for (uint8_t level = 0; level < m_levelCount - 1; level++) {
+        uint64_t prefix = page >> (10 * (m_levelCount - level - 1));
+        WalkCacheEntry& cached = m_walkCache[level][(prefix ^ m_asid) & (VMMU_WALK_CACHE_SIZE - 1)];
+        if (cached.prefix == prefix && cached.asid == m_asid)
+            cached.prefix = UINT64_MAX;
+    }
 }
 
-bool VirtualMMU::ValidateRead(uint64_t address, size_t size) {
-    uint64_t pageSize = 0;
-    switch (m_pageSize) {
-    case PS_4KiB:
-        pageSize = 4'096;
-        break;
-    case PS_16KiB:
-        pageSize = 16'384;
-        break;
-    case PS_64KiB:
-        pageSize = 65'536;
-        break;
-    default:
-        Emulator::Crash("Invalid page size");
+void VirtualMMU::FlushAddressSpace(uint16_t asid) {
+    for (TLBEntry& entry : m_tlb) {
+        if (entry.asid == asid)
+            entry.page = UINT64_MAX;
     }
-    uint64_t start = ALIGN_DOWN_BASE2(address, pageSize);
-    uint64_t end = ALIGN_UP_BASE2(address + size, pageSize);
-    for (uint64_t i = start; i < end; i += pageSize) {
-        bool success = false;
-        TranslateAddress(i, PageTranslateMode::Read, true, &success);
-        if (!success)
-            return false;
+    bool walkCacheEmpty = true;
+    for (auto& level : m_walkCache) {
+        for (WalkCacheEntry& entry : level) {
+            if (entry.asid == asid)
+                entry.prefix = UINT64_MAX;
+            else if (entry.prefix != UINT64_MAX)
+                walkCacheEmpty = false;
+        }
     }
-    return true;
+    if (walkCacheEmpty)
+        m_tablePages.clear();
+    Increment(g_TLBFlushes);
 }
 
-bool VirtualMMU::ValidateWrite(uint64_t address, size_t size) {
-    uint64_t pageSize = 0;
-    switch (m_pageSize) {
-    case PS_4KiB:
-        pageSize = 4'096;
-        break;
-    case PS_16KiB:
-        pageSize = 16'384;
-        break;
-    case PS_64KiB:
-        pageSize = 65'536;
-        break;
-    default:
-        Emulator::Crash("Invalid page size");
-    }
-    uint64_t start = ALIGN_DOWN_BASE2(address, pageSize);
-    uint64_t end = ALIGN_UP_BASE2(address + size, pageSize);
-    for (uint64_t i = start; i < end; i += pageSize) {
-        bool success = false;
-        TranslateAddress(i, PageTranslateMode::Write, true, &success);
-        if (!success)
-            return false;
+void VirtualMMU::FlushTLB() {
+    for (TLBEntry& entry : m_tlb)
+        entry.page = UINT64_MAX;
+    m_largeMappings = false;
+    m_layoutGeneration = m_physicalMMU->GetLayoutGeneration();
+    Increment(g_TLBFlushes);
+    FlushWalkCache();
+}
+
+void VirtualMMU::FlushWalkCache() {
+    for (auto& level : m_walkCache) {
+        for (WalkCacheEntry& entry : level)
+            entry.prefix = UINT64_MAX;
     }
+    m_tablePages.clear();
+    Increment(g_WalkCacheFlushes);
+}
+
+void VirtualMMU::PrintTLBStatistics(void (*write)(void* data, const char* format, ...), void* data) {
+    uint64_t hits = g_TLBHits.load(std::memory_order_relaxed);
+    uint64_t misses = g_TLBMisses.load(std::memory_order_relaxed);
+    write(data, "TLB: %lu entries\n", static_cast<uint64_t>(VMMU_TLB_SIZE));
+    write(data, "Hits: %lu\n", hits);
+    write(data, "Misses: %lu\n", misses);
+    if (hits + misses > 0)
+        write(data, "Hit rate: %.2f%%\n", 100.0 * hits / (hits + misses));
+    write(data, "Flushes: %lu\n", g_TLBFlushes.load(std::memory_order_relaxed));
+    write(data, "Walk cache: %lu entries per level\n", static_cast<uint64_t>(VMMU_WALK_CACHE_SIZE));
+    write(data, "Walk cache hits: %lu\n", g_WalkCacheHits.load(std::memory_order_relaxed));
+    write(data, "Walk cache flushes: %lu\n", g_WalkCacheFlushes.load(std::memory_order_relaxed));
+}
+
+bool VirtualMMU::GetNextTableLevel(PageTableEntry table, uint64_t tableIndex, PageTableEntry* out) const { // tableIndex = index within table
+    assert(tableIndex < 1'024);
+
+    if (!table.Present)
+        return false;
+
+    if (table.Lowest)
+        return false; // should already be handled by the caller
+
+    // data structure for PageTableEntry only supports 4KiB pages, so just shift by 12
+    if (!m_physicalMMU->ValidateRead(((uint64_t)table.PhysicalAddress << 12) + tableIndex * 8, 8))
+        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, ((uint64_t)table.PhysicalAddress << 12) + tableIndex * 8);
+
+    uint64_t raw = m_physicalMMU->read64(((uint64_t)table.PhysicalAddress << 12) + tableIndex * 8);
+    PageTableEntry* temp = reinterpret_cast<PageTableEntry*>(&raw);
+    if (out != nullptr)
+        *out = *temp;
     return true;
 }
 
-bool VirtualMMU::ValidateExecute(uint64_t address, size_t size) {
-    uint64_t pageSize = 0;
-    switch (m_pageSize) {
-    case PS_4KiB:
-        pageSize = 4'096;
-        break;
-    case PS_16KiB:
-        pageSize = 16'384;
-        break;
-    case PS_64KiB:
-        pageSize = 65'536;
-        break;
-    default:
-        Emulator::Crash("Invalid page size");
+template <PageSize Size, PageTableLevelCount Levels>
+PagingMMU<Size, Levels>::PagingMMU(MMU* physicalMMU, uint64_t pageTableRoot)
+    : VirtualMMU(physicalMMU, pageTableRoot, PageShift, LevelCount) {
+}
+
+template <PageSize Size, PageTableLevelCount Levels>
+void PagingMMU<Size, Levels>::ReadBuffer(uint64_t address, uint8_t* data, size_t size) {
+    while (size > 0) {
+        uint64_t physical;
+        uint8_t* host;
+        size_t runSize = TranslateRun(address, size, PageTranslateMode::Read, physical, host);
+        if (host != nullptr)
+            memcpy(data, host, runSize);
+        else
+            m_physicalMMU->ReadBuffer(physical, data, runSize);
+        address += runSize;
+        data += runSize;
+        size -= runSize;
     }
+}
+
+template <PageSize Size, PageTableLevelCount Levels>
+void PagingMMU<Size, Levels>::WriteBuffer(uint64_t address, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        uint64_t physical;
+        uint8_t* host;
+        size_t runSize = TranslateRun(address, size, PageTranslateMode::Write, physical, host);
+        if (host != nullptr)
+            memcpy(host, data, runSize);
+        else {
+            m_physicalMMU->WriteBuffer(physical, data, runSize);
+            CheckPageTableStore(physical, runSize);
+        }
+        address += runSize;
+        data += runSize;
+        size -= runSize;
+    }
+}
+
+template <PageSize Size, PageTableLevelCount Levels>
+bool PagingMMU<Size, Levels>::ValidateRead(uint64_t address, size_t size) {
+    return Validate(address, size, PageTranslateMode::Read);
+}
+
+template <PageSize Size, PageTableLevelCount Levels>
+bool PagingMMU<Size, Levels>::ValidateWrite(uint64_t address, size_t size) {
+    return Validate(address, size, PageTranslateMode::Write);
+}
+
+template <PageSize Size, PageTableLevelCount Levels>
+bool PagingMMU<Size, Levels>::ValidateExecute(uint64_t address, size_t size) {
+    return Validate(address, size, PageTranslateMode::Execute);
+}
+
+template <PageSize Size, PageTableLevelCount Levels>
+bool PagingMMU<Size, Levels>::Validate(uint64_t address, size_t size, PageTranslateMode mode) {
+    constexpr uint64_t pageSize = 1ULL << PageShift;
     uint64_t start = ALIGN_DOWN_BASE2(address, pageSize);
     uint64_t end = ALIGN_UP_BASE2(address + size, pageSize);
     for (uint64_t i = start; i < end; i += pageSize) {
         bool success = false;
-        TranslateAddress(i, PageTranslateMode::Execute, true, &success);
+        TranslateAddress(i, mode, true, &success);
         if (!success)
             return false;
     }
     return true;
 }
 
-void VirtualMMU::AddMemoryRegion(MemoryRegion* region) {
-    (void)region;
-}
-
-void VirtualMMU::RemoveMemoryRegion(MemoryRegion* region) {
-    (void)region;
+template <PageSize Size, PageTableLevelCount Levels>
+void PagingMMU<Size, Levels>::CacheWalkEntry(uint8_t level, uint64_t page, PageTableEntry table, uint8_t permissions, uint64_t entryAddress) {
+    uint64_t prefix = page >> (10 * (LevelCount - level - 1));
+    WalkCacheEntry& entry = m_walkCache[level][(prefix ^ m_asid) & (VMMU_WALK_CACHE_SIZE - 1)];
+    entry.prefix = prefix;
+    entry.table = table;
+    entry.asid = m_asid;
+    entry.permissions = permissions;
+
+    // make sure stores to the table are seen, including through translations that are already cached
+    uint64_t tablePage = entryAddress >> PageShift;
+    if (m_tablePages.insert(tablePage).second) {
+        for (TLBEntry& tlbEntry : m_tlb) {
+            if (tlbEntry.page != UINT64_MAX && tlbEntry.physicalPage == tablePage)
+                tlbEntry.pageTable = true;
+        }
+    }
 }
 
-void VirtualMMU::DumpMemory(FILE*) const {
+template <PageSize Size, PageTableLevelCount Levels>
+void PagingMMU<Size, Levels>::CheckPageTableStore(uint64_t address, size_t size) {
+    if (m_tablePages.empty() || size == 0)
+        return;
+    for (uint64_t page = address >> PageShift; page <= (address + size - 1) >> PageShift; page++) {
+        if (m_tablePages.contains(page)) {
+            FlushWalkCache();
+            return;
+        }
+    }
 }
 
-bool VirtualMMU::RemoveRegionSegment(uint64_t, uint64_t, void**) {
-    return false;
+template <PageSize Size, PageTableLevelCount Levels>
+size_t PagingMMU<Size, Levels>::TranslateRun(uint64_t address, size_t size, PageTranslateMode mode, uint64_t& physical, uint8_t*& host) {
+    constexpr uint64_t pageSize = 1ULL << PageShift;
+    const TLBEntry* entry = LookupTLB(address, mode, false);
+    uint64_t offset = address & (pageSize - 1);
+    physical = (entry->physicalPage << PageShift) | offset;
+    bool direct = entry->host != nullptr && !(mode == PageTranslateMode::Write && entry->pageTable);
+    host = direct ? entry->host + offset : nullptr;
+
+    // extend the run while the following pages are next to each other in physical memory and can be accessed the same way
+    uint64_t nextPhysicalPage = entry->physicalPage + 1;
+    uint8_t* nextHost = direct ? entry->host + pageSize : nullptr;
+    size_t runSize = std::min<uint64_t>(pageSize - offset, size);
+    while (runSize < size) {
+        entry = LookupTLB(address + runSize, mode, false);
+        bool nextDirect = entry->host != nullptr && !(mode == PageTranslateMode::Write && entry->pageTable);
+        if (entry->physicalPage != nextPhysicalPage || nextDirect != direct || (direct && entry->host != nextHost))
+            break;
+        runSize += std::min<uint64_t>(pageSize, size - runSize);
+        nextPhysicalPage++;
+        if (direct)
+            nextHost += pageSize;
+    }
+    return runSize;
 }
 
-bool VirtualMMU::ReaddRegionSegment(void*) {
-    return false;
+template <PageSize Size, PageTableLevelCount Levels>
+const TLBEntry* PagingMMU<Size, Levels>::MissTLB(uint64_t address, PageTranslateMode mode, bool safe, uint8_t required, TLBEntry& entry) {
+    // a cached entry without the permission is walked again, the tables may have been made more permissive since
+    Increment(g_TLBMisses);
+    if (!WalkPageTables(address >> PageShift, required, entry)) {
+        if (safe)
+            return nullptr;
+        PagingViolationErrorCode code = {false, false, false, false, false, false, 0};
+        code.read = mode == PageTranslateMode::Read;
+        code.write = mode == PageTranslateMode::Write;
+        code.execute = mode == PageTranslateMode::Execute;
+        code.user = (required & TLB_USER) > 0;
+        g_ExceptionHandler->RaiseException(Exception::PAGING_VIOLATION, address, code);
+    }
+    return &entry;
 }
 
-void VirtualMMU::SetPageTableRoot(uint64_t pageTableRoot) {
-    m_pageTableRoot = pageTableRoot;
+template <PageSize Size, PageTableLevelCount Levels>
+uint64_t PagingMMU<Size, Levels>::TranslateAddress(uint64_t address, PageTranslateMode mode, bool safe, bool* success) {
+    const TLBEntry* entry = LookupTLB(address, mode, safe);
+    if (safe && success != nullptr)
+        *success = entry != nullptr;
+    if (entry == nullptr)
+        return 0;
+    return (entry->physicalPage << PageShift) | (address & ((1ULL << PageShift) - 1));
 }
 
-uint64_t VirtualMMU::TranslateAddress(uint64_t address, PageTranslateMode mode, bool safe, bool* success) const {
-    uint8_t levelCount = 0;
-    switch (m_pageTableLevelCount) {
-    case PTLC_3:
-        levelCount = 3;
-        break;
-    case PTLC_4:
-        levelCount = 4;
-        break;
-    case PTLC_5:
-        levelCount = 5;
-        break;
-    default:
-        assert(false); // deal with error handling later...
-    }
-    uint64_t page = 0;
-    uint16_t offset = 0;
-    uint8_t pageShift = 0;
-    switch (m_pageSize) {
-    case PS_4KiB:
-        page = address >> 12;
-        offset = address & 0xFFF;
-        pageShift = 12;
-        break;
-    case PS_16KiB:
-        page = address >> 14;
-        offset = address & 0x3FFF;
-        pageShift = 14;
-        break;
-    case PS_64KiB:
-        page = address >> 16;
-        offset = address & 0xFFFF;
-        pageShift = 16;
-        break;
-    default:
-        assert(false); // deal with error handling later...
-    }
-    bool inUserMode = Emulator::isInProtectedMode() && Emulator::isInUserMode();
+template <PageSize Size, PageTableLevelCount Levels>
+bool PagingMMU<Size, Levels>::WalkPageTables(uint64_t page, uint8_t required, TLBEntry& entry) {
+    uint8_t permissions = TLB_READ | TLB_WRITE | TLB_EXECUTE | TLB_USER;
     PageTableEntry table;
-    uint64_t physicalAddress = 0;
-    for (uint8_t i = 0; i < levelCount; i++) {
-        uint64_t index = (page >> (10 * (levelCount - i - 1))) & 0x3FF;
+    uint64_t physicalPage = 0;
+    uint8_t mappingShift = 0;
+
+    // resume from the lowest level that is cached, usually leaving only the last level to read
+    uint8_t start = 0;
+    for (uint8_t level = LevelCount - 1; level > 0; level--) {
+        uint64_t prefix = page >> (10 * (LevelCount - level));
+        const WalkCacheEntry& cached = m_walkCache[level - 1][(prefix ^ m_asid) & (VMMU_WALK_CACHE_SIZE - 1)];
+        if (cached.prefix == prefix && cached.asid == m_asid) {
+            table = cached.table;
+            permissions = cached.permissions;
+            physicalPage = table.PhysicalAddress >> (PageShift - 12);
+            start = level;
+            Increment(g_WalkCacheHits);
+            break;
+        }
+    }
+    if ((permissions & required) != required)
+        return false;
+
+    for (uint8_t i = start; i < LevelCount; i++) {
+        uint64_t index = (page >> (10 * (LevelCount - i - 1))) & 0x3FF;
+        uint64_t entryAddress = 0;
         if (i == 0) {
             // need to fetch the table from guest memory
-            if (!m_physicalMMU->ValidateRead(m_pageTableRoot + index * 8, 8))
-                g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, m_pageTableRoot + index * 8);
+            entryAddress = m_pageTableRoot + index * 8;
+            if (!m_physicalMMU->ValidateRead(entryAddress, 8))
+                g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, entryAddress);
             {
-                uint64_t raw = m_physicalMMU->read64(m_pageTableRoot + index * 8);
+                uint64_t raw = m_physicalMMU->read64(entryAddress);
                 PageTableEntry* temp = reinterpret_cast<PageTableEntry*>(&raw);
                 table = *temp;
             }
         } else if (table.Lowest) {
-            if (safe && success != nullptr)
-                *success = true;
-            return (((table.PhysicalAddress >> (pageShift - 12)) | (page & ((1 << (10 * (i - 1))) - 1))) << pageShift) | offset;
-        } else if (!GetNextTableLevel(table, index, &table)) {
-            if (safe) {
-                if (success != nullptr)
-                    *success = false;
-                return 0;
-            }
-            PagingViolationErrorCode code = {false, false, false, false, false, false, 0};
-            code.read = mode == PageTranslateMode::Read;
-            code.write = mode == PageTranslateMode::Write;
-            code.execute = mode == PageTranslateMode::Execute;
-            code.user = inUserMode;
-            g_ExceptionHandler->RaiseException(Exception::PAGING_VIOLATION, address, code);
-        }
-        if (!table.Present) {
-            if (safe) {
-                if (success != nullptr)
-                    *success = false;
-                return 0;
-            }
-            PagingViolationErrorCode code = {false, false, false, false, false, false, 0};
-            code.read = mode == PageTranslateMode::Read;
-            code.write = mode == PageTranslateMode::Write;
-            code.execute = mode == PageTranslateMode::Execute;
-            code.user = inUserMode;
-            g_ExceptionHandler->RaiseException(Exception::PAGING_VIOLATION, address, code);
-        }
-        if ((!table.Readable && mode == PageTranslateMode::Read) || (!table.Writable && mode == PageTranslateMode::Write) || (!table.Executable && mode == PageTranslateMode::Execute) || (inUserMode && !table.User)) {
-            if (safe) {
-                if (success != nullptr)
-                    *success = false;
-                return 0;
-            }
-            PagingViolationErrorCode code = {false, false, false, false, false, false, 0};
-            code.read = mode == PageTranslateMode::Read;
-            code.write = mode == PageTranslateMode::Write;
-            code.execute = mode == PageTranslateMode::Execute;
-            code.user = inUserMode;
-            g_ExceptionHandler->RaiseException(Exception::PAGING_VIOLATION, address, code);
+            physicalPage = (table.PhysicalAddress >> (PageShift - 12)) | (page & ((1ULL << (10 * (i - 1))) - 1));
+            mappingShift = 10 * (LevelCount - i);
+            m_largeMappings = true;
+            break;
+        } else {
+            entryAddress = ((uint64_t)table.PhysicalAddress << 12) + index * 8;
+            if (!GetNextTableLevel(table, index, &table))
+                return false;
         }
-        physicalAddress = table.PhysicalAddress >> (pageShift - 12);
+        if (!table.Present)
+            return false;
+        // every level has to allow the access, so stop as soon as one doesn't
+        permissions &= (table.Readable ? TLB_READ : 0) | (table.Writable ? TLB_WRITE : 0) | (table.Executable ? TLB_EXECUTE : 0) | (table.User ? TLB_USER : 0);
+        if ((permissions & required) != required)
+            return false;
+        physicalPage = table.PhysicalAddress >> (PageShift - 12);
+        if (i < LevelCount - 1)
+            CacheWalkEntry(i, page, table, permissions, entryAddress);
     }
-    if (safe && success != nullptr)
-        *success = true;
-    return (physicalAddress << pageShift) | offset;
-}
-
-bool VirtualMMU::GetNextTableLevel(PageTableEntry table, uint64_t tableIndex, PageTableEntry* out) const { // tableIndex = index within table
-    assert(tableIndex < 1'024);
 
-    if (!table.Present)
-        return false;
-
-    if (table.Lowest)
-        return false; // should already be handled by the caller
-
-    // data structure for PageTableEntry only supports 4KiB pages, so just shift by 12
-    if (!m_physicalMMU->ValidateRead(((uint64_t)table.PhysicalAddress << 12) + tableIndex * 8, 8))
-        g_ExceptionHandler->RaiseException(Exception::PHYS_MEM_VIOLATION, ((uint64_t)table.PhysicalAddress << 12) + tableIndex * 8);
-
-    uint64_t raw = m_physicalMMU->read64(((uint64_t)table.PhysicalAddress << 12) + tableIndex * 8);
-    PageTableEntry* temp = reinterpret_cast<PageTableEntry*>(&raw);
-    if (out != nullptr)
-        *out = *temp;
+    entry.page = page;
+    entry.asid = m_asid;
+    entry.physicalPage = physicalPage;
+    entry.host = m_physicalMMU->GetHostPointer(physicalPage << PageShift, 1ULL << PageShift);
+    entry.permissions = permissions;
+    entry.pageTable = m_tablePages.contains(physicalPage);
+    entry.mappingShift = mappingShift;
     return true;
 }
+
+// every supported configuration, 64KiB pages can't be used with 5 levels
+template class PagingMMU<PS_4KiB, PTLC_3>;
+template class PagingMMU<PS_4KiB, PTLC_4>;
+template class PagingMMU<PS_4KiB, PTLC_5>;
+template class PagingMMU<PS_16KiB, PTLC_3>;
+template class PagingMMU<PS_16KiB, PTLC_4>;
+template class PagingMMU<PS_16KiB, PTLC_5>;
+template class PagingMMU<PS_64KiB, PTLC_3>;
+template class PagingMMU<PS_64KiB, PTLC_4>;
@@ -18,8 +18,24 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef _VIRTUAL_MMU_HPP
 #define _VIRTUAL_MMU_HPP
 
+#include <atomic>
+#include <cstring>
+#include <unordered_set>
+
+#include <Emulator.hpp>
+
 #include "MMU.hpp"
 
+// Number of translations cached, must be a power of 2
+#define VMMU_TLB_SIZE 256
+// Number of entries cached for each upper page table level, must be a power of 2
+#define VMMU_WALK_CACHE_SIZE 64
+#define VMMU_MAX_LEVELS 5
+
+// CR3 layout when address space IDs are enabled in CR0
+#define CR3_ASID_MASK 0xFFF
+#define CR3_KEEP_TRANSLATIONS (1ULL << 63)
+
 struct PageTableEntry {
     bool Present             : 1;
     bool Readable            : 1;
@@ -49,51 +65,193 @@ enum class PageTranslateMode {
     Execute
 };
 
+enum TLBPermissions : uint8_t {
+    TLB_READ = 1,
+    TLB_WRITE = 2,
+    TLB_EXECUTE = 4,
+    TLB_USER = 8
+};
+
+struct TLBEntry {
+    uint64_t page; // virtual page number, UINT64_MAX if the entry is empty
+    uint64_t physicalPage;
+    uint8_t* host; // the page in host memory if it is plain RAM, otherwise nullptr
+    uint16_t asid;
+    uint8_t permissions; // TLBPermissions allowed by every level of the walk
+    bool pageTable; // the page holds cached page table entries, so writes take the slow path
+    uint8_t mappingShift; // virtual pages share the mapping when they match above this many bits, 0 unless it is a large mapping
+};
+
+struct WalkCacheEntry {
+    uint64_t prefix; // virtual page number shifted down to this level, UINT64_MAX if the entry is empty
+    PageTableEntry table; // entry at this level, refers to the next level or is the lowest level
+    uint16_t asid;
+    uint8_t permissions; // TLBPermissions allowed by this level and every level above it
+};
+
+// counted inline by PagingMMU, the other counters are private to VirtualMMU.cpp
+extern std::atomic_uint64_t g_TLBHits;
+
+/*
+ * State and maintenance shared by every paging configuration.
+ * Translation itself is done by PagingMMU, which is instantiated for each page size and level count.
+ */
 class VirtualMMU : public MMU {
    public:
-    VirtualMMU(MMU* physicalMMU, uint64_t pageTableRoot, PageSize pageSize, PageTableLevelCount pageTableLevelCount);
     virtual ~VirtualMMU() override;
 
+    virtual void AddMemoryRegion(MemoryRegion* region) override; // disabled
+    virtual void RemoveMemoryRegion(MemoryRegion* region) override; // disabled
+    virtual void AddRAM(uint64_t start, uint64_t end) override; // disabled
+    virtual bool DiscardRAM(uint64_t start, uint64_t end) override; // disabled
+    virtual bool MapFileIntoRAM(uint64_t start, uint64_t end, FileHandle_t handle, size_t offset, bool shared = false) override; // disabled
+
+    virtual void DumpMemory(FILE* fp) const override;
+
+    virtual bool RemoveRegionSegment(uint64_t, uint64_t, void**) override;
+    virtual bool ReaddRegionSegment(void*) override;
+
+    /*
+     * Translations are tagged with asid, so switching back to an address space can reuse them.
+     * Unless keepTranslations is set, any already cached for asid are flushed, which is how the guest makes page table changes take effect.
+     */
+    void SetPageTableRoot(uint64_t pageTableRoot, uint16_t asid = 0, bool keepTranslations = false);
+
+    // Flushes the translation of address in the current address space, including the upper levels and the rest of a large mapping
+    void InvalidatePage(uint64_t address);
+    void FlushAddressSpace(uint16_t asid);
+
+    // Flushes every address space, and the page walk cache
+    void FlushTLB();
+    void FlushWalkCache();
+
+    // Counters cover every VirtualMMU, as one is created each time paging is enabled
+    static void PrintTLBStatistics(void (*write)(void* data, const char* format, ...), void* data);
+
+   protected:
+    VirtualMMU(MMU* physicalMMU, uint64_t pageTableRoot, uint8_t pageShift, uint8_t levelCount);
+
+    bool GetNextTableLevel(PageTableEntry table, uint64_t tableIndex, PageTableEntry* out) const;
+
+   protected:
+    MMU* m_physicalMMU;
+    uint64_t m_pageTableRoot;
+    uint16_t m_asid;
+
+    uint8_t m_pageShift;
+    uint8_t m_levelCount;
+
+    TLBEntry m_tlb[VMMU_TLB_SIZE];
+    // level 0 is the top level, the lowest level is never cached here as it is in the TLB
+    WalkCacheEntry m_walkCache[VMMU_MAX_LEVELS - 1][VMMU_WALK_CACHE_SIZE];
+    std::unordered_set<uint64_t> m_tablePages; // physical pages holding entries in the walk cache
+    uint64_t m_layoutGeneration; // of the physical MMU when the host pointers were cached
+    bool m_largeMappings; // the TLB may hold large mappings, which invalidating one page has to search for
+};
+
+/*
+ * Translation for one paging configuration, so the page size and level count are constants rather than checked on each access.
+ * Instantiated in VirtualMMU.cpp for every supported combination.
+ */
+template <PageSize Size, PageTableLevelCount Levels>
+class PagingMMU final : public VirtualMMU {
+   public:
+    static constexpr uint8_t PageShift = Size == PS_4KiB ? 12 : (Size == PS_16KiB ? 14 : 16);
+    static constexpr uint8_t LevelCount = Levels == PTLC_3 ? 3 : (Levels == PTLC_4 ? 4 : 5);
+    static_assert(Size != PS_64KiB || Levels != PTLC_5, "64KiB pages cannot be used with 5 levels");
+
+    PagingMMU(MMU* physicalMMU, uint64_t pageTableRoot);
+
     virtual void ReadBuffer(uint64_t address, uint8_t* data, size_t size) override;
     virtual void WriteBuffer(uint64_t address, const uint8_t* data, size_t size) override;
 
-    virtual uint8_t read8(uint64_t address) override;
-    virtual uint16_t read16(uint64_t address) override;
-    virtual uint32_t read32(uint64_t address) override;
-    virtual uint64_t read64(uint64_t address) override;
+    virtual uint8_t read8(uint64_t address) override { return read<uint8_t>(address); }
+    virtual uint16_t read16(uint64_t address) override { return read<uint16_t>(address); }
+    virtual uint32_t read32(uint64_t address) override { return read<uint32_t>(address); }
+    virtual uint64_t read64(uint64_t address) override { return read<uint64_t>(address); }
 
-    virtual void write8(uint64_t address, uint8_t data) override;
-    virtual void write16(uint64_t address, uint16_t data) override;
-    virtual void write32(uint64_t address, uint32_t data) override;
-    virtual void write64(uint64_t address, uint64_t data) override;
+    virtual void write8(uint64_t address, uint8_t data) override { write<uint8_t>(address, data); }
+    virtual void write16(uint64_t address, uint16_t data) override { write<uint16_t>(address, data); }
+    virtual void write32(uint64_t address, uint32_t data) override { write<uint32_t>(address, data); }
+    virtual void write64(uint64_t address, uint64_t data) override { write<uint64_t>(address, data); }
 
     virtual bool ValidateRead(uint64_t address, size_t size) override;
     virtual bool ValidateWrite(uint64_t address, size_t size) override;
     virtual bool ValidateExecute(uint64_t address, size_t size) override;
 
-    virtual void AddMemoryRegion(MemoryRegion* region) override; // disabled
-    virtual void RemoveMemoryRegion(MemoryRegion* region) override; // disabled
+    // Non-virtual forms of MMU::read<T> and MMU::write<T>, for callers that know the configuration
+    template <typename T>
+    T read(uint64_t address) {
+        uint64_t physical;
+        if (uint8_t* host = TranslateFast(address, sizeof(T), PageTranslateMode::Read, physical); host != nullptr) {
+            T data;
+            memcpy(&data, host, sizeof(T));
+            return data;
+        }
+        return m_physicalMMU->ReadPhysical<T>(physical);
+    }
 
-    virtual void DumpMemory(FILE* fp) const override;
-
-    virtual bool RemoveRegionSegment(uint64_t, uint64_t, void**) override;
-    virtual bool ReaddRegionSegment(void*) override;
-
-    void SetPageTableRoot(uint64_t pageTableRoot);
+    template <typename T>
+    void write(uint64_t address, T data) {
+        uint64_t physical;
+        if (uint8_t* host = TranslateFast(address, sizeof(T), PageTranslateMode::Write, physical); host != nullptr) {
+            memcpy(host, &data, sizeof(T));
+            return;
+        }
+        m_physicalMMU->WritePhysical<T>(physical, data);
+        CheckPageTableStore(physical, sizeof(T));
+    }
 
    private:
     /*
      * safe flag prevents Paging Violation exceptions, but not Physical Memory Violation exceptions.
      * success is only written to when not nullptr and safe is true.
      */
-    uint64_t TranslateAddress(uint64_t address, PageTranslateMode mode, bool safe = false, bool* success = nullptr) const;
-    bool GetNextTableLevel(PageTableEntry table, uint64_t tableIndex, PageTableEntry* out) const;
+    uint64_t TranslateAddress(uint64_t address, PageTranslateMode mode, bool safe = false, bool* success = nullptr);
+    bool Validate(uint64_t address, size_t size, PageTranslateMode mode);
 
-   private:
-    MMU* m_physicalMMU;
-    uint64_t m_pageTableRoot;
-    PageSize m_pageSize;
-    PageTableLevelCount m_pageTableLevelCount;
+    // Returns nullptr instead of raising a Paging Violation when safe is set
+    const TLBEntry* LookupTLB(uint64_t address, PageTranslateMode mode, bool safe) {
+        // host pointers are stale once the physical regions change
+        if (m_layoutGeneration != m_physicalMMU->GetLayoutGeneration())
+            FlushTLB();
+
+        uint8_t required = mode == PageTranslateMode::Read ? TLB_READ : (mode == PageTranslateMode::Write ? TLB_WRITE : TLB_EXECUTE);
+        if (Emulator::isInProtectedMode() && Emulator::isInUserMode())
+            required |= TLB_USER;
+
+        uint64_t page = address >> PageShift;
+        TLBEntry& entry = m_tlb[(page ^ m_asid) & (VMMU_TLB_SIZE - 1)];
+        if (entry.page == page && entry.asid == m_asid && (entry.permissions & required) == required) {
+            g_TLBHits.store(g_TLBHits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return &entry;
+        }
+        return MissTLB(address, mode, safe, required, entry);
+    }
+    // Walks the page tables into entry, raising a Paging Violation if they don't allow the access
+    const TLBEntry* MissTLB(uint64_t address, PageTranslateMode mode, bool safe, uint8_t required, TLBEntry& entry);
+    // Fills entry if the page tables allow the access, returns false if they don't
+    bool WalkPageTables(uint64_t page, uint8_t required, TLBEntry& entry);
+    void CacheWalkEntry(uint8_t level, uint64_t page, PageTableEntry table, uint8_t permissions, uint64_t entryAddress);
+    // Flushes the page walk cache if the physical range holds any cached page table entries
+    void CheckPageTableStore(uint64_t address, size_t size);
+
+    // Host pointer to size bytes at address if they are in one RAM page, otherwise nullptr. physical is set either way.
+    uint8_t* TranslateFast(uint64_t address, size_t size, PageTranslateMode mode, uint64_t& physical) {
+        const TLBEntry* entry = LookupTLB(address, mode, false);
+        uint64_t offset = address & ((1ULL << PageShift) - 1);
+        physical = (entry->physicalPage << PageShift) | offset;
+        // accesses running into the next page take the slow path, as do stores to page tables
+        if (entry->host == nullptr || offset + size > (1ULL << PageShift) || (mode == PageTranslateMode::Write && entry->pageTable))
+            return nullptr;
+        return entry->host + offset;
+    }
+    /*
+     * Translates the pages from address that follow on from each other in physical memory, up to size bytes.
+     * Every page is checked for mode. Returns the number of bytes translated.
+     * host is set if the whole run can be accessed directly in host memory, otherwise nullptr.
+     */
+    size_t TranslateRun(uint64_t address, size_t size, PageTranslateMode mode, uint64_t& physical, uint8_t*& host);
 };
 
 #endif /* _VIRTUAL_MMU_HPP */
\ No newline at end of file
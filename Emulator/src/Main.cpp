@@ -24,6 +24,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <cstring>
 #include <Emulator.hpp>
 #include <IO/Devices/Video/VideoBackend.hpp>
+#include <IO/Devices/Video/backends/Headless/HeadlessVideoBackend.hpp>
+#include <OSSpecific/Memory.hpp>
 
 #define MAX_PROGRAM_FILE_SIZE 0x1000'0000
 #define MIN_PROGRAM_FILE_SIZE 1
@@ -31,16 +33,16 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #define DEFAULT_RAM MiB(1)
 
 #if defined(ENABLE_SDL) && defined(ENABLE_XCB)
-    #define DISPLAY_HELP_TEXT R"(Display mode. Valid values are "sdl", "xcb", or "none" (case insensitive).)"
+    #define DISPLAY_HELP_TEXT R"(Display mode. Valid values are "sdl", "xcb", "headless", or "none" (case insensitive).)"
 #define DISPLAY_TYPE_CHECKS if (display == "sdl") displayType = VideoBackendType::SDL; else if (display == "xcb") displayType = VideoBackendType::XCB;
 #elif defined(ENABLE_SDL)
-    #define DISPLAY_HELP_TEXT R"(Display mode. Valid values are "sdl" or "none" (case insensitive).)"
+    #define DISPLAY_HELP_TEXT R"(Display mode. Valid values are "sdl", "headless", or "none" (case insensitive).)"
 #define DISPLAY_TYPE_CHECKS if (display == "sdl") displayType = VideoBackendType::SDL;
 #elif defined(ENABLE_XCB)
-    #define DISPLAY_HELP_TEXT R"(Display mode. Valid values are "xcb" or "none" (case insensitive).)"
+    #define DISPLAY_HELP_TEXT R"(Display mode. Valid values are "xcb", "headless", or "none" (case insensitive).)"
 #define DISPLAY_TYPE_CHECKS if (display == "xcb") displayType = VideoBackendType::XCB;
 #else
-    #define DISPLAY_HELP_TEXT R"(Display mode. Valid value is "none" (case insensitive).)"
+    #define DISPLAY_HELP_TEXT R"(Display mode. Valid values are "headless" or "none" (case insensitive).)"
 #define DISPLAY_TYPE_CHECKS if constexpr (false) ;
 #endif
 
@@ -50,10 +52,18 @@ int main(int argc, char** argv) {
     g_args = new ArgsParser();
     g_args->AddOption('p', "program", "Program file to run", true);
     g_args->AddOption('m', "ram", "RAM size in bytes", false);
+    g_args->AddOption(0, "ram-image", "File with the initial contents of RAM, in the order the guest adds it. It is mapped copy-on-write, so instances using the same image share its pages. The RAM size defaults to the image size.", false);
     g_args->AddOption('d', "display", DISPLAY_HELP_TEXT, false);
+    g_args->AddOption(0, "frame-dump", "File or pipe to write frames from the headless display to.", false);
+    g_args->AddOption(0, "frame-dump-format", R"(Format of dumped frames. Valid values are "ppm" (default) or "raw" (case insensitive).)", false);
+    g_args->AddOption(0, "frame-dump-interval", "Dump every Nth frame. Default is 0, which only dumps frames requested from the debug console.", false);
+    g_args->AddOption(0, "ram-export", "File to publish a map of guest RAM to, so other local processes can map it read-only while the emulator runs. RAM is kept in shared memory when this is set.", false);
+    g_args->AddOption(0, "huge-pages", R"(Host huge pages for guest RAM. Valid values are "none" (default), "transparent", or "explicit", which takes pages from the host's huge page pool and falls back to "transparent" (case insensitive).)", false);
+    g_args->AddOption(0, "prefault-ram", "Fault all guest RAM in on the host when it is allocated.", false, false);
+    g_args->AddOption(0, "lock-ram", "Lock guest RAM into host memory, which also faults it in.", false, false);
     g_args->AddOption('D', "drive", "File to use as a storage drive.", false);
-    g_args->AddOption('c', "console", R"(Console device location. Valid values are "stdio", "file:<path>", or "port:<port>" (case insensitive).)", false);
-    g_args->AddOption(0, "debug", R"(Debug console location. Valid values are "disabled", "stdio", "file:<path>", or "port:<port>" (case insensitive). Default is "disabled".)", false);
+    g_args->AddOption('c', "console", R"(Console device location. Valid values are "stdio", "file:<path>", "port:<port>[:<policy>]", "unix:<path>[:<policy>]", or "shm:<path>" (case insensitive). <policy> is "broadcast" (default) or "first-writer".)", false);
+    g_args->AddOption(0, "debug", R"(Debug console location. Valid values are "disabled", "stdio", "file:<path>", "port:<port>[:<policy>]", "unix:<path>[:<policy>]", or "shm:<path>" (case insensitive). Default is "disabled".)", false);
     g_args->AddOption('h', "help", "Print this help message", false, false);
 
     g_args->ParseArgs(argc, argv);
@@ -72,9 +82,23 @@ int main(int argc, char** argv) {
     // Handle emulation arguments
     std::string_view program = g_args->GetOption('p');
 
+    size_t imageSize = 0;
+    if (g_args->HasOption("ram-image")) {
+        OSSpecific::g_GuestMemoryConfig.imagePath = g_args->GetOption("ram-image");
+        FILE* image = fopen(OSSpecific::g_GuestMemoryConfig.imagePath.c_str(), "r");
+        if (image == nullptr || fseek(image, 0, SEEK_END) != 0) {
+            fprintf(stderr, "Error: could not open RAM image %s: %s\n", OSSpecific::g_GuestMemoryConfig.imagePath.c_str(), strerror(errno));
+            return 1;
+        }
+        imageSize = ftell(image);
+        fclose(image);
+    }
+
     size_t ramSize;
     if (g_args->HasOption('m'))
         ramSize = strtoull(g_args->GetOption('m').data(), nullptr, 0); // automatically detects base
+    else if (imageSize > 0)
+        ramSize = ALIGN_UP(imageSize, KiB(64)); // RAM is handed out in 64KiB pages
     else
         ramSize = DEFAULT_RAM;
 
@@ -131,6 +155,8 @@ int main(int argc, char** argv) {
         }
 
         DISPLAY_TYPE_CHECKS
+        else if (display == "headless")
+            displayType = VideoBackendType::HEADLESS;
         else if (display == "none")
             displayType = VideoBackendType::NONE;
         else {
@@ -139,6 +165,52 @@ int main(int argc, char** argv) {
         }
     }
 
+    // Get the frame dump settings
+    if (g_args->HasOption("frame-dump"))
+        g_HeadlessVideoConfig.dumpPath = g_args->GetOption("frame-dump");
+
+    if (g_args->HasOption("frame-dump-format")) {
+        std::string format;
+        for (char c : g_args->GetOption("frame-dump-format"))
+            format += std::tolower(static_cast<unsigned char>(c));
+
+        if (format == "ppm")
+            g_HeadlessVideoConfig.dumpFormat = FrameDumpFormat::PPM;
+        else if (format == "raw")
+            g_HeadlessVideoConfig.dumpFormat = FrameDumpFormat::RAW;
+        else {
+            fprintf(stderr, "Error: Invalid frame dump format: %s\n", format.c_str());
+            return 1;
+        }
+    }
+
+    if (g_args->HasOption("frame-dump-interval"))
+        g_HeadlessVideoConfig.dumpInterval = strtoull(g_args->GetOption("frame-dump-interval").data(), nullptr, 0);
+
+    // Get the guest RAM allocation settings
+    if (g_args->HasOption("huge-pages")) {
+        std::string hugePages;
+        for (char c : g_args->GetOption("huge-pages"))
+            hugePages += std::tolower(static_cast<unsigned char>(c));
+
+        if (hugePages == "none")
+            OSSpecific::g_GuestMemoryConfig.hugePages = OSSpecific::HugePageMode::NONE;
+        else if (hugePages == "transparent")
+            OSSpecific::g_GuestMemoryConfig.hugePages = OSSpecific::HugePageMode::TRANSPARENT;
+        else if (hugePages == "explicit")
+            OSSpecific::g_GuestMemoryConfig.hugePages = OSSpecific::HugePageMode::EXPLICIT;
+        else {
+            fprintf(stderr, "Error: Invalid huge page mode: %s\n", hugePages.c_str());
+            return 1;
+        }
+    }
+
+    if (g_args->HasOption("ram-export"))
+        OSSpecific::g_GuestMemoryConfig.exportPath = g_args->GetOption("ram-export");
+
+    OSSpecific::g_GuestMemoryConfig.prefault = g_args->HasOption("prefault-ram");
+    OSSpecific::g_GuestMemoryConfig.lock = g_args->HasOption("lock-ram");
+
     std::string_view drive;
     bool hasDrive = g_args->HasOption('D');
     if (hasDrive)
@@ -21,9 +21,18 @@ Authors
 #include "../Memory.hpp"
 #include "Emulator.hpp"
 
+#include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <string>
+
+#include <Common/Util.hpp>
 
 namespace OSSpecific {
 
@@ -44,6 +53,57 @@ namespace OSSpecific {
         free(ptr);
     }
 
+    GuestMemoryConfig g_GuestMemoryConfig;
+
+    namespace {
+
+        struct {
+            std::atomic<uint64_t> allocatedBytes;
+            std::atomic<uint64_t> hugeTLBFallbacks;
+            std::atomic<uint64_t> prefaultedBytes;
+            std::atomic<uint64_t> lockedBytes;
+            std::atomic<uint64_t> lockFailures;
+            std::atomic<uint64_t> discardedBytes;
+        } g_stats;
+
+        // There are no huge pages to ask for here, so this only keeps the statistics
+        void AdviseMemory(size_t size) {
+            g_stats.allocatedBytes += size;
+            if (g_GuestMemoryConfig.hugePages == HugePageMode::EXPLICIT)
+                g_stats.hugeTLBFallbacks++;
+        }
+
+        // Applies the configured pre-faulting and locking to memory that is in use. mem has to be page aligned.
+        void PrepareMemory(void* mem, size_t size) {
+            if (g_GuestMemoryConfig.lock) {
+                if (mlock(mem, size) == 0) {
+                    g_stats.lockedBytes += size;
+                    return;
+                }
+                g_stats.lockFailures++;
+            }
+            if (g_GuestMemoryConfig.prefault) {
+                size_t pageSize = getpagesize();
+                volatile uint8_t* bytes = static_cast<volatile uint8_t*>(mem);
+                for (size_t i = 0; i < size; i += pageSize)
+                    bytes[i] = bytes[i];
+                g_stats.prefaultedBytes += size;
+            }
+        }
+
+        void ReadIn(uint8_t* dst, size_t size, FileHandle_t handle, size_t offset) {
+            while (size > 0) {
+                ssize_t bytesRead = pread(handle, dst, size, offset);
+                if (bytesRead <= 0)
+                    break; // the rest stays zero
+                dst += bytesRead;
+                offset += bytesRead;
+                size -= bytesRead;
+            }
+        }
+
+    } // anonymous namespace
+
     void* AllocateCOWMemory(size_t size) {
         return AllocateZeroedCOWMemory(size);
     }
@@ -52,16 +112,117 @@ namespace OSSpecific {
         void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
         if (mem == MAP_FAILED)
             Emulator::Crash("Failed to allocate COW memory");
+        AdviseMemory(size);
+        PrepareMemory(mem, size);
+        return mem;
+    }
+
+    void FreeSizedCOWMemory(void* ptr, size_t size) {
+        munmap(ptr, size);
+    }
+
+    void* ResizeCOWMemory(void* ptr, size_t oldSize, size_t newSize, size_t dataSize) {
+        // no mremap, so always copy
+        void* mem = mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (mem == MAP_FAILED)
+            Emulator::Crash("Failed to allocate COW memory");
+        AdviseMemory(newSize);
+        memcpy(mem, ptr, MIN(oldSize, newSize));
+        munmap(ptr, oldSize);
+        PrepareCOWMemory(mem, MIN(dataSize, newSize));
+        return mem;
+    }
+
+    void PrepareCOWMemory(void* ptr, size_t size) {
+        if (size == 0 || (!g_GuestMemoryConfig.lock && !g_GuestMemoryConfig.prefault))
+            return;
+        size_t pageSize = getpagesize();
+        uint64_t start = ALIGN_DOWN(reinterpret_cast<uint64_t>(ptr), pageSize);
+        uint64_t end = ALIGN_UP(reinterpret_cast<uint64_t>(ptr) + size, pageSize);
+        PrepareMemory(reinterpret_cast<void*>(start), end - start);
+    }
+
+    void* SplitCOWMemory(void* ptr, size_t size, size_t offset) {
+        void* mem = AllocateZeroedCOWMemory(size - offset);
+        memcpy(mem, static_cast<uint8_t*>(ptr) + offset, size - offset);
+        if (size_t keep = ALIGN_UP(offset, static_cast<size_t>(getpagesize())); keep < size)
+            munmap(static_cast<uint8_t*>(ptr) + keep, size - keep);
+        return mem;
+    }
+
+    void DiscardCOWMemory(void* ptr, size_t size, COWBacking backing) {
+        size_t pageSize = getpagesize();
+        uint8_t* start = static_cast<uint8_t*>(ptr);
+        uint8_t* end = start + size;
+        uint8_t* pageStart = reinterpret_cast<uint8_t*>(ALIGN_UP(reinterpret_cast<uint64_t>(start), pageSize));
+        uint8_t* pageEnd = reinterpret_cast<uint8_t*>(ALIGN_DOWN(reinterpret_cast<uint64_t>(end), pageSize));
+        if (pageStart >= pageEnd || g_GuestMemoryConfig.lock || backing == COWBacking::SHARED_FILE) {
+            // fresh pages wouldn't be locked or shared, so those only get cleared
+            memset(start, 0, size);
+            return;
+        }
+        memset(start, 0, pageStart - start);
+        memset(pageEnd, 0, end - pageEnd);
+        // MADV_FREE leaves the old contents readable until the pages are reclaimed, so map fresh zero pages over them instead
+        if (mmap(pageStart, pageEnd - pageStart, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0) != MAP_FAILED)
+            g_stats.discardedBytes += pageEnd - pageStart;
         else
-            return mem;
+            memset(pageStart, 0, pageEnd - pageStart);
     }
 
-    void FreeCOWMemory(void* ptr) {
-        munmap(ptr, 0);
+    void MapFileIntoCOWMemory(void* ptr, size_t size, FileHandle_t handle, size_t offset, bool shared) {
+        size_t pageSize = getpagesize();
+        uint8_t* start = static_cast<uint8_t*>(ptr);
+        if (shared) {
+            if (mmap(start, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, handle, offset) == MAP_FAILED)
+                Emulator::Crash("Failed to map shared memory");
+            if (g_GuestMemoryConfig.lock)
+                mlock(start, size);
+            return;
+        }
+        // only whole pages at the same offset into a page as the file can be mapped
+        if (reinterpret_cast<uint64_t>(start) % pageSize == offset % pageSize) {
+            size_t head = MIN(size, ALIGN_UP(reinterpret_cast<uint64_t>(start), pageSize) - reinterpret_cast<uint64_t>(start));
+            size_t body = ALIGN_DOWN(size - head, pageSize);
+            if (body > 0 && mmap(start + head, body, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, handle, offset + head) != MAP_FAILED) {
+                if (g_GuestMemoryConfig.lock)
+                    mlock(start + head, body);
+                ReadIn(start, head, handle, offset);
+                ReadIn(start + head + body, size - head - body, handle, offset + head + body);
+                return;
+            }
+        }
+        ReadIn(start, size, handle, offset);
     }
 
-    void FreeSizedCOWMemory(void* ptr, size_t size) {
-        munmap(ptr, size);
+    void MoveCOWMemory(void* dst, void* src, size_t size) {
+        // no mremap, so always copy
+        memcpy(dst, src, size);
+    }
+
+    FileHandle_t CreateSharedMemory(size_t size, std::string& path) {
+        // no memfd, so it has to have a name other processes can shm_open
+        path = "/frost64-ram-" + std::to_string(getpid());
+        int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if (fd < 0 || ftruncate(fd, size) != 0)
+            Emulator::Crash("Failed to create shared memory");
+        return fd;
+    }
+
+    void DestroySharedMemory(FileHandle_t handle, const std::string& path) {
+        shm_unlink(path.c_str());
+        close(handle);
+    }
+
+    COWMemoryStats GetCOWMemoryStats() {
+        return {g_stats.allocatedBytes, 0, g_stats.hugeTLBFallbacks, 0, g_stats.prefaultedBytes, g_stats.lockedBytes, g_stats.lockFailures, g_stats.discardedBytes};
+    }
+
+    bool QueryCOWMemory(void* ptr, size_t size, COWMemoryUsage& usage) {
+        (void)ptr;
+        (void)size;
+        (void)usage;
+        return false;
     }
 
 } // namespace OSSpecific
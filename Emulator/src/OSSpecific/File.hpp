@@ -20,24 +20,35 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <cstddef>
 
-#ifdef __unix__
+#if defined(__unix__) || defined(__APPLE__)
 typedef int FileHandle_t;
 
 #define FILE_HANDLE_TO_VOID_PTR(x) ((void*)(unsigned long)(x))
 #define VOID_PTR_TO_FILE_HANDLE(x) ((FileHandle_t)(unsigned long)(x))
-#endif /* __unix__ */
+#endif /* __unix__ || __APPLE__ */
 
 FileHandle_t GetFileHandleForStdIn();
 FileHandle_t GetFileHandleForStdOut();
 FileHandle_t GetFileHandleForStdErr();
 
 FileHandle_t OpenFile(const char* path, bool create = false);
+FileHandle_t OpenFileReadOnly(const char* path);
 void CloseFile(FileHandle_t handle);
 size_t GetFileSize(FileHandle_t handle);
 
 size_t ReadFile(FileHandle_t handle, void* buffer, size_t size, size_t offset);
 size_t WriteFile(FileHandle_t handle, const void* buffer, size_t size, size_t offset);
 
+// Lets a ReadFileCancellable blocked on another thread be woken
+struct FileReadCancel_t;
+FileReadCancel_t* CreateFileReadCancel();
+void CancelFileRead(FileReadCancel_t* cancel);
+// Only once nothing can be reading with cancel anymore
+void DestroyFileReadCancel(FileReadCancel_t* cancel);
+
+// ReadFile from the current position, except it returns 0 without reading once cancel has been cancelled, including while waiting for input
+size_t ReadFileCancellable(FileHandle_t handle, void* buffer, size_t size, FileReadCancel_t* cancel);
+
 void* MapFile(FileHandle_t handle, size_t size, size_t offset);
 void UnmapFile(void* address, size_t size);
 
@@ -21,6 +21,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <cerrno>
 #include <cstring>
 #include <fcntl.h>
+#include <poll.h>
 #include <string>
 #include <unistd.h>
 
@@ -58,6 +59,20 @@ FileHandle_t OpenFile(const char* path, bool create) {
     return fd;
 }
 
+FileHandle_t OpenFileReadOnly(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        const char* err = strerror(errno);
+        std::string str = "Failed to open file: ";
+        str += path;
+        str += " with error: ";
+        str += err;
+        Emulator::Crash(str.c_str());
+    }
+
+    return fd;
+}
+
 void CloseFile(FileHandle_t handle) {
     close(handle);
 }
@@ -95,6 +110,51 @@ size_t ReadFile(FileHandle_t handle, void* buffer, size_t size, size_t offset) {
     return static_cast<size_t>(read_size);
 }
 
+struct FileReadCancel_t {
+    int pipe[2]; // the write end is written to once to cancel, and never drained
+};
+
+FileReadCancel_t* CreateFileReadCancel() {
+    FileReadCancel_t* cancel = new FileReadCancel_t();
+    if (pipe(cancel->pipe) < 0) {
+        const char* err = strerror(errno);
+        std::string str = "Failed to create read cancel pipe with error: ";
+        str += err;
+        Emulator::Crash(str.c_str());
+    }
+    return cancel;
+}
+
+void CancelFileRead(FileReadCancel_t* cancel) {
+    char c = 0;
+    while (write(cancel->pipe[1], &c, 1) < 0 && errno == EINTR) {
+    }
+}
+
+void DestroyFileReadCancel(FileReadCancel_t* cancel) {
+    close(cancel->pipe[0]);
+    close(cancel->pipe[1]);
+    delete cancel;
+}
+
+size_t ReadFileCancellable(FileHandle_t handle, void* buffer, size_t size, FileReadCancel_t* cancel) {
+    pollfd fds[2] = {{handle, POLLIN, 0}, {cancel->pipe[0], POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            const char* err = strerror(errno);
+            std::string str = "Failed to wait for file input with error: ";
+            str += err;
+            Emulator::Crash(str.c_str());
+        }
+        if (fds[1].revents != 0)
+            return 0;
+        if (fds[0].revents != 0)
+            return ReadFile(handle, buffer, size, SIZE_MAX);
+    }
+}
+
 size_t WriteFile(FileHandle_t handle, const void* buffer, size_t size, size_t offset) {
     if (offset != SIZE_MAX) {
         if (off_t ret = lseek(handle, offset, SEEK_SET); ret < 0) {
@@ -17,9 +17,19 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "../Memory.hpp"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/mman.h>
 
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Common/Util.hpp>
+
 #include "Emulator.hpp"
 
 namespace OSSpecific {
@@ -41,23 +51,340 @@ namespace OSSpecific {
         free(ptr);
     }
 
+    GuestMemoryConfig g_GuestMemoryConfig;
+
+    namespace {
+
+        constexpr size_t HUGE_PAGE_SIZE = MiB(2);
+
+        struct {
+            std::atomic<uint64_t> allocatedBytes;
+            std::atomic<uint64_t> hugeTLBBytes;
+            std::atomic<uint64_t> hugeTLBFallbacks;
+            std::atomic<uint64_t> advisedBytes;
+            std::atomic<uint64_t> prefaultedBytes;
+            std::atomic<uint64_t> lockedBytes;
+            std::atomic<uint64_t> lockFailures;
+            std::atomic<uint64_t> discardedBytes;
+        } g_stats;
+
+        void* MapAnonymous(size_t size, int flags) {
+            return mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+        }
+
+        // hugetlb mappings can only be unmapped in whole huge pages, so retry with the huge pages inside the range
+        void Unmap(void* ptr, size_t size) {
+            if (munmap(ptr, size) == 0)
+                return;
+            uint64_t start = ALIGN_UP(reinterpret_cast<uint64_t>(ptr), HUGE_PAGE_SIZE);
+            uint64_t end = ALIGN_UP(reinterpret_cast<uint64_t>(ptr) + size, HUGE_PAGE_SIZE);
+            if (start < end)
+                munmap(reinterpret_cast<void*>(start), end - start);
+        }
+
+        // Transparent huge pages only get used for the 2MiB aligned parts of a mapping, so over-allocate and trim
+        void* MapHugeAligned(size_t size) {
+            size_t pageSize = sysconf(_SC_PAGESIZE);
+            size_t mapSize = ALIGN_UP(size, pageSize);
+            uint8_t* raw = static_cast<uint8_t*>(MapAnonymous(mapSize + HUGE_PAGE_SIZE, 0));
+            if (raw == MAP_FAILED)
+                return MAP_FAILED;
+            uint8_t* mem = reinterpret_cast<uint8_t*>(ALIGN_UP(reinterpret_cast<uint64_t>(raw), HUGE_PAGE_SIZE));
+            if (mem > raw)
+                munmap(raw, mem - raw);
+            if (uint8_t* end = raw + mapSize + HUGE_PAGE_SIZE; end > mem + mapSize)
+                munmap(mem + mapSize, end - (mem + mapSize));
+            return mem;
+        }
+
+        void Populate(void* mem, size_t size) {
+#ifdef MADV_POPULATE_WRITE
+            if (madvise(mem, size, MADV_POPULATE_WRITE) == 0)
+                return;
+#endif
+            // older kernels have to be made to fault each page in
+            size_t pageSize = sysconf(_SC_PAGESIZE);
+            volatile uint8_t* bytes = static_cast<volatile uint8_t*>(mem);
+            for (size_t i = 0; i < size; i += pageSize)
+                bytes[i] = bytes[i];
+        }
+
+        // Applies the configured huge page advice to newly mapped memory. mem has to be page aligned.
+        void AdviseMemory(void* mem, size_t size, bool hugeTLB) {
+            g_stats.allocatedBytes += size;
+            if (hugeTLB)
+                g_stats.hugeTLBBytes += size;
+            else if (g_GuestMemoryConfig.hugePages != HugePageMode::NONE && madvise(mem, size, MADV_HUGEPAGE) == 0)
+                g_stats.advisedBytes += size;
+        }
+
+        // Applies the configured pre-faulting and locking to memory that is in use. mem has to be page aligned.
+        void PrepareMemory(void* mem, size_t size) {
+            if (g_GuestMemoryConfig.lock) {
+                if (mlock(mem, size) == 0) {
+                    g_stats.lockedBytes += size;
+                    return;
+                }
+                g_stats.lockFailures++;
+            }
+            if (g_GuestMemoryConfig.prefault) {
+                Populate(mem, size);
+                g_stats.prefaultedBytes += size;
+            }
+        }
+
+        // Moves whole pages from src to dst. mremap only works within one host mapping, so a range covering several is moved one at a time.
+        void MovePages(uint8_t* dst, uint8_t* src, size_t size) {
+            if (mremap(src, size, size, MREMAP_MAYMOVE | MREMAP_FIXED, dst) != MAP_FAILED)
+                return;
+
+            // read them all first, since moving changes the list
+            std::vector<std::pair<uint8_t*, uint8_t*>> mappings;
+            if (FILE* maps = fopen("/proc/self/maps", "r"); maps != nullptr) {
+                char* line = nullptr;
+                size_t lineSize = 0;
+                while (getline(&line, &lineSize, maps) > 0) {
+                    uint64_t start, end;
+                    if (sscanf(line, "%lx-%lx", &start, &end) != 2 || start >= reinterpret_cast<uint64_t>(src + size) || end <= reinterpret_cast<uint64_t>(src))
+                        continue;
+                    mappings.emplace_back(MAX(reinterpret_cast<uint8_t*>(start), src), MIN(reinterpret_cast<uint8_t*>(end), src + size));
+                }
+                free(line);
+                fclose(maps);
+            }
+
+            for (auto [start, end] : mappings) {
+                if (mremap(start, end - start, end - start, MREMAP_MAYMOVE | MREMAP_FIXED, dst + (start - src)) == MAP_FAILED)
+                    memcpy(dst + (start - src), start, end - start);
+            }
+        }
+
+        // Maps zeroed memory for the guest, using huge pages as configured
+        void* MapGuestMemory(size_t size, bool& hugeTLB) {
+            void* mem = MAP_FAILED;
+            // odd sized hugetlb mappings would leave a partial huge page that can't be handed to the guest, so they go straight to the fallback
+            if (g_GuestMemoryConfig.hugePages == HugePageMode::EXPLICIT) {
+                if (size % HUGE_PAGE_SIZE == 0)
+                    mem = MapAnonymous(size, MAP_HUGETLB);
+                hugeTLB = mem != MAP_FAILED;
+                if (!hugeTLB)
+                    g_stats.hugeTLBFallbacks++;
+            }
+            if (mem == MAP_FAILED && g_GuestMemoryConfig.hugePages != HugePageMode::NONE && size >= HUGE_PAGE_SIZE)
+                mem = MapHugeAligned(size);
+            if (mem == MAP_FAILED)
+                mem = MapAnonymous(size, 0);
+            if (mem == MAP_FAILED)
+                Emulator::Crash("Failed to allocate COW memory");
+            return mem;
+        }
+
+        void ReadIn(uint8_t* dst, size_t size, FileHandle_t handle, size_t offset) {
+            while (size > 0) {
+                ssize_t bytesRead = pread(handle, dst, size, offset);
+                if (bytesRead <= 0)
+                    break; // the rest stays zero
+                dst += bytesRead;
+                offset += bytesRead;
+                size -= bytesRead;
+            }
+        }
+
+    } // anonymous namespace
+
     void* AllocateCOWMemory(size_t size) {
         return AllocateZeroedCOWMemory(size); // on Linux, COW memory is always zeroed
     }
 
     void* AllocateZeroedCOWMemory(size_t size) {
-        if (void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); mem == MAP_FAILED)
+        bool hugeTLB = false;
+        void* mem = MapGuestMemory(size, hugeTLB);
+        AdviseMemory(mem, size, hugeTLB);
+        PrepareMemory(mem, size);
+        return mem;
+    }
+
+    void FreeSizedCOWMemory(void* ptr, size_t size) {
+        Unmap(ptr, size);
+    }
+
+    void* ResizeCOWMemory(void* ptr, size_t oldSize, size_t newSize, size_t dataSize) {
+        void* mem = mremap(ptr, oldSize, newSize, MREMAP_MAYMOVE);
+        if (mem == MAP_FAILED) {
+            // mremap can only resize a single mapping, so move it across a mapping at a time. Anything copied rather than moved lost its locks.
+            bool hugeTLB = false;
+            mem = MapGuestMemory(newSize, hugeTLB);
+            AdviseMemory(mem, newSize, hugeTLB);
+            MoveCOWMemory(mem, ptr, MIN(oldSize, newSize));
+            Unmap(ptr, oldSize);
+            PrepareCOWMemory(mem, MIN(dataSize, newSize));
+            return mem;
+        }
+        if (newSize <= oldSize)
+            return mem;
+        // the rest of the old last page can still hold data from before a shrink
+        size_t pageEnd = ALIGN_UP(oldSize, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+        if (pageEnd > oldSize)
+            memset(static_cast<uint8_t*>(mem) + oldSize, 0, MIN(newSize, pageEnd) - oldSize);
+        // the grown part keeps the mapping's huge page advice, it is only faulted in or locked once it is in use
+        if (newSize > pageEnd)
+            AdviseMemory(static_cast<uint8_t*>(mem) + pageEnd, newSize - pageEnd, false);
+        return mem;
+    }
+
+    void PrepareCOWMemory(void* ptr, size_t size) {
+        if (size == 0 || (!g_GuestMemoryConfig.lock && !g_GuestMemoryConfig.prefault))
+            return;
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        uint64_t start = ALIGN_DOWN(reinterpret_cast<uint64_t>(ptr), pageSize);
+        uint64_t end = ALIGN_UP(reinterpret_cast<uint64_t>(ptr) + size, pageSize);
+        PrepareMemory(reinterpret_cast<void*>(start), end - start);
+    }
+
+    void* SplitCOWMemory(void* ptr, size_t size, size_t offset) {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        // page aligned splits move the pages across instead of copying them, and they keep their advice and locks
+        void* mem = offset % pageSize == 0 ? MapAnonymous(size - offset, 0) : AllocateZeroedCOWMemory(size - offset);
+        if (mem == MAP_FAILED)
             Emulator::Crash("Failed to allocate COW memory");
+        MoveCOWMemory(mem, static_cast<uint8_t*>(ptr) + offset, size - offset);
+        if (size_t keep = ALIGN_UP(offset, pageSize); keep < size)
+            Unmap(static_cast<uint8_t*>(ptr) + keep, size - keep);
+        return mem;
+    }
+
+    void DiscardCOWMemory(void* ptr, size_t size, COWBacking backing) {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        uint8_t* start = static_cast<uint8_t*>(ptr);
+        uint8_t* end = start + size;
+        uint8_t* pageStart = reinterpret_cast<uint8_t*>(ALIGN_UP(reinterpret_cast<uint64_t>(start), pageSize));
+        uint8_t* pageEnd = reinterpret_cast<uint8_t*>(ALIGN_DOWN(reinterpret_cast<uint64_t>(end), pageSize));
+        if (pageStart >= pageEnd) {
+            memset(start, 0, size);
+            return;
+        }
+        memset(start, 0, pageStart - start);
+        memset(pageEnd, 0, end - pageEnd);
+        // locked memory and parts of hugetlb pages can't be dropped, so they only get cleared
+        bool dropped;
+        if (backing == COWBacking::ANONYMOUS)
+            dropped = madvise(pageStart, pageEnd - pageStart, MADV_DONTNEED) == 0;
+        else if (backing == COWBacking::SHARED_FILE) {
+            // punches a hole in the file, so everything else mapping it sees zeroes too. Anonymous parts fail this, and get cleared.
+            dropped = madvise(pageStart, pageEnd - pageStart, MADV_REMOVE) == 0;
+        } else {
+            // dropped pages of a private file mapping read as the file again, so map fresh pages over them instead
+            dropped = !g_GuestMemoryConfig.lock && mmap(pageStart, pageEnd - pageStart, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED;
+            if (dropped && g_GuestMemoryConfig.hugePages != HugePageMode::NONE)
+                madvise(pageStart, pageEnd - pageStart, MADV_HUGEPAGE);
+        }
+        if (dropped)
+            g_stats.discardedBytes += pageEnd - pageStart;
         else
-            return mem;
+            memset(pageStart, 0, pageEnd - pageStart);
     }
 
-    void FreeCOWMemory(void* ptr) {
-        munmap(ptr, 0);
+    void MapFileIntoCOWMemory(void* ptr, size_t size, FileHandle_t handle, size_t offset, bool shared) {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        uint8_t* start = static_cast<uint8_t*>(ptr);
+        if (shared) {
+            if (mmap(start, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, handle, offset) == MAP_FAILED)
+                Emulator::Crash("Failed to map shared memory");
+            if (g_GuestMemoryConfig.hugePages != HugePageMode::NONE)
+                madvise(start, size, MADV_HUGEPAGE);
+            if (g_GuestMemoryConfig.lock)
+                mlock(start, size);
+            else if (g_GuestMemoryConfig.prefault)
+                Populate(start, size);
+            return;
+        }
+        // only whole pages at the same offset into a page as the file can be mapped
+        if (reinterpret_cast<uint64_t>(start) % pageSize == offset % pageSize) {
+            size_t head = MIN(size, ALIGN_UP(reinterpret_cast<uint64_t>(start), pageSize) - reinterpret_cast<uint64_t>(start));
+            size_t body = ALIGN_DOWN(size - head, pageSize);
+            if (body > 0 && mmap(start + head, body, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, handle, offset + head) != MAP_FAILED) {
+                // locking a writable private mapping gives it its own copy of every page, so only do it when asked to
+                if (g_GuestMemoryConfig.lock)
+                    mlock(start + head, body);
+                else if (g_GuestMemoryConfig.prefault) {
+#ifdef MADV_POPULATE_READ
+                    madvise(start + head, body, MADV_POPULATE_READ);
+#endif
+                }
+                ReadIn(start, head, handle, offset);
+                ReadIn(start + head + body, size - head - body, handle, offset + head + body);
+                return;
+            }
+        }
+        ReadIn(start, size, handle, offset);
     }
 
-    void FreeSizedCOWMemory(void* ptr, size_t size) {
-        munmap(ptr, size);
+    void MoveCOWMemory(void* dst, void* src, size_t size) {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+        uint8_t* to = static_cast<uint8_t*>(dst);
+        uint8_t* from = static_cast<uint8_t*>(src);
+        size_t head = MIN(size, ALIGN_UP(reinterpret_cast<uint64_t>(from), pageSize) - reinterpret_cast<uint64_t>(from));
+        size_t body = ALIGN_DOWN(size - head, pageSize);
+        // pages can only move between addresses at the same offset into a page
+        if (reinterpret_cast<uint64_t>(to) % pageSize != reinterpret_cast<uint64_t>(from) % pageSize || body == 0) {
+            memcpy(to, from, size);
+            return;
+        }
+        memcpy(to, from, head);
+        MovePages(to + head, from + head, body);
+        memcpy(to + head + body, from + head + body, size - head - body);
+    }
+
+    FileHandle_t CreateSharedMemory(size_t size, std::string& path) {
+        int fd = memfd_create("frost64-ram", MFD_CLOEXEC);
+        if (fd < 0 || ftruncate(fd, size) != 0)
+            Emulator::Crash("Failed to create shared memory");
+        // other processes of the same user can open it through procfs
+        path = "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(fd);
+        return fd;
+    }
+
+    void DestroySharedMemory(FileHandle_t handle, const std::string&) {
+        close(handle);
+    }
+
+    COWMemoryStats GetCOWMemoryStats() {
+        return {g_stats.allocatedBytes, g_stats.hugeTLBBytes, g_stats.hugeTLBFallbacks, g_stats.advisedBytes, g_stats.prefaultedBytes, g_stats.lockedBytes, g_stats.lockFailures, g_stats.discardedBytes};
+    }
+
+    bool QueryCOWMemory(void* ptr, size_t size, COWMemoryUsage& usage) {
+        FILE* smaps = fopen("/proc/self/smaps", "r");
+        if (smaps == nullptr)
+            return false;
+        usage = {};
+        uint64_t start = reinterpret_cast<uint64_t>(ptr);
+        uint64_t end = start + size;
+        bool inside = false;
+        char* line = nullptr;
+        size_t lineSize = 0;
+        // the host can merge neighbouring mappings, in which case the whole mapping is counted
+        while (getline(&line, &lineSize, smaps) > 0) {
+            uint64_t mapStart, mapEnd, kib;
+            if (sscanf(line, "%lx-%lx ", &mapStart, &mapEnd) == 2)
+                inside = mapStart < end && mapEnd > start;
+            else if (!inside)
+                continue;
+            else if (sscanf(line, "Rss: %lu kB", &kib) == 1)
+                usage.residentBytes += KiB(kib);
+            else if (sscanf(line, "Shared_Clean: %lu kB", &kib) == 1 || sscanf(line, "Shared_Dirty: %lu kB", &kib) == 1)
+                usage.sharedBytes += KiB(kib);
+            else if (sscanf(line, "AnonHugePages: %lu kB", &kib) == 1)
+                usage.hugePageBytes += KiB(kib);
+            else if (sscanf(line, "Private_Hugetlb: %lu kB", &kib) == 1) {
+                // hugetlb pages are left out of Rss and AnonHugePages
+                usage.residentBytes += KiB(kib);
+                usage.hugePageBytes += KiB(kib);
+            } else if (sscanf(line, "Locked: %lu kB", &kib) == 1)
+                usage.lockedBytes += KiB(kib);
+        }
+        free(line);
+        fclose(smaps);
+        return true;
     }
 
 } // namespace OSSpecific
@@ -17,53 +17,265 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "../Network.hpp"
 
+#include <atomic>
 #include <cerrno>
 #include <cstring>
+#include <mutex>
 #include <sstream>
+#include <string>
 #include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #include <netinet/in.h>
 
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 
-#include <Common/Spinlock.hpp>
+#include <Common/Util.hpp>
 
 #include <Emulator.hpp>
 
-struct TCPSocketHandle_t {
-    int sockfd;
+// input received but not read yet, past this point clients stop being read from
+#define TCP_INPUT_BUFFER_LIMIT KiB(64)
+// output a client hasn't accepted yet, past this point the client is dropped instead of stalling the emulator
+#define TCP_OUTPUT_BUFFER_LIMIT MiB(1)
+
+#define TCP_MAX_EVENTS 64
 
-    std::thread* acceptThread;
+struct TCPConnection {
+    TCPSocketHandle_t* handle;
+    int fd;
+    bool listener;
+    std::vector<uint8_t> output;
+};
 
-    std::vector<int> clientSockets;
-    spinlock_t clientSocketsLock;
+struct TCPSocketHandle_t {
+    TCPSocketPolicy policy;
+    TCPConnection* listener;
+    std::string unixPath; // empty for TCP sockets
+    std::vector<TCPConnection*> clients;
+    TCPConnection* inputOwner; // FIRST_WRITER only, the client input is currently taken from
+
+    std::vector<uint8_t> input;
+    bool inputPaused;
+    bool closed;
+    std::atomic_uint64_t inputSignal; // bumped whenever input arrives, what a blocking read waits on
 };
 
-void SocketWaitThread(TCPSocketHandle_t* handle) {
+// One reactor thread serves every socket. All connection and handle state is protected by g_reactorLock.
+// Events carry the fd rather than a pointer, so an event for a connection that has since been closed is simply not found.
+int g_epollFD = -1;
+std::thread* g_reactorThread = nullptr;
+std::mutex g_reactorLock; // a mutex, as it is held across syscalls
+std::unordered_map<int, TCPConnection*> g_connections;
+
+void ReactorThread();
+
+void ReactorCrash(const char* message) {
+    std::stringstream ss = std::stringstream();
+    ss << message << strerror(errno);
+    Emulator::Crash(ss.str().c_str());
+}
+
+void StartReactor() {
+    if (g_epollFD >= 0)
+        return;
+
+    g_epollFD = epoll_create1(EPOLL_CLOEXEC);
+    if (g_epollFD < 0)
+        ReactorCrash("Failed to create epoll instance with error: ");
+
+    g_reactorThread = new std::thread(ReactorThread);
+}
+
+void WatchConnection(TCPConnection* connection, int op) {
+    epoll_event event = {};
+    event.events = 0;
+    if (connection->listener || !connection->handle->inputPaused)
+        event.events |= EPOLLIN;
+    if (!connection->output.empty())
+        event.events |= EPOLLOUT;
+    event.data.fd = connection->fd;
+    if (epoll_ctl(g_epollFD, op, connection->fd, &event) < 0)
+        ReactorCrash("Failed to update epoll instance with error: ");
+}
+
+// must be called with g_reactorLock held
+void DropConnection(TCPConnection* connection) {
+    TCPSocketHandle_t* handle = connection->handle;
+    epoll_ctl(g_epollFD, EPOLL_CTL_DEL, connection->fd, nullptr);
+    close(connection->fd);
+    g_connections.erase(connection->fd);
+
+    for (auto it = handle->clients.begin(); it != handle->clients.end(); ++it) {
+        if (*it == connection) {
+            handle->clients.erase(it);
+            break;
+        }
+    }
+    if (handle->inputOwner == connection)
+        handle->inputOwner = nullptr;
+
+    delete connection;
+}
+
+// must be called with g_reactorLock held. Returns false if the connection should be dropped.
+bool FlushConnection(TCPConnection* connection) {
+    size_t offset = 0;
+    while (offset < connection->output.size()) {
+        ssize_t written = send(connection->fd, connection->output.data() + offset, connection->output.size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        offset += written;
+    }
+    connection->output.erase(connection->output.begin(), connection->output.begin() + offset);
+    return true;
+}
+
+// must be called with g_reactorLock held
+void SetInputPaused(TCPSocketHandle_t* handle, bool paused) {
+    if (handle->inputPaused == paused)
+        return;
+    handle->inputPaused = paused;
+    for (TCPConnection* client : handle->clients)
+        WatchConnection(client, EPOLL_CTL_MOD);
+}
+
+// must be called with g_reactorLock held
+void AcceptClients(TCPSocketHandle_t* handle) {
     while (true) {
-        int client_sockfd = accept(handle->sockfd, nullptr, nullptr);
+        int client_sockfd = accept4(handle->listener->fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (client_sockfd < 0) {
-            std::stringstream ss = std::stringstream();
-            ss << "Failed to accept TCP socket with error: " << strerror(errno);
-            Emulator::Crash(ss.str().c_str());
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            ReactorCrash("Failed to accept TCP socket with error: ");
         }
 
-        spinlock_acquire(&handle->clientSocketsLock);
-        handle->clientSockets.push_back(client_sockfd);
-        spinlock_release(&handle->clientSocketsLock);
+        TCPConnection* client = new TCPConnection{handle, client_sockfd, false, {}};
+        handle->clients.push_back(client);
+        g_connections[client_sockfd] = client;
+        WatchConnection(client, EPOLL_CTL_ADD);
+    }
+}
+
+// must be called with g_reactorLock held. Returns false if the connection should be dropped.
+bool ReceiveFromClient(TCPConnection* client) {
+    TCPSocketHandle_t* handle = client->handle;
+    uint8_t buffer[4096];
+    while (!handle->inputPaused) {
+        ssize_t read_size = recv(client->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (read_size < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (read_size == 0)
+            return false;
+
+        if (handle->policy == TCPSocketPolicy::FIRST_WRITER) {
+            if (handle->inputOwner == nullptr)
+                handle->inputOwner = client;
+            else if (handle->inputOwner != client)
+                continue; // someone else has the input
+        }
+
+        handle->input.insert(handle->input.end(), buffer, buffer + read_size);
+        handle->inputSignal.fetch_add(1);
+        handle->inputSignal.notify_all();
+
+        if (handle->input.size() >= TCP_INPUT_BUFFER_LIMIT)
+            SetInputPaused(handle, true);
     }
+    return true;
 }
 
-TCPSocketHandle_t* OpenTCPSocket(int port) {
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+void ReactorThread() {
+    epoll_event events[TCP_MAX_EVENTS];
+    while (true) {
+        int count = epoll_wait(g_epollFD, events, TCP_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            ReactorCrash("Failed to wait on epoll instance with error: ");
+        }
+
+        g_reactorLock.lock();
+        for (int i = 0; i < count; i++) {
+            auto it = g_connections.find(events[i].data.fd);
+            if (it == g_connections.end())
+                continue; // closed since the event was queued
+            TCPConnection* connection = it->second;
+
+            if (connection->listener) {
+                AcceptClients(connection->handle);
+                continue;
+            }
+
+            bool keep = (events[i].events & EPOLLERR) == 0;
+            if (keep && (events[i].events & EPOLLHUP) != 0 && connection->handle->inputPaused)
+                keep = false; // can't wait for the input to drain, the hangup would be reported forever
+            if (keep && (events[i].events & (EPOLLIN | EPOLLHUP)) != 0)
+                keep = ReceiveFromClient(connection);
+            if (keep && (events[i].events & EPOLLOUT) != 0) {
+                keep = FlushConnection(connection);
+                if (keep && connection->output.empty())
+                    WatchConnection(connection, EPOLL_CTL_MOD);
+            }
+
+            if (!keep)
+                DropConnection(connection);
+        }
+        g_reactorLock.unlock();
+    }
+}
+
+TCPSocketHandle_t* CreateSocketHandle(int sockfd, TCPSocketPolicy policy) {
+    if (listen(sockfd, 5) < 0) {
+        std::stringstream ss = std::stringstream();
+        ss << "Failed to listen on socket with error: " << strerror(errno);
+        Emulator::Crash(ss.str().c_str());
+    }
+
+    TCPSocketHandle_t* handle = new TCPSocketHandle_t();
+    handle->policy = policy;
+    handle->inputOwner = nullptr;
+    handle->inputPaused = false;
+    handle->closed = false;
+    handle->listener = new TCPConnection{handle, sockfd, true, {}};
+
+    // clients are accepted by the reactor whenever they turn up, nothing waits for them here
+    g_reactorLock.lock();
+    StartReactor();
+    g_connections[sockfd] = handle->listener;
+    WatchConnection(handle->listener, EPOLL_CTL_ADD);
+    g_reactorLock.unlock();
+
+    return handle;
+}
+
+TCPSocketHandle_t* OpenTCPSocket(int port, TCPSocketPolicy policy) {
+    int sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (sockfd < 0) {
         std::stringstream ss = std::stringstream();
         ss << "Failed to open TCP socket with error: " << strerror(errno);
         Emulator::Crash(ss.str().c_str());
     }
 
+    int reuse = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     sockaddr_in serv_addr{};
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -75,108 +287,118 @@ TCPSocketHandle_t* OpenTCPSocket(int port) {
         Emulator::Crash(ss.str().c_str());
     }
 
-    if (listen(sockfd, 5) < 0) {
+    return CreateSocketHandle(sockfd, policy);
+}
+
+TCPSocketHandle_t* OpenUnixSocket(const char* path, TCPSocketPolicy policy) {
+    sockaddr_un serv_addr{};
+    if (strlen(path) >= sizeof(serv_addr.sun_path))
+        Emulator::Crash("Unix socket path is too long");
+
+    int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
         std::stringstream ss = std::stringstream();
-        ss << "Failed to listen on TCP socket with error: " << strerror(errno);
+        ss << "Failed to open unix socket with error: " << strerror(errno);
         Emulator::Crash(ss.str().c_str());
     }
 
-    TCPSocketHandle_t* handle = new TCPSocketHandle_t();
-    handle->sockfd = sockfd;
-    spinlock_init(&handle->clientSocketsLock);
+    serv_addr.sun_family = AF_UNIX;
+    strncpy(serv_addr.sun_path, path, sizeof(serv_addr.sun_path) - 1);
 
-    // wait for at least one client
-    int client_sockfd = accept(handle->sockfd, nullptr, nullptr);
-    if (client_sockfd < 0) {
+    unlink(path); // left behind by a previous run
+    if (bind(sockfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
         std::stringstream ss = std::stringstream();
-        ss << "Failed to accept TCP socket with error: " << strerror(errno);
+        ss << "Failed to bind unix socket with error: " << strerror(errno);
         Emulator::Crash(ss.str().c_str());
     }
 
-    handle->clientSockets.push_back(client_sockfd);
-
-    handle->acceptThread = new std::thread(SocketWaitThread, handle);
-
+    TCPSocketHandle_t* handle = CreateSocketHandle(sockfd, policy);
+    handle->unixPath = path;
     return handle;
 }
 
 void CloseTCPSocket(TCPSocketHandle_t* handle) {
-    handle->acceptThread->detach();
-    delete handle->acceptThread;
-
-    spinlock_acquire(&handle->clientSocketsLock);
-    for (int client_sockfd : handle->clientSockets)
-        close(client_sockfd);
-    handle->clientSockets.clear();
-
-    // don't release the lock, we're about to delete the handle
-
-    close(handle->sockfd);
-    delete handle;
+    g_reactorLock.lock();
+    while (!handle->clients.empty())
+        DropConnection(handle->clients.back());
+
+    epoll_ctl(g_epollFD, EPOLL_CTL_DEL, handle->listener->fd, nullptr);
+    close(handle->listener->fd);
+    g_connections.erase(handle->listener->fd);
+    delete handle->listener;
+    handle->listener = nullptr;
+    if (!handle->unixPath.empty())
+        unlink(handle->unixPath.c_str());
+
+    // wake any reader so it can see the socket is gone
+    handle->closed = true;
+    handle->inputSignal.fetch_add(1);
+    handle->inputSignal.notify_all();
+    g_reactorLock.unlock();
+
+    // the handle itself is leaked on purpose, a reader may still be returning from ReadFromTCPSocket
 }
 
 ssize_t ReadFromTCPSocket(TCPSocketHandle_t* handle, void* buffer, size_t size) {
-    spinlock_acquire(&handle->clientSocketsLock);
-    if (handle->clientSockets.empty()) {
-        spinlock_release(&handle->clientSocketsLock);
-        return -1;
-    }
-
-    int client_sockfd = handle->clientSockets.front();
-    spinlock_release(&handle->clientSocketsLock);
-
-    ssize_t read_size = read(client_sockfd, buffer, size);
-    if (read_size < 0) {
-        switch (errno) {
-            case ECONNRESET:
-            case ENOTCONN:
-            case ETIMEDOUT: {
-                spinlock_acquire(&handle->clientSocketsLock);
-                close(handle->clientSockets.front());
-                handle->clientSockets.erase(handle->clientSockets.begin());
-                spinlock_release(&handle->clientSocketsLock);
-                return ReadFromTCPSocket(handle, buffer, size); // try again
-            }
-            default: {
-                std::stringstream ss = std::stringstream();
-                ss << "Failed to read from TCP socket with error: " << strerror(errno);
-                Emulator::Crash(ss.str().c_str());
-            }
+    while (true) {
+        uint64_t signal = handle->inputSignal.load();
+
+        g_reactorLock.lock();
+        if (!handle->input.empty()) {
+            size_t read_size = MIN(size, handle->input.size());
+            memcpy(buffer, handle->input.data(), read_size);
+            handle->input.erase(handle->input.begin(), handle->input.begin() + read_size);
+            if (handle->input.size() < TCP_INPUT_BUFFER_LIMIT / 2)
+                SetInputPaused(handle, false);
+            g_reactorLock.unlock();
+            return static_cast<ssize_t>(read_size);
         }
-    }
+        bool closed = handle->closed;
+        g_reactorLock.unlock();
 
-    return read_size;
+        if (closed)
+            return 0;
+        handle->inputSignal.wait(signal);
+    }
 }
 
 ssize_t WriteToTCPSocket(TCPSocketHandle_t* handle, const void* buffer, size_t size) {
-    spinlock_acquire(&handle->clientSocketsLock);
-    if (handle->clientSockets.empty()) {
-        spinlock_release(&handle->clientSocketsLock);
-        return -1;
-    }
-
-    int client_sockfd = handle->clientSockets.front();
-    spinlock_release(&handle->clientSocketsLock);
-
-    ssize_t write_size = write(client_sockfd, buffer, size);
-    if (write_size < 0) {
-        switch (errno) {
-            case ECONNRESET:
-            case ENOTCONN:
-            case ETIMEDOUT: {
-                spinlock_acquire(&handle->clientSocketsLock);
-                close(handle->clientSockets.front());
-                handle->clientSockets.erase(handle->clientSockets.begin());
-                spinlock_release(&handle->clientSocketsLock);
-                return WriteToTCPSocket(handle, buffer, size); // try again
-            }
-            default: {
-                std::stringstream ss = std::stringstream();
-                ss << "Failed to write to TCP socket with error: " << strerror(errno);
-                Emulator::Crash(ss.str().c_str());
+    g_reactorLock.lock();
+
+    std::vector<TCPConnection*> dropped;
+    for (TCPConnection* client : handle->clients) {
+        // only go straight to the socket if nothing is queued ahead of this data
+        size_t offset = 0;
+        if (client->output.empty()) {
+            ssize_t written = send(client->fd, buffer, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (written < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    dropped.push_back(client);
+                    continue;
+                }
+                written = 0;
             }
+            offset = written;
+            if (offset == size)
+                continue;
+        }
+
+        if (client->output.size() + (size - offset) > TCP_OUTPUT_BUFFER_LIMIT) {
+            dropped.push_back(client);
+            continue;
         }
+
+        bool wasEmpty = client->output.empty();
+        client->output.insert(client->output.end(), static_cast<const uint8_t*>(buffer) + offset, static_cast<const uint8_t*>(buffer) + size);
+        if (wasEmpty)
+            WatchConnection(client, EPOLL_CTL_MOD);
     }
 
-    return write_size;
-}
\ No newline at end of file
+    for (TCPConnection* client : dropped)
+        DropConnection(client);
+
+    g_reactorLock.unlock();
+
+    // output with nobody connected is discarded, same as a terminal nobody is looking at
+    return static_cast<ssize_t>(size);
+}
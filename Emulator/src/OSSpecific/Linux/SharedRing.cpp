@@ -0,0 +1,273 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "../SharedRing.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <Common/Util.hpp>
+
+#include <Emulator.hpp>
+
+struct SharedRingHandle_t {
+    int memoryFD;
+    SharedRingHeader* header;
+    uint8_t* output;
+    uint8_t* input;
+
+    // [0] output data, [1] output space, [2] input data, [3] input space
+    int events[4];
+
+    int listenerFD;
+    std::string path;
+    std::thread* attachThread;
+    std::atomic_bool attached;
+    std::atomic_bool ended; // set once a tool detaches, reads then return 0 when the input ring is empty. No tool can attach after that.
+
+    // the rings are single producer, single consumer, these keep it that way on the emulator side.
+    // mutexes rather than spinlocks, as a holder can sleep waiting for the tool.
+    std::mutex readLock;
+    std::mutex writeLock;
+};
+
+void SharedRingCrash(const char* message) {
+    std::stringstream ss = std::stringstream();
+    ss << message << strerror(errno);
+    Emulator::Crash(ss.str().c_str());
+}
+
+void SignalEvent(int fd) {
+    uint64_t value = 1;
+    while (write(fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+    }
+}
+
+void WaitForEvent(int fd) {
+    uint64_t value;
+    while (read(fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+    }
+}
+
+bool SendDescriptors(SharedRingHandle_t* handle, int client) {
+    int fds[5] = {handle->memoryFD, handle->events[0], handle->events[1], handle->events[2], handle->events[3]};
+
+    char data = 0;
+    iovec iov = {&data, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    return sendmsg(client, &message, MSG_NOSIGNAL) == 1;
+}
+
+// Whichever of the attach thread and CloseSharedRing gets here first closes it
+void CloseListener(SharedRingHandle_t* handle) {
+    int fd = std::atomic_ref<int>(handle->listenerFD).exchange(-1);
+    if (fd < 0)
+        return;
+    close(fd);
+    unlink(handle->path.c_str());
+}
+
+void SharedRingAttachThread(SharedRingHandle_t* handle) {
+    while (!handle->ended.load()) {
+        int client = accept4(std::atomic_ref<int>(handle->listenerFD).load(), nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (handle->ended.load())
+                break; // closed under us
+            SharedRingCrash("Failed to accept shared ring tool with error: ");
+        }
+
+        if (SendDescriptors(handle, client)) {
+            handle->attached.store(true);
+
+            // the tool is attached for as long as the connection is open
+            char c;
+            while (true) {
+                ssize_t ret = recv(client, &c, 1, 0);
+                if (ret == 0 || (ret < 0 && errno != EINTR))
+                    break;
+            }
+
+            handle->attached.store(false);
+            handle->ended.store(true);
+            SignalEvent(handle->events[1]); // a writer waiting for space would otherwise wait forever
+            SignalEvent(handle->events[2]); // and a reader would never see the end of the input
+        }
+
+        close(client);
+    }
+
+    // the input has ended for good, so a new tool would have nothing reading what it sends
+    CloseListener(handle);
+}
+
+SharedRingHandle_t* OpenSharedRing(const char* path) {
+    sockaddr_un addr{};
+    if (strlen(path) >= sizeof(addr.sun_path))
+        Emulator::Crash("Shared ring socket path is too long");
+
+    SharedRingHandle_t* handle = new SharedRingHandle_t();
+
+    handle->memoryFD = memfd_create("frost64-ring", MFD_CLOEXEC);
+    if (handle->memoryFD < 0)
+        SharedRingCrash("Failed to create shared ring memory with error: ");
+    if (ftruncate(handle->memoryFD, SHARED_RING_MEMORY_SIZE) < 0)
+        SharedRingCrash("Failed to size shared ring memory with error: ");
+
+    void* memory = mmap(nullptr, SHARED_RING_MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, handle->memoryFD, 0);
+    if (memory == MAP_FAILED)
+        SharedRingCrash("Failed to map shared ring memory with error: ");
+
+    // the memory starts zeroed, so only the constant fields need filling in
+    handle->header = static_cast<SharedRingHeader*>(memory);
+    handle->header->magic = SHARED_RING_MAGIC;
+    handle->header->version = SHARED_RING_VERSION;
+    handle->header->dataSize = SHARED_RING_DATA_SIZE;
+    handle->header->outputOffset = SHARED_RING_OUTPUT_OFFSET;
+    handle->header->inputOffset = SHARED_RING_INPUT_OFFSET;
+    handle->output = static_cast<uint8_t*>(memory) + SHARED_RING_OUTPUT_OFFSET;
+    handle->input = static_cast<uint8_t*>(memory) + SHARED_RING_INPUT_OFFSET;
+
+    for (int& event : handle->events) {
+        event = eventfd(0, EFD_CLOEXEC);
+        if (event < 0)
+            SharedRingCrash("Failed to create shared ring eventfd with error: ");
+    }
+
+    handle->listenerFD = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (handle->listenerFD < 0)
+        SharedRingCrash("Failed to open shared ring socket with error: ");
+
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path); // left behind by a previous run
+    if (bind(handle->listenerFD, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        SharedRingCrash("Failed to bind shared ring socket with error: ");
+    if (listen(handle->listenerFD, 1) < 0)
+        SharedRingCrash("Failed to listen on shared ring socket with error: ");
+
+    handle->path = path;
+    handle->attached.store(false);
+    handle->ended.store(false);
+    handle->attachThread = new std::thread(SharedRingAttachThread, handle);
+
+    return handle;
+}
+
+void CloseSharedRing(SharedRingHandle_t* handle) {
+    handle->attachThread->detach();
+    delete handle->attachThread;
+
+    handle->ended.store(true);
+    SignalEvent(handle->events[2]); // wake a reader so it can return
+
+    CloseListener(handle);
+
+    // the memory and eventfds stay around, a reader or writer may still be waiting on them
+}
+
+ssize_t ReadFromSharedRing(SharedRingHandle_t* handle, void* buffer, size_t size) {
+    if (size == 0)
+        return 0;
+
+    SharedRingControl& ring = handle->header->input;
+    std::lock_guard<std::mutex> lock(handle->readLock);
+
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t head;
+    while ((head = ring.head.load()) == tail) {
+        if (handle->ended.load())
+            return 0;
+        ring.consumerWaiting.store(1);
+        if (ring.head.load() != tail || handle->ended.load()) {
+            ring.consumerWaiting.store(0);
+            continue;
+        }
+        WaitForEvent(handle->events[2]);
+    }
+
+    // at most 2 pieces if the ring wraps
+    size_t count = MIN(head - tail, size);
+    uint64_t offset = tail % SHARED_RING_DATA_SIZE;
+    size_t first = MIN(count, SHARED_RING_DATA_SIZE - offset);
+    memcpy(buffer, handle->input + offset, first);
+    memcpy(static_cast<uint8_t*>(buffer) + first, handle->input, count - first);
+
+    ring.tail.store(tail + count);
+    if (ring.producerWaiting.exchange(0) != 0)
+        SignalEvent(handle->events[3]);
+
+    return static_cast<ssize_t>(count);
+}
+
+ssize_t WriteToSharedRing(SharedRingHandle_t* handle, const void* buffer, size_t size) {
+    SharedRingControl& ring = handle->header->output;
+    std::lock_guard<std::mutex> lock(handle->writeLock);
+
+    size_t written = 0;
+    while (written < size) {
+        uint64_t head = ring.head.load(std::memory_order_relaxed);
+        uint64_t tail = ring.tail.load();
+        size_t space = SHARED_RING_DATA_SIZE - (head - tail);
+        if (space == 0) {
+            if (!handle->attached.load())
+                break; // nobody to wait for, discard the rest
+            ring.producerWaiting.store(1);
+            if (ring.tail.load() != tail || !handle->attached.load()) {
+                ring.producerWaiting.store(0);
+                continue;
+            }
+            WaitForEvent(handle->events[1]);
+            continue;
+        }
+
+        uint64_t offset = head % SHARED_RING_DATA_SIZE;
+        size_t count = MIN(MIN(space, size - written), SHARED_RING_DATA_SIZE - offset);
+        memcpy(handle->output + offset, static_cast<const uint8_t*>(buffer) + written, count);
+        written += count;
+
+        ring.head.store(head + count);
+        if (ring.consumerWaiting.exchange(0) != 0)
+            SignalEvent(handle->events[0]);
+    }
+
+    return static_cast<ssize_t>(size);
+}
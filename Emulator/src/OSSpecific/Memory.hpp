@@ -21,8 +21,56 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <stdint.h>
 #include <stddef.h>
 
+#include <string>
+
+#include "File.hpp"
+
 namespace OSSpecific {
 
+    enum class HugePageMode {
+        NONE,
+        TRANSPARENT, // advise the host to back COW memory with transparent huge pages
+        EXPLICIT     // take huge pages from the host's reserved pool, falling back to TRANSPARENT
+    };
+
+    // How COW memory, which backs guest RAM, is allocated. Has to be set before the emulator starts.
+    struct GuestMemoryConfig {
+        HugePageMode hugePages = HugePageMode::NONE;
+        bool prefault = false; // fault every page in when it is allocated, instead of on first guest access
+        bool lock = false;     // lock allocations into host memory, which also faults them in
+        std::string imagePath; // file with the initial contents of guest RAM, empty for zeroed RAM
+        std::string exportPath; // where to publish the map of guest RAM shared with other processes, empty to keep it private
+    };
+
+    // What can be mapped into a range of COW memory, from least to most special
+    enum class COWBacking {
+        ANONYMOUS,
+        PRIVATE_FILE, // MapFileIntoCOWMemory
+        SHARED_FILE   // MapFileIntoCOWMemory with shared set
+    };
+
+    extern GuestMemoryConfig g_GuestMemoryConfig;
+
+    // Running totals of what COW allocations asked for and what the host gave them
+    struct COWMemoryStats {
+        uint64_t allocatedBytes;
+        uint64_t hugeTLBBytes;     // taken from the explicit huge page pool
+        uint64_t hugeTLBFallbacks; // explicit huge page allocations that fell back to ordinary pages
+        uint64_t advisedBytes;     // advised for transparent huge pages
+        uint64_t prefaultedBytes;
+        uint64_t lockedBytes;
+        uint64_t lockFailures;
+        uint64_t discardedBytes;   // given back to the host, which doesn't count memory that could only be cleared
+    };
+
+    // What is actually backing a range of COW memory right now
+    struct COWMemoryUsage {
+        uint64_t residentBytes;
+        uint64_t sharedBytes; // resident, but also mapped by other processes, like RAM image pages nobody has written to
+        uint64_t hugePageBytes;
+        uint64_t lockedBytes;
+    };
+
     void* GenericAllocateMemory(size_t size);
     void* GenericAllocateZeroedMemory(size_t size);
     void GenericFreeMemory(void* ptr);
@@ -30,9 +78,41 @@ namespace OSSpecific {
 
     void* AllocateCOWMemory(size_t size);
     void* AllocateZeroedCOWMemory(size_t size);
-    void FreeCOWMemory(void* ptr);
     void FreeSizedCOWMemory(void* ptr, size_t size);
 
+    // Grows or shrinks COW memory, keeping its contents. The memory can move, and any new part is zeroed.
+    // Only the first dataSize bytes are in use, so nothing past them is pre-faulted or locked. Use PrepareCOWMemory as the rest comes into use.
+    void* ResizeCOWMemory(void* ptr, size_t oldSize, size_t newSize, size_t dataSize);
+
+    // Applies the configured pre-faulting and locking to part of COW memory that is now in use
+    void PrepareCOWMemory(void* ptr, size_t size);
+
+    // Moves everything from offset onwards into a new COW allocation, which is returned. ptr keeps the first offset bytes.
+    void* SplitCOWMemory(void* ptr, size_t size, size_t offset);
+
+    // Drops the contents of part of COW memory, giving whole pages back to the host. All of it reads as zero afterwards.
+    // backing is the most special thing that may be mapped into it, since files need more than dropping pages.
+    void DiscardCOWMemory(void* ptr, size_t size, COWBacking backing);
+
+    // Replaces size bytes of COW memory at ptr with a private copy-on-write mapping of the file from offset, so untouched
+    // pages are shared with everything else mapping it. The file has to cover the whole range. Parts that can't be mapped are read in.
+    // If shared is set, the mapping is shared instead, so writes go to the file. The whole range then has to be page aligned.
+    void MapFileIntoCOWMemory(void* ptr, size_t size, FileHandle_t handle, size_t offset, bool shared = false);
+
+    // Creates size bytes of zeroed memory that other processes can map, for MapFileIntoCOWMemory with shared set.
+    // path is set to where other processes can open it.
+    FileHandle_t CreateSharedMemory(size_t size, std::string& path);
+    void DestroySharedMemory(FileHandle_t handle, const std::string& path);
+
+    // Moves size bytes of COW memory from src to dst, moving whole pages instead of copying them where possible.
+    // src is left undefined, and still has to be freed.
+    void MoveCOWMemory(void* dst, void* src, size_t size);
+
+    COWMemoryStats GetCOWMemoryStats();
+
+    // Returns false if the host can't report it
+    bool QueryCOWMemory(void* ptr, size_t size, COWMemoryUsage& usage);
+
 }
 
 #endif /* _OS_SPECIFIC_MEMORY_HPP */
\ No newline at end of file
@@ -26,13 +26,21 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 struct TCPSocketHandle_t;
 
-TCPSocketHandle_t* OpenTCPSocket(int port);
+enum class TCPSocketPolicy {
+    BROADCAST,   // output goes to every client, input is taken from every client
+    FIRST_WRITER // output goes to every client, input is only taken from the first client to send any, until it disconnects
+};
+
+// Listen on port. Does not wait for a client, any number of clients can connect and disconnect at any time.
+TCPSocketHandle_t* OpenTCPSocket(int port, TCPSocketPolicy policy = TCPSocketPolicy::BROADCAST);
+// Same as OpenTCPSocket, but listening on a unix domain socket at path. The returned handle works with all the TCP socket functions.
+TCPSocketHandle_t* OpenUnixSocket(const char* path, TCPSocketPolicy policy = TCPSocketPolicy::BROADCAST);
 void CloseTCPSocket(TCPSocketHandle_t* handle);
 
-// Read from the oldest active client
+// Read input received from the clients, waiting until there is some. Returns 0 once the socket is closed.
 ssize_t ReadFromTCPSocket(TCPSocketHandle_t* handle, void* buffer, size_t size);
 
-// Write to the oldest active client
+// Write to every connected client. Never waits, output a client can't take yet is buffered for it.
 ssize_t WriteToTCPSocket(TCPSocketHandle_t* handle, const void* buffer, size_t size);
 
 #endif /* _OS_SPECIFIC_NETWORK_HPP */
\ No newline at end of file
@@ -0,0 +1,84 @@
+/*
+Copyright (©) 2025  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _OS_SPECIFIC_SHARED_RING_HPP
+#define _OS_SPECIFIC_SHARED_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __unix__
+#include <sys/types.h>
+#endif /* __unix__ */
+
+/*
+ * A pair of single producer, single consumer byte rings in shared memory, for exchanging data with a tool running on the same host.
+ *
+ * The emulator listens on a unix domain socket. When a tool connects, it is sent one byte with SCM_RIGHTS carrying 5 file descriptors:
+ * the memory (which is SHARED_RING_MEMORY_SIZE bytes, starting with a SharedRingHeader), then the data and space eventfds of the output
+ * ring, then the data and space eventfds of the input ring. The tool stays attached until it closes the connection, and only one tool
+ * can be attached at a time. Closing the connection ends the input, so the socket is removed then and no other tool can attach.
+ *
+ * head and tail are free-running byte counts, the position in the data is the count modulo SHARED_RING_DATA_SIZE.
+ * After publishing data, a producer writes to the data eventfd only if consumerWaiting was set, clearing it. After consuming data, a
+ * consumer writes to the space eventfd only if producerWaiting was set, clearing it. Before sleeping on an eventfd, a side sets its
+ * waiting flag and checks the ring again.
+ */
+
+#define SHARED_RING_MAGIC 0x474E495234365246 // "FR64RING"
+#define SHARED_RING_VERSION 1
+
+#define SHARED_RING_DATA_SIZE 0x10000
+#define SHARED_RING_OUTPUT_OFFSET 0x1000
+#define SHARED_RING_INPUT_OFFSET (SHARED_RING_OUTPUT_OFFSET + SHARED_RING_DATA_SIZE)
+#define SHARED_RING_MEMORY_SIZE (SHARED_RING_INPUT_OFFSET + SHARED_RING_DATA_SIZE)
+
+struct SharedRingControl {
+    alignas(64) std::atomic_uint64_t head; // only written by the producer
+    alignas(64) std::atomic_uint64_t tail; // only written by the consumer
+    alignas(64) std::atomic_uint32_t consumerWaiting;
+    std::atomic_uint32_t producerWaiting;
+};
+
+struct SharedRingHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t dataSize;
+    uint64_t outputOffset; // emulator -> tool
+    uint64_t inputOffset;  // tool -> emulator
+    SharedRingControl output;
+    SharedRingControl input;
+};
+
+static_assert(sizeof(SharedRingHeader) <= SHARED_RING_OUTPUT_OFFSET);
+static_assert(std::atomic_uint64_t::is_always_lock_free && std::atomic_uint32_t::is_always_lock_free);
+
+struct SharedRingHandle_t;
+
+// Create the shared memory and start listening for a tool on a unix domain socket at path. Does not wait for a tool.
+SharedRingHandle_t* OpenSharedRing(const char* path);
+void CloseSharedRing(SharedRingHandle_t* handle);
+
+// Read from the input ring, waiting until there is something to read. Returns 0 once a tool has detached and the ring is empty.
+ssize_t ReadFromSharedRing(SharedRingHandle_t* handle, void* buffer, size_t size);
+
+// Write to the output ring. Waits for space while a tool is attached, otherwise whatever doesn't fit is discarded.
+ssize_t WriteToSharedRing(SharedRingHandle_t* handle, const void* buffer, size_t size);
+
+#endif /* _OS_SPECIFIC_SHARED_RING_HPP */
@@ -343,6 +343,10 @@ uint64_t SafeSyncingRegister::GetValue(OperandSize size) const {
     }
 }
 
+void SafeSyncingRegister::SetValueNoCheck(uint64_t value) {
+    m_value = value;
+}
+
 SafeRegister::SafeRegister()
     : Register() {
 }
@@ -126,6 +126,7 @@ public:
 
     bool SetValue(uint64_t value, bool force = false) override;
     bool SetValue(uint64_t value, OperandSize size) override;
+    void SetValueNoCheck(uint64_t value); // doesn't mark the register dirty
 
     uint64_t GetValue() const override;
     uint64_t GetValue(OperandSize size) const override;
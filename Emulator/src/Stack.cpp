@@ -37,7 +37,7 @@ void Stack::push(uint64_t value) {
         g_ExceptionHandler->RaiseException(Exception::STACK_VIOLATION, code);
     }
     m_stackPointer += 8;
-    m_MMU->write64(m_stackPointer, value);
+    m_MMU->WritePhysical<uint64_t>(m_stackPointer, value);
 }
 
 uint64_t Stack::pop() {
@@ -48,13 +48,13 @@ uint64_t Stack::pop() {
         code.align = (m_stackPointer % 8) > 0 ? 1 : 0;
         g_ExceptionHandler->RaiseException(Exception::STACK_VIOLATION, code);
     }
-    uint64_t value = m_MMU->read64(m_stackPointer);
+    uint64_t value = m_MMU->ReadPhysical<uint64_t>(m_stackPointer);
     m_stackPointer -= 8;
     return value;
 }
 
 uint64_t Stack::peek() {
-    return m_MMU->read64(m_stackPointer);
+    return m_MMU->ReadPhysical<uint64_t>(m_stackPointer);
 }
 
 void Stack::clear() {
@@ -46,7 +46,7 @@ public:
     bool WillUnderflowOnPop() const;
     
 private:
-    MMU* m_MMU;
+    MMU* m_MMU; // always the physical MMU, so accesses use its inline ReadPhysical/WritePhysical
 
     Register& m_stackBase;
     Register& m_stackPointer;
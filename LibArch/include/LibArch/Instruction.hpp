@@ -72,6 +72,8 @@ namespace InsEncoding {
         SYSCALL,
         SYSRET,
         ENTERUSER,
+        INVLPG,
+        INVASID,
         UNKNOWN = 0xFF
     };
 
@@ -166,6 +166,8 @@ namespace InsEncoding {
         case Opcode::JNL:
         case Opcode::JNLE:
         case Opcode::ENTERUSER:
+        case Opcode::INVLPG:
+        case Opcode::INVASID:
         case Opcode::PUSH:
         case Opcode::POP:
         case Opcode::INT:
@@ -232,6 +234,8 @@ namespace InsEncoding {
             NAME_CASE(SYSCALL)
             NAME_CASE(SYSRET)
             NAME_CASE(ENTERUSER)
+            NAME_CASE(INVLPG)
+            NAME_CASE(INVASID)
             NAME_CASE(UNKNOWN)
         }
     #undef NAME_CASE
@@ -104,30 +104,19 @@ namespace AVLTree {
         int64_t balance = getBalance(root);
 
         // STEP 4: BALANCE THE NODE
-        // Left, Left Case
-        if (balance > 1 && key < root->left->key)
-            root = rightRotate(root);
-
-        // Right, Right Case
-        if (balance < -1 && key > root->right->key)
-            root = leftRotate(root);
-
-        assert(root->left != nullptr);
-
-        // Left Right Case
-        if (balance > 1 && key > root->left->key) {
-            if (root->left->right != nullptr) {
+        // Only one case can apply, and root changes once it has been rotated
+        if (balance > 1) {
+            // Left Right Case
+            if (key > root->left->key)
                 root->left = leftRotate(root->left);
-                root = rightRotate(root);
-            }
-        }
-
-        // Right Left Case
-        if (balance < -1 && key < root->right->key) {
-            if (root->right->left != nullptr) {
+            // Left Left Case
+            root = rightRotate(root);
+        } else if (balance < -1) {
+            // Right Left Case
+            if (key < root->right->key)
                 root->right = rightRotate(root->right);
-                root = leftRotate(root);
-            }
+            // Right Right Case
+            root = leftRotate(root);
         }
 
         return node;
@@ -226,23 +215,18 @@ namespace AVLTree {
         int64_t balance = getBalance(root);
 
         // STEP 4: BALANCE THE NODE
-        // Left, Left Case
-        if (balance > 1 && getBalance(root->left) >= 0)
-            root = rightRotate(root);
-
-        // Left Right Case
-        if (balance > 1 && getBalance(root->left) < 0) {
-            root->left = leftRotate(root->left);
+        // Only one case can apply, and root changes once it has been rotated
+        if (balance > 1) {
+            // Left Right Case
+            if (getBalance(root->left) < 0)
+                root->left = leftRotate(root->left);
+            // Left Left Case
             root = rightRotate(root);
-        }
-
-        // Right, Right Case
-        if (balance < -1 && getBalance(root->right) <= 0)
-            root = leftRotate(root);
-
-        // Right Left Case
-        if (balance < -1 && getBalance(root->right) > 0) {
-            root->right = rightRotate(root->right);
+        } else if (balance < -1) {
+            // Right Left Case
+            if (getBalance(root->right) > 0)
+                root->right = rightRotate(root->right);
+            // Right Right Case
             root = leftRotate(root);
         }
     }